@@ -0,0 +1,1247 @@
+#include "broadcast_protocol.h"
+
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// ========== 基准测试 ==========
+// 用法: ./bench <subcommand> [options]
+//   transport  在本机组播回环上对比各传输后端的收发吞吐
+//   sim        经进程内模拟网络收发，给出可复现的丢包/乱序/时延/吞吐
+//   checksum   各数据块校验实现的吞吐（字节/周期）
+//   hash       文件hash（simple_hash与hash64各实现）的吞吐
+//   fec        修复符号编解码（GF(256)各实现）的吞吐
+
+#define BENCH_MSG_TYPE 0xB0 // 基准测试报文类型（不与协议报文冲突）
+
+// ========== transport: 组播回环吞吐 ==========
+typedef struct
+{
+    uint32_t expected;
+    size_t size;
+    volatile uint32_t received;
+    volatile uint64_t last_rx_ns;
+} TransportBenchRx;
+
+static void *transport_bench_rx_thread(void *arg)
+{
+    TransportBenchRx *rx = arg;
+
+    while (1)
+    {
+        PacketBuf *pkt = transport_recv_packet();
+        if (!pkt)
+        {
+            break;
+        }
+        if (pkt->len == rx->size && pkt->data[0] == BENCH_MSG_TYPE)
+        {
+            rx->received++;
+            rx->last_rx_ns = get_monotonic_ns();
+        }
+        packet_release(pkt);
+    }
+    return NULL;
+}
+
+typedef struct
+{
+    TransportBackend backend;
+    bool offload;
+} TransportBenchConfig;
+
+// 单个后端跑一轮：发送count个size字节的报文，经组播回环收回
+static int transport_bench_run(const TransportBenchConfig *config, uint32_t count, size_t size)
+{
+    transport_set_offload(config->offload);
+    if (!transport_init_backend(config->backend, false))
+    {
+        fprintf(stderr, "Failed to initialize transport layer\n");
+        return 1;
+    }
+    transport_set_pacing(0, 0); // 不限速
+
+    TransportBenchRx rx = {.expected = count, .size = size};
+    pthread_t rx_thread;
+    pthread_create(&rx_thread, NULL, transport_bench_rx_thread, &rx);
+    pthread_detach(rx_thread); // 线程后端关闭时不唤醒阻塞在接收队列上的应用线程，不等待其退出
+    usleep(100 * 1000);
+
+    uint64_t start_ns = get_monotonic_ns();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        PacketBuf *pkt = packet_alloc();
+        memset(pkt->data, 0, size);
+        pkt->data[0] = BENCH_MSG_TYPE;
+        memcpy(pkt->data + 4, &i, sizeof(i));
+        pkt->len = size;
+        transport_send_packet(pkt);
+    }
+    transport_flush();
+    uint64_t sent_ns = get_monotonic_ns();
+
+    // 等待回环报文到齐（回环上的丢包表现为接收不再增长）
+    uint32_t last_received = 0;
+    for (int idle = 0; idle < 10 && rx.received < count; )
+    {
+        usleep(20 * 1000);
+        idle = (rx.received == last_received) ? idle + 1 : 0;
+        last_received = rx.received;
+    }
+
+    uint64_t end_ns = rx.received ? rx.last_rx_ns : sent_ns;
+    double tx_sec = (sent_ns - start_ns) / 1e9;
+    double rx_sec = (end_ns - start_ns) / 1e9;
+
+    printf("%-26s size %4zu: tx %8.0f pkt/s %8.1f Mbit/s | rx %u/%u (%.2f%% lost) %8.0f pkt/s %8.1f Mbit/s\n",
+           transport_backend_name(), size, count / tx_sec, count * size * 8 / tx_sec / 1e6,
+           rx.received, count, 100.0 * (count - rx.received) / count,
+           rx.received / rx_sec, rx.received * size * 8 / rx_sec / 1e6);
+
+    transport_close();
+    return 0;
+}
+
+static int bench_transport(int argc, char *argv[])
+{
+    uint32_t count = 200000;
+    size_t size = offsetof(DataChunk, data) + DEFAULT_CHUNK_SIZE; // 默认块大小的数据报文，不超过默认MTU
+    int only_backend = -1;
+    bool only_offload = false;
+
+    static const struct option long_options[] = {
+        {"count", required_argument, NULL, 'n'},
+        {"size", required_argument, NULL, 's'},
+        {"transport", required_argument, NULL, 't'},
+        {"offload", no_argument, NULL, 'o'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:s:t:o", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            count = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            size = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+        {
+            TransportBackend backend;
+            if (!transport_parse_backend(optarg, &backend) || backend == TRANSPORT_BACKEND_SIM)
+            {
+                fprintf(stderr, "Unknown transport backend: %s\n", optarg);
+                return 1;
+            }
+            only_backend = backend;
+            break;
+        }
+        case 'o':
+            only_offload = true;
+            break;
+        default:
+            fprintf(stderr, "Usage: bench transport [--count N] [--size BYTES] [--transport socket|uring] [--offload]\n");
+            return 1;
+        }
+    }
+
+    if (count == 0 || size < 8 || size > MAX_PACKET_SIZE)
+    {
+        fprintf(stderr, "Invalid count/size\n");
+        return 1;
+    }
+
+    printf("Loopback multicast %s:%d, %u packets per backend\n", MULTICAST_GROUP, MULTICAST_PORT, count);
+
+    // 传输层是进程内单例，每种配置在独立子进程中运行
+    const TransportBenchConfig configs[] = {
+        {TRANSPORT_BACKEND_THREADS, false},
+        {TRANSPORT_BACKEND_THREADS, true},
+        {TRANSPORT_BACKEND_IO_URING, false},
+    };
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+    {
+        if (only_backend >= 0 && (int)configs[i].backend != only_backend)
+        {
+            continue;
+        }
+        if (only_offload && !configs[i].offload)
+        {
+            continue;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            exit(transport_bench_run(&configs[i], count, size));
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ========== sim: 模拟网络 ==========
+typedef struct
+{
+    uint32_t expected;
+    volatile uint32_t received;
+    uint32_t reordered;
+    uint32_t max_seq;
+    uint64_t *latency_ns; // 按接收顺序记录的单向时延
+    volatile uint64_t last_rx_ns;
+} SimBenchRx;
+
+typedef struct
+{
+    uint32_t seq;
+    uint64_t sent_ns;
+} SimBenchStamp;
+
+static void *sim_bench_rx_thread(void *arg)
+{
+    SimBenchRx *rx = arg;
+
+    while (1)
+    {
+        PacketBuf *pkt = transport_recv_packet();
+        if (!pkt)
+        {
+            break;
+        }
+        if (pkt->data[0] == BENCH_MSG_TYPE && pkt->len >= 8 + sizeof(SimBenchStamp) && rx->received < rx->expected)
+        {
+            SimBenchStamp stamp;
+            memcpy(&stamp, pkt->data + 8, sizeof(stamp));
+            uint64_t now = get_monotonic_ns();
+
+            if (rx->received > 0 && stamp.seq < rx->max_seq)
+            {
+                rx->reordered++;
+            }
+            else
+            {
+                rx->max_seq = stamp.seq;
+            }
+            rx->latency_ns[rx->received] = now - stamp.sent_ns;
+            rx->last_rx_ns = now;
+            rx->received++;
+        }
+        packet_release(pkt);
+    }
+    return NULL;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int bench_sim(int argc, char *argv[])
+{
+    uint32_t count = 20000;
+    size_t size = offsetof(DataChunk, data) + DEFAULT_CHUNK_SIZE; // 默认块大小的数据报文，不超过默认MTU
+    uint64_t rate_kbps = 0;
+    SimNetConfig cfg;
+    sim_parse_config(NULL, &cfg);
+
+    static const struct option long_options[] = {
+        {"count", required_argument, NULL, 'n'},
+        {"size", required_argument, NULL, 's'},
+        {"rate", required_argument, NULL, 'r'},
+        {"sim", required_argument, NULL, 'm'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:s:r:m:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            count = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            size = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            rate_kbps = strtoull(optarg, NULL, 10);
+            break;
+        case 'm':
+            if (!sim_parse_config(optarg, &cfg))
+            {
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "Usage: bench sim [--count N] [--size BYTES] [--rate KBPS] [--sim SPEC]\n");
+            return 1;
+        }
+    }
+
+    if (count == 0 || size < 8 + sizeof(SimBenchStamp) || size > MAX_PACKET_SIZE)
+    {
+        fprintf(stderr, "Invalid count/size\n");
+        return 1;
+    }
+
+    // 基准只在进程内收发，不使用socket
+    cfg.local = true;
+    transport_set_sim(&cfg);
+    if (!transport_init_backend(TRANSPORT_BACKEND_SIM, false))
+    {
+        fprintf(stderr, "Failed to initialize transport layer\n");
+        return 1;
+    }
+    transport_set_pacing(rate_kbps * 1000, PACING_DEFAULT_BURST_BYTES);
+
+    SimBenchRx rx = {.expected = count};
+    rx.latency_ns = calloc(count, sizeof(uint64_t));
+    pthread_t rx_thread;
+    pthread_create(&rx_thread, NULL, sim_bench_rx_thread, &rx);
+    pthread_detach(rx_thread);
+
+    uint64_t start_ns = get_monotonic_ns();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        PacketBuf *pkt = packet_alloc();
+        memset(pkt->data, 0, size);
+        pkt->data[0] = BENCH_MSG_TYPE;
+        SimBenchStamp stamp = {.seq = i, .sent_ns = get_monotonic_ns()};
+        memcpy(pkt->data + 8, &stamp, sizeof(stamp));
+        pkt->len = size;
+        transport_send_packet(pkt);
+    }
+    uint64_t sent_ns = get_monotonic_ns();
+
+    // 等待在途报文交付（最长为时延 + 抖动 + 乱序延迟之后再空闲一段时间）
+    uint32_t last_received = 0;
+    for (int idle = 0; idle < 20 && rx.received < count;)
+    {
+        usleep(10 * 1000);
+        idle = (rx.received == last_received) ? idle + 1 : 0;
+        last_received = rx.received;
+    }
+
+    TransportStats stats;
+    transport_get_stats(&stats);
+    transport_close();
+
+    uint32_t received = rx.received;
+    double tx_sec = (sent_ns - start_ns) / 1e9;
+    double rx_sec = ((received ? rx.last_rx_ns : sent_ns) - start_ns) / 1e9;
+    qsort(rx.latency_ns, received, sizeof(uint64_t), compare_u64);
+
+    printf("Simulated network: loss %.2f%%, burst %.2f%%/%.2f%% (bad loss %.0f%%), delay %.3f ms, jitter %.3f ms, "
+           "rate %llu kbit/s, reorder %.2f%%, seed %llu\n",
+           cfg.loss_pct, cfg.burst_enter_pct, cfg.burst_exit_pct, cfg.burst_loss_pct, cfg.delay_us / 1000.0,
+           cfg.jitter_us / 1000.0, (unsigned long long)(cfg.rate_bps / 1000), cfg.reorder_pct,
+           (unsigned long long)cfg.seed);
+    printf("  sent %u x %zu bytes in %.3f s, delivered %u (lost %llu, overflow %llu), reordered %u\n", count, size,
+           tx_sec, received, (unsigned long long)stats.sim_lost, (unsigned long long)stats.sim_overflow,
+           rx.reordered);
+    printf("  goodput %.1f Mbit/s, one-way latency", received * size * 8 / rx_sec / 1e6);
+    if (received > 0)
+    {
+        printf(" p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", rx.latency_ns[received / 2] / 1e6,
+               rx.latency_ns[(uint64_t)received * 99 / 100] / 1e6, rx.latency_ns[received - 1] / 1e6);
+    }
+    else
+    {
+        printf(" n/a\n");
+    }
+
+    free(rx.latency_ns);
+    return 0;
+}
+
+// ========== checksum: 校验实现吞吐 ==========
+typedef struct
+{
+    const char *name;
+    uint32_t (*fn)(const uint8_t *data, size_t len);
+    bool available;
+} ChecksumBenchImpl;
+
+static uint32_t bench_crc16_bitwise(const uint8_t *data, size_t len)
+{
+    return crc16_bitwise(data, len);
+}
+
+static uint32_t bench_crc16(const uint8_t *data, size_t len)
+{
+    return crc16(data, len);
+}
+
+// 周期计数：优先使用perf的CPU周期计数器，不可用时x86退回TSC（参考周期）
+typedef struct
+{
+    int perf_fd;
+    const char *unit;
+} CycleCounter;
+
+static void cycle_counter_open(CycleCounter *counter)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    counter->perf_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#if defined(__x86_64__)
+    counter->unit = counter->perf_fd >= 0 ? "cycle" : "TSC cycle";
+#else
+    counter->unit = counter->perf_fd >= 0 ? "cycle" : NULL;
+#endif
+}
+
+static uint64_t cycle_counter_read(const CycleCounter *counter)
+{
+    if (counter->perf_fd >= 0)
+    {
+        uint64_t value = 0;
+        if (read(counter->perf_fd, &value, sizeof(value)) == sizeof(value))
+        {
+            return value;
+        }
+    }
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// 与逐位参考实现（及已知测试向量）对比，确认各实现结果一致
+static bool checksum_bench_verify(const uint8_t *data, size_t max_len)
+{
+    static const uint8_t vector[] = "123456789";
+    if (crc16(vector, 9) != 0x4B37 || crc16_bitwise(vector, 9) != 0x4B37 || crc32c(vector, 9) != 0xE3069283 ||
+        crc32c_sw(vector, 9) != 0xE3069283)
+    {
+        fprintf(stderr, "Check value mismatch for \"123456789\"\n");
+        return false;
+    }
+
+    for (size_t len = 0; len <= max_len; len++)
+    {
+        // 覆盖不同长度与非8字节对齐的起始地址
+        const uint8_t *p = data + (len % 8);
+        if (crc16(p, len) != crc16_bitwise(p, len) || crc32c(p, len) != crc32c_sw(p, len))
+        {
+            fprintf(stderr, "Checksum mismatch at length %zu\n", len);
+            return false;
+        }
+    }
+    return true;
+}
+
+static int bench_checksum(int argc, char *argv[])
+{
+    size_t size = DEFAULT_CHUNK_SIZE;
+    uint64_t total_mb = 64;
+
+    static const struct option long_options[] = {
+        {"size", required_argument, NULL, 's'},
+        {"mb", required_argument, NULL, 'm'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:m:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            size = strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            total_mb = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: bench checksum [--size BYTES] [--mb MB_PER_VARIANT]\n");
+            return 1;
+        }
+    }
+
+    if (size == 0 || size > MAX_PACKET_SIZE || total_mb == 0)
+    {
+        fprintf(stderr, "Invalid size/mb\n");
+        return 1;
+    }
+
+    uint8_t *data = malloc(MAX_PACKET_SIZE + 8);
+    if (!data)
+    {
+        perror("malloc");
+        return 1;
+    }
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < MAX_PACKET_SIZE + 8; i++)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        data[i] = seed >> 56;
+    }
+
+    if (!checksum_bench_verify(data, MAX_PACKET_SIZE))
+    {
+        free(data);
+        return 1;
+    }
+
+    char hw_name[32] = "crc32c hardware";
+    if (crc32c_hw_available())
+    {
+        snprintf(hw_name, sizeof(hw_name), "crc32c %s", crc32c_impl_name());
+    }
+    const ChecksumBenchImpl impls[] = {
+        {"crc16 bitwise", bench_crc16_bitwise, true},
+        {"crc16 slice-by-8", bench_crc16, true},
+        {"crc32c slice-by-8", crc32c_sw, true},
+        {hw_name, crc32c, crc32c_hw_available()},
+    };
+
+    CycleCounter counter;
+    cycle_counter_open(&counter);
+
+    printf("Checksum throughput, %zu-byte buffers, %llu MB per variant (results verified against bitwise CRC16 "
+           "and slice-by-8 CRC32C)\n",
+           size, (unsigned long long)total_mb);
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++)
+    {
+        if (!impls[i].available)
+        {
+            printf("  %-20s not supported on this CPU\n", impls[i].name);
+            continue;
+        }
+
+        // 逐位实现慢一个数量级，按比例减少数据量
+        uint64_t iterations = total_mb * 1024 * 1024 / size / (impls[i].fn == bench_crc16_bitwise ? 16 : 1);
+        if (iterations == 0)
+        {
+            iterations = 1;
+        }
+
+        volatile uint32_t sink = 0;
+        uint64_t start_ns = get_monotonic_ns();
+        uint64_t start_cycles = cycle_counter_read(&counter);
+        for (uint64_t n = 0; n < iterations; n++)
+        {
+            sink ^= impls[i].fn(data, size);
+        }
+        uint64_t cycles = cycle_counter_read(&counter) - start_cycles;
+        uint64_t elapsed_ns = get_monotonic_ns() - start_ns;
+        (void)sink;
+
+        double bytes = (double)iterations * size;
+        printf("  %-20s %8.2f GB/s", impls[i].name, bytes / elapsed_ns);
+        if (counter.unit && cycles > 0)
+        {
+            printf("  %6.3f bytes/%s", bytes / cycles, counter.unit);
+        }
+        printf("\n");
+    }
+
+    if (counter.perf_fd >= 0)
+    {
+        close(counter.perf_fd);
+    }
+    free(data);
+    return 0;
+}
+
+// ========== hash: 文件hash吞吐 ==========
+static const char *const g_hash64_impl_names[] = {"scalar", "sse2", "avx2", "neon"};
+
+// 各实现的一次性与任意分段流式结果都应与标量实现相同
+static bool hash_bench_verify(const uint8_t *data, size_t max_len)
+{
+    hash64_use_impl("scalar");
+    uint64_t *expected = malloc((max_len + 1) * sizeof(uint64_t));
+    if (!expected)
+    {
+        return false;
+    }
+    for (size_t len = 0; len <= max_len; len++)
+    {
+        expected[len] = hash64(data, len);
+    }
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < sizeof(g_hash64_impl_names) / sizeof(g_hash64_impl_names[0]); i++)
+    {
+        if (!hash64_use_impl(g_hash64_impl_names[i]))
+        {
+            continue;
+        }
+        for (size_t len = 0; ok && len <= max_len; len++)
+        {
+            Hash64State state;
+            hash64_init(&state);
+            for (size_t pos = 0, step = 1 + len % 97; pos < len; pos += step)
+            {
+                hash64_update(&state, data + pos, (len - pos < step) ? len - pos : step);
+            }
+            if (hash64(data, len) != expected[len] || hash64_final(&state) != expected[len])
+            {
+                fprintf(stderr, "hash64 %s mismatch at length %zu\n", g_hash64_impl_names[i], len);
+                ok = false;
+            }
+        }
+    }
+    free(expected);
+    return ok;
+}
+
+// 任意叶数（含各层需要上提奇数节点的情况）建树后，每个叶子的认证路径都应能验证到根
+static bool merkle_bench_verify(uint32_t max_leaves)
+{
+    uint64_t *leaves = malloc(max_leaves * sizeof(uint64_t));
+    if (!leaves)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < max_leaves; i++)
+    {
+        leaves[i] = hash64((const uint8_t *)&i, sizeof(i));
+    }
+
+    bool ok = true;
+    for (uint32_t count = 1; ok && count <= max_leaves; count++)
+    {
+        MerkleTree tree;
+        if (!merkle_build(&tree, leaves, count))
+        {
+            fprintf(stderr, "merkle_build failed for %u leaves\n", count);
+            ok = false;
+            break;
+        }
+        uint64_t root = merkle_root(&tree);
+        for (uint32_t index = 0; ok && index < count; index++)
+        {
+            uint64_t proof[MERKLE_MAX_DEPTH];
+            int proof_len = merkle_proof(&tree, index, proof);
+            if (proof_len < 0 || !merkle_verify(root, count, index, leaves[index], proof, proof_len))
+            {
+                fprintf(stderr, "merkle proof mismatch: %u leaves, index %u\n", count, index);
+                ok = false;
+            }
+        }
+        merkle_free(&tree);
+    }
+    free(leaves);
+    return ok;
+}
+
+// 以chunk_size为单位流式处理total字节（数据循环使用buffer），返回GB/s
+static double hash_bench_run(bool use_hash64, const uint8_t *buffer, size_t buffer_len, uint64_t total,
+                             size_t chunk_size, uint64_t *result)
+{
+    Hash64State state;
+    uint32_t fnv = SIMPLE_HASH_INIT;
+    hash64_init(&state);
+
+    uint64_t start_ns = get_monotonic_ns();
+    for (uint64_t done = 0; done < total;)
+    {
+        size_t offset = done % buffer_len;
+        size_t n = buffer_len - offset < chunk_size ? buffer_len - offset : chunk_size;
+        if (n > total - done)
+        {
+            n = total - done;
+        }
+        if (use_hash64)
+        {
+            hash64_update(&state, buffer + offset, n);
+        }
+        else
+        {
+            fnv = simple_hash_update(fnv, buffer + offset, n);
+        }
+        done += n;
+    }
+    *result = use_hash64 ? hash64_final(&state) : fnv;
+    return total / (double)(get_monotonic_ns() - start_ns);
+}
+
+static int bench_hash(int argc, char *argv[])
+{
+    const char *path = NULL;
+    size_t file_size = 300 * 1024; // 与make test-file生成的test_file.bin相同
+    uint64_t large_gb = 2;
+
+    static const struct option long_options[] = {
+        {"file", required_argument, NULL, 'f'},
+        {"size", required_argument, NULL, 's'},
+        {"gb", required_argument, NULL, 'g'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:s:g:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'f':
+            path = optarg;
+            break;
+        case 's':
+            file_size = strtoul(optarg, NULL, 10);
+            break;
+        case 'g':
+            large_gb = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: bench hash [--file PATH | --size BYTES] [--gb GB]\n");
+            return 1;
+        }
+    }
+
+    // 文件内容读入内存（或生成同样大小的随机数据），只测hash本身
+    uint8_t *data = NULL;
+    if (path)
+    {
+        FILE *fp = fopen(path, "rb");
+        if (!fp)
+        {
+            perror(path);
+            return 1;
+        }
+        fseek(fp, 0, SEEK_END);
+        file_size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        data = malloc(file_size ? file_size : 1);
+        if (data && fread(data, 1, file_size, fp) != file_size)
+        {
+            free(data);
+            data = NULL;
+        }
+        fclose(fp);
+    }
+    else
+    {
+        data = malloc(file_size ? file_size : 1);
+        uint64_t seed = 0x9E3779B97F4A7C15ULL;
+        for (size_t i = 0; data && i < file_size; i++)
+        {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            data[i] = seed >> 56;
+        }
+    }
+    if (!data || file_size < 4096)
+    {
+        fprintf(stderr, "Failed to prepare input (need at least 4096 bytes)\n");
+        free(data);
+        return 1;
+    }
+
+    if (!hash_bench_verify(data, 4096) || !merkle_bench_verify(300))
+    {
+        free(data);
+        return 1;
+    }
+
+    // 小文件重复多次以得到稳定的计时；大文件按1 MiB分段流式处理（模拟数GB文件，数据循环使用）
+    uint64_t small_total = file_size;
+    uint64_t repeat = (256ULL << 20) / file_size + 1;
+    uint64_t large_total = large_gb << 30;
+
+    printf("File hash throughput (GB/s); %s: %zu bytes x %llu passes, large: %llu GB streamed in 1 MiB updates\n",
+           path ? path : "test_file.bin-sized", file_size, (unsigned long long)repeat, (unsigned long long)large_gb);
+    printf("  %-22s %10s %10s  %s\n", "implementation", "file", "large", "hash");
+
+    for (int variant = -1; variant < (int)(sizeof(g_hash64_impl_names) / sizeof(g_hash64_impl_names[0])); variant++)
+    {
+        bool use_hash64 = variant >= 0;
+        char name[32];
+        if (use_hash64)
+        {
+            if (!hash64_use_impl(g_hash64_impl_names[variant]))
+            {
+                continue;
+            }
+            snprintf(name, sizeof(name), "hash64 %s", g_hash64_impl_names[variant]);
+        }
+        else
+        {
+            snprintf(name, sizeof(name), "simple_hash (FNV-1a)");
+        }
+
+        uint64_t result = 0;
+        double small_rate = 0;
+        for (uint64_t i = 0; i < repeat; i++)
+        {
+            // 每次都是一次完整的文件hash（按数据块大小分段，与传输时相同）
+            uint64_t start_ns = get_monotonic_ns();
+            hash_bench_run(use_hash64, data, file_size, small_total, DEFAULT_CHUNK_SIZE, &result);
+            small_rate += (double)(get_monotonic_ns() - start_ns);
+        }
+        small_rate = (double)small_total * repeat / small_rate;
+
+        uint64_t large_result = 0;
+        double large_rate = large_total ? hash_bench_run(use_hash64, data, file_size, large_total, 1 << 20,
+                                                         &large_result)
+                                        : 0;
+        printf("  %-22s %10.2f %10.2f  0x%016llX\n", name, small_rate, large_rate, (unsigned long long)result);
+    }
+
+    free(data);
+    return 0;
+}
+
+// ========== fec: GF(256)纠删码编解码吞吐 ==========
+static const char *const g_gf256_impl_names[] = {"scalar", "ssse3", "avx2", "neon"};
+
+// 各实现的区域乘加结果（所有系数、非16/32字节对齐的长度）都应与标量实现相同
+static bool fec_bench_verify(const uint8_t *data, size_t len)
+{
+    uint8_t *expected = malloc(len);
+    uint8_t *actual = malloc(len);
+    bool ok = expected && actual;
+    for (size_t i = 0; ok && i < sizeof(g_gf256_impl_names) / sizeof(g_gf256_impl_names[0]); i++)
+    {
+        if (!gf256_use_impl(g_gf256_impl_names[i]))
+        {
+            continue;
+        }
+        for (int c = 0; ok && c < 256; c++)
+        {
+            size_t n = len - c % 61;
+            memcpy(expected, data + len, n); // 以数据的后半段作为dst初值
+            memcpy(actual, data + len, n);
+            gf256_use_impl("scalar");
+            gf256_mul_add(expected, data, c, n);
+            gf256_use_impl(g_gf256_impl_names[i]);
+            gf256_mul_add(actual, data, c, n);
+            if (memcmp(expected, actual, n) != 0)
+            {
+                fprintf(stderr, "gf256 %s mismatch for coefficient %d, length %zu\n", g_gf256_impl_names[i], c, n);
+                ok = false;
+            }
+        }
+    }
+    free(expected);
+    free(actual);
+    return ok;
+}
+
+// 编码一个窗口的repairs个修复符号（每个源块乘加到全部符号上，与Master相同）
+static void fec_bench_encode(const uint8_t *source, int count, int repairs, uint8_t *symbols)
+{
+    memset(symbols, 0, (size_t)repairs * DEFAULT_CHUNK_SIZE);
+    for (int i = 0; i < count; i++)
+    {
+        for (int j = 0; j < repairs; j++)
+        {
+            gf256_mul_add(symbols + (size_t)j * DEFAULT_CHUNK_SIZE, source + (size_t)i * DEFAULT_CHUNK_SIZE,
+                          fec_coefficient(j, i), DEFAULT_CHUNK_SIZE);
+        }
+    }
+}
+
+// 丢失前repairs个源块，用全部修复符号恢复（与接收方相同：先减去已知块，再解方程组）；结果写入recovered
+static bool fec_bench_decode(const uint8_t *source, int count, int repairs, uint8_t *symbols, uint8_t *recovered)
+{
+    uint8_t repair_index[WINDOW_SIZE];
+    uint8_t missing_index[WINDOW_SIZE];
+    uint8_t *syndromes[WINDOW_SIZE];
+    uint8_t *out[WINDOW_SIZE];
+    for (int a = 0; a < repairs; a++)
+    {
+        repair_index[a] = a;
+        missing_index[a] = a;
+        syndromes[a] = symbols + (size_t)a * DEFAULT_CHUNK_SIZE;
+        out[a] = recovered + (size_t)a * DEFAULT_CHUNK_SIZE;
+    }
+    for (int i = repairs; i < count; i++)
+    {
+        for (int a = 0; a < repairs; a++)
+        {
+            gf256_mul_add(syndromes[a], source + (size_t)i * DEFAULT_CHUNK_SIZE, fec_coefficient(a, i), DEFAULT_CHUNK_SIZE);
+        }
+    }
+    return fec_solve(repair_index, missing_index, repairs, syndromes, out, DEFAULT_CHUNK_SIZE);
+}
+
+static int bench_fec(int argc, char *argv[])
+{
+    int repairs = 8;
+    uint32_t windows = 2000;
+
+    static const struct option long_options[] = {
+        {"repairs", required_argument, NULL, 'r'},
+        {"windows", required_argument, NULL, 'w'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "r:w:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            repairs = atoi(optarg);
+            break;
+        case 'w':
+            windows = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: bench fec [--repairs R] [--windows N]\n");
+            return 1;
+        }
+    }
+    if (repairs < 1 || repairs > WINDOW_SIZE)
+    {
+        fprintf(stderr, "--repairs must be between 1 and %d\n", WINDOW_SIZE);
+        return 1;
+    }
+
+    // 一个满窗口的源块、修复符号与恢复结果
+    size_t window_bytes = (size_t)WINDOW_SIZE * DEFAULT_CHUNK_SIZE;
+    uint8_t *source = malloc(window_bytes);
+    uint8_t *symbols = malloc((size_t)repairs * DEFAULT_CHUNK_SIZE);
+    uint8_t *recovered = malloc((size_t)repairs * DEFAULT_CHUNK_SIZE);
+    if (!source || !symbols || !recovered)
+    {
+        fprintf(stderr, "Failed to allocate buffers\n");
+        free(source);
+        free(symbols);
+        free(recovered);
+        return 1;
+    }
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < window_bytes; i++)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        source[i] = seed >> 56;
+    }
+
+    int status = 0;
+    if (!fec_bench_verify(source, DEFAULT_CHUNK_SIZE))
+    {
+        status = 1;
+    }
+
+    printf("FEC throughput (GB/s of source data); %d chunks x %d bytes per window, %d repair symbols, %u windows\n",
+           WINDOW_SIZE, DEFAULT_CHUNK_SIZE, repairs, windows);
+    printf("  %-10s %10s %10s\n", "gf256", "encode", "decode");
+
+    for (size_t i = 0; status == 0 && i < sizeof(g_gf256_impl_names) / sizeof(g_gf256_impl_names[0]); i++)
+    {
+        if (!gf256_use_impl(g_gf256_impl_names[i]))
+        {
+            continue;
+        }
+
+        uint64_t start_ns = get_monotonic_ns();
+        for (uint32_t w = 0; w < windows; w++)
+        {
+            fec_bench_encode(source, WINDOW_SIZE, repairs, symbols);
+        }
+        double encode_rate = (double)window_bytes * windows / (get_monotonic_ns() - start_ns);
+
+        // 解码会消耗修复符号，每次计时前重新编码（不计入时间）
+        uint64_t decode_ns = 0;
+        for (uint32_t w = 0; w < windows; w++)
+        {
+            fec_bench_encode(source, WINDOW_SIZE, repairs, symbols);
+            start_ns = get_monotonic_ns();
+            bool ok = fec_bench_decode(source, WINDOW_SIZE, repairs, symbols, recovered);
+            decode_ns += get_monotonic_ns() - start_ns;
+            if (!ok || memcmp(recovered, source, (size_t)repairs * DEFAULT_CHUNK_SIZE) != 0)
+            {
+                fprintf(stderr, "FEC %s failed to recover the erased chunks\n", g_gf256_impl_names[i]);
+                status = 1;
+                break;
+            }
+        }
+        printf("  %-10s %10.2f %10.2f\n", g_gf256_impl_names[i], encode_rate,
+               (double)window_bytes * windows / decode_ns);
+    }
+
+    free(source);
+    free(symbols);
+    free(recovered);
+    return status;
+}
+
+// ========== bitmap: 多字位图操作 ==========
+static const char *const g_bitmap_impl_names[] = {"scalar", "popcnt", "avx2", "neon"};
+
+// 逐字/逐位参考实现
+static bool bitmap_ref_test(const uint64_t *bitmap, uint32_t bit)
+{
+    return (bitmap[bit / 64] >> (bit % 64)) & 1;
+}
+
+static uint32_t bitmap_ref_next(const uint64_t *bitmap, uint32_t start, uint32_t nbits, bool value)
+{
+    for (uint32_t i = start; i < nbits; i++)
+    {
+        if (bitmap_ref_test(bitmap, i) == value)
+        {
+            return i;
+        }
+    }
+    return nbits;
+}
+
+// 随机位图，混入整字全0/全1以覆盖按128位跳过的路径
+static void bitmap_bench_fill(uint64_t *bitmap, uint32_t words, uint64_t *seed)
+{
+    for (uint32_t i = 0; i < words; i++)
+    {
+        *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint32_t kind = (*seed >> 60) % 4;
+        bitmap[i] = kind == 0 ? 0 : (kind == 1 ? ~0ULL : *seed ^ (*seed << 17));
+    }
+}
+
+// SIMD位图操作与popcount的各实现在1..MAX_WINDOW_WORDS个字（含奇数字数、nbits非64倍数）上都应与参考实现一致
+static bool bitmap_bench_verify()
+{
+    uint64_t a[MAX_WINDOW_WORDS], b[MAX_WINDOW_WORDS], out[MAX_WINDOW_WORDS];
+    uint64_t seed = 0x243F6A8885A308D3ULL;
+
+    for (uint32_t words = 1; words <= MAX_WINDOW_WORDS; words++)
+    {
+        for (int trial = 0; trial < 64; trial++)
+        {
+            bitmap_bench_fill(a, words, &seed);
+            bitmap_bench_fill(b, words, &seed);
+            uint32_t nbits = words * 64 - (uint32_t)(seed % 64); // 末字只用到部分位
+
+            // bitmap_or
+            memcpy(out, a, words * sizeof(uint64_t));
+            bitmap_or(out, b, words);
+            for (uint32_t i = 0; i < words; i++)
+            {
+                if (out[i] != (a[i] | b[i]))
+                {
+                    fprintf(stderr, "bitmap_or mismatch: %u words, word %u\n", words, i);
+                    return false;
+                }
+            }
+
+            // bitmap_missing
+            bitmap_missing(out, a, nbits);
+            for (uint32_t i = 0; i < words * 64; i++)
+            {
+                if (bitmap_ref_test(out, i) != (i < nbits && !bitmap_ref_test(a, i)))
+                {
+                    fprintf(stderr, "bitmap_missing mismatch: %u bits, bit %u\n", nbits, i);
+                    return false;
+                }
+            }
+
+            // bitmap_is_subset：a&b总是a|b的子集；a一般不是b的子集，翻转一位后各测一次
+            uint64_t both[MAX_WINDOW_WORDS], either[MAX_WINDOW_WORDS];
+            bool expected_subset = true;
+            for (uint32_t i = 0; i < words; i++)
+            {
+                both[i] = a[i] & b[i];
+                either[i] = a[i] | b[i];
+                expected_subset = expected_subset && (a[i] & ~b[i]) == 0;
+            }
+            if (!bitmap_is_subset(both, either, words) || bitmap_is_subset(a, b, words) != expected_subset)
+            {
+                fprintf(stderr, "bitmap_is_subset mismatch: %u words\n", words);
+                return false;
+            }
+            uint32_t flip = (uint32_t)(seed >> 32) % (words * 64);
+            both[flip / 64] |= 1ULL << (flip % 64);
+            either[flip / 64] &= ~(1ULL << (flip % 64));
+            if (bitmap_is_subset(both, either, words))
+            {
+                fprintf(stderr, "bitmap_is_subset missed bit %u of %u words\n", flip, words);
+                return false;
+            }
+
+            // bitmap_next_set / bitmap_next_zero：从各个起点查找
+            for (uint32_t start = 0; start <= nbits; start += 1 + start % 37)
+            {
+                if (bitmap_next_set(a, start, nbits) != bitmap_ref_next(a, start, nbits, true) ||
+                    bitmap_next_zero(a, start, nbits) != bitmap_ref_next(a, start, nbits, false))
+                {
+                    fprintf(stderr, "bitmap_next_set/zero mismatch: %u bits from %u\n", nbits, start);
+                    return false;
+                }
+            }
+
+            // bitmap_popcount：每个实现、每个前缀字数
+            for (size_t i = 0; i < sizeof(g_bitmap_impl_names) / sizeof(g_bitmap_impl_names[0]); i++)
+            {
+                if (!bitmap_use_impl(g_bitmap_impl_names[i]))
+                {
+                    continue;
+                }
+                uint32_t expected = 0;
+                for (uint32_t w = 0; w < words; w++)
+                {
+                    expected += __builtin_popcountll(a[w]);
+                }
+                if (bitmap_popcount(a, words) != expected)
+                {
+                    fprintf(stderr, "bitmap_popcount %s mismatch: %u words\n", g_bitmap_impl_names[i], words);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static int bench_bitmap(int argc, char *argv[])
+{
+    uint32_t words = MAX_WINDOW_WORDS;
+    uint64_t iterations = 2000000;
+
+    static const struct option long_options[] = {
+        {"words", required_argument, NULL, 'w'},
+        {"iterations", required_argument, NULL, 'n'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "w:n:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'w':
+            words = strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            iterations = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: bench bitmap [--words 1-%d] [--iterations N]\n", MAX_WINDOW_WORDS);
+            return 1;
+        }
+    }
+    if (words < 1 || words > MAX_WINDOW_WORDS)
+    {
+        fprintf(stderr, "--words must be between 1 and %d\n", MAX_WINDOW_WORDS);
+        return 1;
+    }
+
+    if (!bitmap_bench_verify())
+    {
+        return 1;
+    }
+    printf("Bitmap operations verified against scalar reference for 1..%d words\n", MAX_WINDOW_WORDS);
+
+    // NACK合并与覆盖判断的典型输入：稀疏缺块
+    uint64_t a[MAX_WINDOW_WORDS] = {0}, b[MAX_WINDOW_WORDS];
+    memset(b, 0xFF, sizeof(b));
+    a[words - 1] = 1ULL << 63;
+    uint64_t sink = 0;
+
+    printf("ns per call on %u-word bitmaps (%u chunks per window)\n", words, words * 64);
+    uint64_t start_ns = get_monotonic_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        b[i % words] ^= a[i % words];
+        bitmap_or(b, a, words);
+        sink += b[0];
+    }
+    printf("  %-22s %8.2f\n", "bitmap_or", (double)(get_monotonic_ns() - start_ns) / iterations);
+
+    start_ns = get_monotonic_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        a[0] ^= i & 1;
+        sink += bitmap_is_subset(a, b, words);
+    }
+    printf("  %-22s %8.2f\n", "bitmap_is_subset", (double)(get_monotonic_ns() - start_ns) / iterations);
+
+    start_ns = get_monotonic_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        a[0] ^= i & 1;
+        sink += bitmap_next_set(a, 1, words * 64);
+    }
+    printf("  %-22s %8.2f\n", "bitmap_next_set", (double)(get_monotonic_ns() - start_ns) / iterations);
+
+    for (size_t impl = 0; impl < sizeof(g_bitmap_impl_names) / sizeof(g_bitmap_impl_names[0]); impl++)
+    {
+        if (!bitmap_use_impl(g_bitmap_impl_names[impl]))
+        {
+            continue;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "bitmap_popcount %s", g_bitmap_impl_names[impl]);
+        start_ns = get_monotonic_ns();
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            b[i % words] ^= i;
+            sink += bitmap_popcount(b, words);
+        }
+        printf("  %-22s %8.2f\n", name, (double)(get_monotonic_ns() - start_ns) / iterations);
+    }
+    printf("  (checksum %llu)\n", (unsigned long long)sink);
+    return 0;
+}
+
+// ========== 主函数 ==========
+typedef struct
+{
+    const char *name;
+    int (*run)(int argc, char *argv[]);
+    const char *help;
+} BenchCommand;
+
+static const BenchCommand g_commands[] = {
+    {"transport", bench_transport, "Loopback multicast throughput per transport backend"},
+    {"sim", bench_sim, "Reproducible loss/reorder/latency through the in-process simulated network"},
+    {"checksum", bench_checksum, "Bytes/cycle of each chunk checksum implementation"},
+    {"hash", bench_hash, "File hash throughput: simple_hash vs hash64 (scalar/SSE2/AVX2/NEON); checks Merkle proofs"},
+    {"fec", bench_fec, "Reed-Solomon repair symbol encode/decode throughput per GF(256) implementation"},
+    {"bitmap", bench_bitmap, "Multi-word window bitmap operations (SSE2/NEON) and popcount implementations"},
+};
+
+static void print_usage(const char *prog)
+{
+    printf("Usage: %s <subcommand> [options]\n", prog);
+    printf("Subcommands:\n");
+    for (size_t i = 0; i < sizeof(g_commands) / sizeof(g_commands[0]); i++)
+    {
+        printf("  %-12s %s\n", g_commands[i].name, g_commands[i].help);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    setbuf(stdout, NULL);
+
+    if (argc < 2)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(g_commands) / sizeof(g_commands[0]); i++)
+    {
+        if (strcmp(argv[1], g_commands[i].name) == 0)
+        {
+            return g_commands[i].run(argc - 1, argv + 1);
+        }
+    }
+
+    print_usage(argv[0]);
+    return 1;
+}
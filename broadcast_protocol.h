@@ -1,8 +1,13 @@
 #ifndef BROADCAST_PROTOCOL_H
 #define BROADCAST_PROTOCOL_H
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // sendmmsg/recvmmsg
+#endif
+
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,22 +21,75 @@
 // ========== 协议参数配置 ==========
 #define MULTICAST_GROUP "239.255.1.1"
 #define MULTICAST_PORT 9000
-#define MAX_CHUNK_SIZE 1024      // 每个数据块1KB
-#define WINDOW_SIZE 64           // 每个窗口64个块
+#define DEFAULT_CHUNK_SIZE 1024  // 默认块大小（探测不到路径MTU时使用；v1定长格式固定为此大小）
+#define MAX_CHUNK_SIZE 8952      // 块大小上限（9000字节巨帧，见chunk_size_for_mtu）
+#define MIN_MTU 576              // --mtu下限（IPv4最小重组长度）
+#define MAX_MTU 9000             // --mtu上限（巨帧）
+#define IP_UDP_HEADER_LEN 28     // IPv4头 + UDP头
+#define WINDOW_SIZE 64           // 默认窗口大小（块数），也是流水线、重传缓存、写盘批次与FEC编码的分组单位（一个64位位图字）
+#define MAX_WINDOW_SIZE 4096     // --window可协商的窗口大小上限（位图由多个64位字组成）
+#define MAX_WINDOW_WORDS (MAX_WINDOW_SIZE / 64) // 窗口位图的最大字数
 #define MAX_UAVS 32              // 最大无人机数量
+#define RECEIVER_MAX_UAVS 256    // 单个receiver进程最多承载的虚拟UAV数（--uavs）
+#define UAV_BITMAP_WORDS ((RECEIVER_MAX_UAVS + 63) / 64) // 按uav_id（0-255）索引的UAV位图字数
 #define NACK_TIMEOUT_MS 15       // NACK随机退避最大延迟
-#define STATUS_REQ_INTERVAL 500  // 状态查询间隔（毫秒）增加以确保NACK有足够时间
+#define STATUS_REQ_INTERVAL 500  // 状态查询的初始应答超时（毫秒），测得NACK往返时间后改用自适应超时
+#define NACK_RTO_MIN_MS (NACK_TIMEOUT_MS * 2) // 自适应应答超时下限（不短于接收方的NACK随机退避）
+#define NACK_RTO_MAX_MS 2000                  // 自适应应答超时上限
 #define MAX_RETRANS_ROUNDS 10    // 最大重传轮数
 #define ANNOUNCE_REPEAT_COUNT 5  // 会话启动报文重复发送次数
 #define MAX_RESEND_BITMAP_ASK 30 // 每轮STATUS_REQ重发上限
+#define MAX_INFLIGHT_WINDOWS 32  // 多窗口滑动发送时同时处于查询/重传阶段的窗口数上限（--inflight）
 
-// ========== 丢包模拟配置（用于WSL2等不支持tc的环境）==========
-// 设置为0禁用丢包模拟，设置为1-100表示丢包百分比
-#define SIMULATE_PACKET_LOSS 0 // 丢包率百分比（0=禁用，10=10%丢包）
+// ========== 模拟网络配置 ==========
+// 丢包/时延等参数在运行时通过 --transport sim --sim <spec> 指定（见 SimNetConfig）
+#define SIM_MAX_PENDING 512 // 模拟链路上同时在途的报文上限（超出视为队列溢出丢弃）
 
 // ========== 队列配置 ==========
-#define QUEUE_CAPACITY 200   // 队列最大容量
-#define MAX_PACKET_SIZE 2048 // 最大报文长度
+#define QUEUE_CAPACITY 200      // 队列最大容量
+#define MAX_PACKET_SIZE (MAX_MTU - IP_UDP_HEADER_LEN) // 报文长度上限（缓冲池按选定的块大小分配，见transport_set_packet_size）
+#define TRANSPORT_BATCH_SIZE 32 // Tx/Rx线程单次sendmmsg/recvmmsg的最大报文数
+#define SPSC_RING_SLOTS 256     // 无锁环形队列槽位数（2的幂，不小于QUEUE_CAPACITY）
+#define SPSC_SPIN_COUNT 2000    // 队列空/满时进入futex休眠前的自旋次数
+#define CACHE_LINE_SIZE 64      // 缓存行大小（环形队列索引填充）
+#define PIPELINE_DEPTH 2        // Master在发送窗口N时预读/预校验的后续窗口数（N+1、N+2）
+#define RETRANS_CACHE_DEFAULT_KB 512 // Master重传缓存的默认内存预算（按整窗口折算，缓存报文另行加入缓冲池）
+#define STREAM_BUFFER_WINDOWS 4      // 流式模式下内存中保留的最近窗口数（代替回读文件供重传）
+#define STREAM_IDLE_DEFAULT_MS 1000  // 流式读取普通文件到达末尾后等待文件继续增长的时间
+#define WRITE_QUEUE_MAX 64           // Receiver写盘队列中待写批次上限（超出时接收路径等待，限制内存占用）
+// 报文缓冲池大小：两个队列 + Tx/Rx线程各一批在途报文 + Master流水线预备的窗口 + 应用层持有的少量报文
+// （io_uring后端的接收缓冲区同样来自缓冲池）
+#define PACKET_POOL_SIZE (QUEUE_CAPACITY * 2 + TRANSPORT_BATCH_SIZE * 2 + PIPELINE_DEPTH * WINDOW_SIZE + 16)
+
+// ========== UDP GSO/GRO配置 ==========
+#define UDP_GSO_MAX_SEGMENTS 64   // 一次GSO发送的最大分段数（内核UDP_MAX_SEGMENTS）
+#define UDP_GSO_MAX_BYTES 65000   // 一次GSO发送的最大负载字节数（不超过IP报文上限）
+#define GRO_RX_BUF_SIZE 65536     // GRO接收缓冲区大小（容纳一个合并后的报文）
+#define GRO_RX_BATCH 4            // 每次recvmmsg读取的GRO缓冲区数
+
+// ========== io_uring后端配置 ==========
+#define UR_SQ_ENTRIES 256  // 提交队列深度
+#define UR_CQ_ENTRIES 2048 // 完成队列深度（多发接收与零拷贝通知都会产生CQE）
+#define UR_RECV_BUFS 256   // 提供缓冲环中的接收缓冲区数（2的幂，取自缓冲池；该后端不使用两个传输队列）
+#define UR_BUF_GROUP 0     // 提供缓冲环的缓冲组ID
+
+// ========== 事件循环配置 ==========
+#define EVLOOP_MAX_TIMERS (RECEIVER_MAX_UAVS + 16) // 事件循环同时存在的定时器上限（每个虚拟UAV一个NACK退避定时器）
+#define EVLOOP_MAX_FDS 4     // 事件循环监听的文件描述符上限
+
+// ========== 发送速率控制 ==========
+#define PACING_DEFAULT_RATE_KBPS 20000        // 默认发送速率（kbit/s），0表示不限速
+#define PACING_DEFAULT_BURST_BYTES (16 * 1024) // 默认令牌桶容量（最大突发字节数）
+#define PACING_IDLE_GAP_NS 20000000ULL         // 发送间隔超过20ms视为空闲，不计入实际速率统计
+
+// ========== Merkle校验 ==========
+#define MERKLE_MAX_DEPTH 32 // 认证路径最大长度（最多2^32个窗口）
+
+// ========== 前向纠错 ==========
+// 按编码块进行：窗口内每WINDOW_SIZE个块（窗口位图的一个字）为一个编码块，
+// 每个编码块的源块与修复符号在GF(2^8)上共用256个互不相同的柯西点
+#define FEC_MAX_SOURCE WINDOW_SIZE                // 每编码块的源块数上限
+#define FEC_MAX_REPAIR (256 - FEC_MAX_SOURCE)     // 每编码块修复符号编号上限（超出后重传原始块）
 
 // ========== 消息类型 ==========
 typedef enum
@@ -40,17 +98,61 @@ typedef enum
     MSG_DATA_CHUNK = 2,
     MSG_STATUS_REQ = 3,
     MSG_NACK = 4,
-    MSG_END = 5
+    MSG_END = 5,
+    MSG_WINDOW_DIGEST = 6,
+    MSG_REPAIR = 7
 } MessageType;
 
 // ========== 消息结构定义 ==========
 
+// ========== 线上格式版本 ==========
+// MessageHeader.ver_flags（原reserved字段）：高4位为格式版本，低4位为标志位
+//   v1: 旧格式，ver_flags=0，主机字节序，数据块总是按sizeof(DataChunk)定长发送
+//   v2: 所有多字节字段使用网络字节序（大端），数据块只携带实际数据长度
+#define WIRE_VERSION_V1 1
+#define WIRE_VERSION_V2 2
+#define WIRE_VERSION_DEFAULT WIRE_VERSION_V2
+#define WIRE_VER_FLAGS(version, flags) ((uint8_t)((version) == WIRE_VERSION_V1 ? 0 : (((version) << 4) | ((flags) & 0x0F))))
+#define WIRE_GET_VERSION(ver_flags) (((ver_flags) >> 4) == 0 ? WIRE_VERSION_V1 : ((ver_flags) >> 4))
+#define WIRE_GET_FLAGS(ver_flags) ((ver_flags) & 0x0F)
+
+// 标志位（仅v2）
+//   WIRE_FLAG_CRC32C: SESSION_ANNOUNCE上表示本会话数据块使用CRC32C；DATA_CHUNK上表示crc字段为0，
+//                     数据之后追加4字节CRC32C（计入payload_len）
+//   WIRE_FLAG_MERKLE: SESSION_ANNOUNCE上表示携带merkle_root，Master会为每个窗口下发WINDOW_DIGEST
+//   WIRE_FLAG_DIGEST_REQ: NACK上表示该窗口已收齐但还没有拿到窗口摘要，请求Master重发
+//   WIRE_FLAG_HASH64: SESSION_ANNOUNCE上表示文件hash使用hash64；END上表示携带file_hash64
+//   WIRE_FLAG_STREAM: SESSION_ANNOUNCE上表示流式会话（总块数未知，total_chunks为0，由END确定）；
+//                     STATUS_REQ上表示携带total_chunks（Master目前已发送的块数）。与WIRE_FLAG_DIGEST_REQ
+//                     同一位，按消息类型区分
+#define WIRE_FLAG_CRC32C 0x01
+#define WIRE_FLAG_MERKLE 0x02
+#define WIRE_FLAG_DIGEST_REQ 0x04
+#define WIRE_FLAG_STREAM 0x04
+#define WIRE_FLAG_HASH64 0x08
+
+// ========== 数据块校验算法 ==========
+// 由Master选择并在SESSION_ANNOUNCE中宣告；每个数据块的标志位也携带算法，接收方据此校验
+typedef enum
+{
+    CHECKSUM_CRC16 = 0,  // CRC16(Modbus)，v1唯一支持的算法
+    CHECKSUM_CRC32C = 1, // CRC32C(Castagnoli)，CPU支持时使用SSE4.2/ARMv8 CRC指令
+} ChecksumType;
+
+// ========== 文件hash算法 ==========
+// 由Master在SESSION_ANNOUNCE中宣告（WIRE_FLAG_HASH64），v1及旧接收端使用FNV-1a 32位
+typedef enum
+{
+    FILE_HASH_FNV1A32 = 0, // simple_hash，逐字节FNV-1a
+    FILE_HASH_HASH64 = 1,  // hash64，向量化64位hash
+} FileHashType;
+
 // 通用消息头（所有消息前4字节）
 typedef struct __attribute__((packed))
 {
     uint8_t msg_type;     // 消息类型
-    uint8_t reserved;     // 保留字段
-    uint16_t payload_len; // 载荷长度
+    uint8_t ver_flags;    // 格式版本(高4位)/标志(低4位)，v1为0
+    uint16_t payload_len; // 载荷长度（v2为实际载荷字节数）
 } MessageHeader;
 
 // 阶段1: 会话启动消息
@@ -62,6 +164,7 @@ typedef struct __attribute__((packed))
     uint16_t window_size;  // 窗口大小（块数）
     uint32_t chunk_size;   // 每块大小（字节）
     char filename[64];     // 文件名
+    uint64_t merkle_root;  // 窗口摘要Merkle树的根（仅v2且带WIRE_FLAG_MERKLE时发送）
 } SessionAnnounce;
 
 // 阶段2: 数据块消息
@@ -79,9 +182,10 @@ typedef struct __attribute__((packed))
 typedef struct __attribute__((packed))
 {
     MessageHeader header;
-    uint16_t file_id;   // 文件ID
-    uint32_t window_id; // 窗口ID
-    uint16_t round_id;  // 查询轮次
+    uint16_t file_id;      // 文件ID
+    uint32_t window_id;    // 窗口ID
+    uint16_t round_id;     // 查询轮次
+    uint32_t total_chunks; // 流式会话中Master已发送的块数（仅v2且带WIRE_FLAG_STREAM时发送）
 } StatusRequest;
 
 // 阶段3: NACK消息（缺块反馈）
@@ -92,7 +196,7 @@ typedef struct __attribute__((packed))
     uint32_t window_id;      // 窗口ID
     uint16_t round_id;       // 轮次
     uint8_t uav_id;          // 发送方ID
-    uint64_t missing_bitmap; // 缺块bitmap（64位）
+    uint64_t missing_bitmap[MAX_WINDOW_WORDS]; // 缺块bitmap（v2省略末尾全0的字，至少1个字；v1只有第1个字）
 } NackMessage;
 
 // 阶段5: 结束消息
@@ -101,14 +205,57 @@ typedef struct __attribute__((packed))
     MessageHeader header;
     uint16_t file_id;      // 文件ID
     uint32_t total_chunks; // 总块数
-    uint32_t file_hash;    // 文件hash校验
+    uint32_t file_hash;    // 文件hash校验（FNV-1a 32位；使用hash64时为其低32位）
+    uint64_t file_hash64;  // hash64文件hash（仅v2且带WIRE_FLAG_HASH64时发送）
 } EndMessage;
 
+// 窗口摘要消息：窗口摘要及其到Merkle根的认证路径（v2只发送proof_len个节点）
+typedef struct __attribute__((packed))
+{
+    MessageHeader header;
+    uint16_t file_id;                  // 文件ID
+    uint32_t window_id;                // 窗口ID
+    uint64_t digest;                   // 窗口摘要（窗口内各块hash的hash）
+    uint8_t proof_len;                 // 认证路径长度
+    uint64_t proof[MERKLE_MAX_DEPTH];  // 从叶到根依次的兄弟节点
+} WindowDigestMessage;
+
+// 修复符号消息：编码块源块（补0到symbol_len）的柯西Reed-Solomon线性组合（仅v2，旧接收端按未知类型丢弃）
+typedef struct __attribute__((packed))
+{
+    MessageHeader header;
+    uint16_t file_id;             // 文件ID
+    uint32_t block_id;            // 编码块号（窗口号 * 窗口位图字数 + 窗口内的第几组WINDOW_SIZE块）
+    uint8_t repair_index;         // 修复符号编号（0 ~ FEC_MAX_REPAIR-1）
+    uint8_t source_count;         // 编码块内的源块数
+    uint16_t last_len;            // 编码块最后一块的数据长度
+    uint16_t symbol_len;          // 符号长度（窗口内最长的块）
+    uint32_t crc;                 // 符号数据的CRC32C
+    uint8_t data[MAX_CHUNK_SIZE]; // 符号数据
+} RepairSymbol;
+
+// ========== 报文缓冲区 ==========
+// 缓冲池中的报文句柄，引用计数归零时自动归还缓冲池
+typedef struct PacketBuf
+{
+    struct PacketBuf *next;        // 空闲链表指针（仅缓冲池内部使用）
+    int refcnt;                    // 引用计数（原子操作）
+    size_t len;                    // 报文有效长度
+    // 外部数据段（如输入文件的只读映射）：报文的[ext_offset, ext_offset+ext_len)不在data中，
+    // 发送时取自ext_data（分散/聚集发送，数据不经用户态拷贝）；ext_len为0时报文全部在data中
+    const uint8_t *ext_data;
+    size_t ext_offset;
+    size_t ext_len;
+    uint8_t data[]; // 报文内容（容量为缓冲池的报文大小，见transport_set_packet_size）
+} PacketBuf;
+
 // ========== 队列结构 ==========
+// 默认使用无锁单生产者/单消费者环形队列；编译时定义USE_MUTEX_QUEUE
+// （make -f makefile_broadcast QUEUE=mutex）改用互斥锁队列，便于对比测试
+#ifdef USE_MUTEX_QUEUE
 typedef struct
 {
-    uint8_t data[QUEUE_CAPACITY][MAX_PACKET_SIZE];
-    size_t lens[QUEUE_CAPACITY];
+    PacketBuf *pkts[QUEUE_CAPACITY]; // 报文句柄（不拷贝数据）
     int head;
     int tail;
     int count;
@@ -116,16 +263,73 @@ typedef struct
     pthread_cond_t not_empty;
     pthread_cond_t not_full;
 } PacketQueue;
+#else
+typedef struct
+{
+    // head/tail为自由递增计数，分别独占一个缓存行，避免生产者与消费者伪共享
+    _Alignas(CACHE_LINE_SIZE) uint32_t tail; // 生产者写入位置
+    uint32_t consumer_waiting;               // 消费者是否在futex上休眠
+    _Alignas(CACHE_LINE_SIZE) uint32_t head; // 消费者读取位置
+    uint32_t producer_waiting;               // 生产者是否在futex上休眠
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t producer_lock; // Tx队列可能有多个发送线程，生产端串行化
+    PacketBuf *pkts[SPSC_RING_SLOTS];                        // 报文句柄（不拷贝数据）
+} PacketQueue;
+#endif
+
+// ========== 传输层统计 ==========
+typedef struct
+{
+    uint64_t tx_packets;                              // 已发送报文数
+    uint64_t rx_packets;                              // 已接收报文数
+    uint64_t tx_bytes;                                // 已发送字节数
+    uint64_t pacing_rate_bps;                         // 配置的发送速率（0表示不限速）
+    uint64_t pacing_active_ns;                        // 有效发送时长（不含空闲间隔）
+    uint64_t pacing_waits;                            // 令牌不足而等待的次数
+    uint64_t tx_batch_hist[TRANSPORT_BATCH_SIZE + 1]; // 每次sendmmsg的批大小分布
+    uint64_t rx_batch_hist[TRANSPORT_BATCH_SIZE + 1]; // 每次recvmmsg的批大小分布
+    uint64_t tx_gso_sends;    // GSO发送的超大报文数
+    uint64_t tx_gso_segments; // 其中包含的分段（报文）数
+    uint64_t rx_gro_reads;    // 启用GRO时读到的报文数（可能是合并报文）
+    uint64_t rx_gro_segments; // 拆分后得到的分段数
+    uint64_t sim_lost;         // 模拟网络按丢包模型丢弃的报文数
+    uint64_t sim_overflow;     // 模拟链路队列溢出丢弃的报文数
+    uint64_t sim_reordered;    // 被额外延迟（乱序）的报文数
+    uint64_t sim_delivered;    // 模拟网络交付的报文数
+    uint64_t sim_delay_ns;     // 交付报文的模拟时延总和（排队 + 传播 + 抖动）
+} TransportStats;
 
 // ========== 本地状态结构 ==========
 
+// 流式64位hash状态 (见hash64_init)
+#define HASH64_STRIPE_SIZE 64
+typedef struct
+{
+    uint64_t acc[8];                 // 累加器
+    uint8_t buf[HASH64_STRIPE_SIZE]; // 不足一个条带的剩余数据
+    size_t buf_len;
+    size_t block_stripes;            // 当前块内已处理的条带数
+    uint64_t total_len;
+} Hash64State;
+
+// 流式文件hash
+typedef struct
+{
+    FileHashType type;
+    uint32_t fnv;     // FILE_HASH_FNV1A32
+    Hash64State h64;  // FILE_HASH_HASH64
+} FileHasher;
+
 // 窗口接收状态
 typedef struct
 {
     uint32_t window_id;
-    uint64_t received_bitmap; // 64位bitmap，1表示已收到
-    bool completed;           // 窗口是否完成
+    bool completed;           // 窗口是否完成（已收到的块见ReceiverSession.bitmaps）
     // uint8_t *data_buffer;     // 数据缓冲区
+    uint64_t *chunk_hashes; // 各块数据的hash，用于计算窗口摘要（窗口验证通过后释放）
+    uint64_t digest;        // 经Merkle路径验证的窗口摘要
+    bool digest_known;      // 是否已收到并验证窗口摘要
+    bool verified;          // 窗口数据已与摘要比对一致，不再重复校验
+    struct FecRepairSet **repairs; // 各编码块已收到但还不足以恢复缺失块的修复符号（按需分配，窗口完成后释放）
 } WindowState;
 
 // 接收方会话状态
@@ -134,23 +338,51 @@ typedef struct
     uint16_t file_id;
     uint32_t total_chunks;
     uint16_t window_size;
+    uint16_t window_words; // 每个窗口位图的64位字数
     uint32_t chunk_size;
     char filename[64];
-    uint32_t total_windows;
+    uint8_t wire_version; // 会话启动消息协商的线上格式版本
+    ChecksumType checksum_type; // 会话启动消息宣告的数据块校验算法
+    uint32_t total_windows; // windows数组长度（流式会话随数据到达增长）
     WindowState *windows; // 窗口状态数组
-    FILE *output_file;
+    uint64_t *bitmaps;    // 各窗口已收到的块（每窗口window_words个字，1表示已收到）
+    bool streaming;       // 流式会话：total_chunks为目前已知的块数
+    bool total_final;     // total_chunks已确定（非流式会话总是true）
+    int output_fd; // 输出文件（块由写盘线程批量pwritev写入）
+    struct ResumeHeader *resume; // 断点续传旁路文件的映射（流式会话不使用）
+    size_t resume_len;
     bool session_active;
     uint32_t received_chunks;
+    FileHasher file_hash;   // 已连续收到的前hashed_chunks个块的流式hash
+    uint32_t hashed_chunks; // 已计入file_hash的块数（即第一个缺失块的编号）
+    FileHasher *hash_checkpoints; // 各窗口起点处的file_hash（启用Merkle时分配，窗口修复时回退）
+    uint16_t last_chunk_len; // 最后一块的数据长度（收到后有效）
+    bool merkle_enabled;       // Master是否宣告了Merkle根
+    uint64_t merkle_root;
+    uint32_t verified_windows; // 已通过摘要校验的窗口数
 } ReceiverSession;
 
+// Merkle树：各层节点依次存放在nodes中，第0层为叶子（窗口摘要）
+typedef struct
+{
+    uint64_t *nodes;
+    uint32_t leaf_count;
+    uint32_t level_count;
+    uint32_t level_offset[MERKLE_MAX_DEPTH + 1];
+    uint32_t level_size[MERKLE_MAX_DEPTH + 1];
+} MerkleTree;
+
 // 发送方窗口状态
 typedef struct
 {
     uint32_t window_id;
-    uint64_t need_retransmit;      // 需要重传的块bitmap
     uint8_t round_count;           // 已查询轮数
     bool completed;                // 窗口是否完成
-    uint32_t responded_uav_bitmap; // 当前窗口最近一次查询收到响应的UAV位图
+    uint64_t responded_uav_bitmap[UAV_BITMAP_WORDS]; // 当前窗口最近一次查询收到响应的UAV位图
+    bool digest_requested;         // 有UAV请求重发窗口摘要
+    uint16_t query_round;          // 最近一次STATUS_REQ的轮次
+    uint64_t query_sent_ns;        // 最近一次STATUS_REQ的发送时间（测量NACK往返时间）
+    bool query_resent;             // 本轮STATUS_REQ已重发，应答无法对应到某次发送，不作为RTT样本
 } MasterWindowState;
 
 // 发送方会话状态
@@ -159,23 +391,125 @@ typedef struct
     uint16_t file_id;
     uint32_t total_chunks;
     uint16_t window_size;
+    uint16_t window_words; // 每个窗口位图的64位字数
     uint32_t chunk_size;
     char filename[64];
+    uint8_t wire_version; // 线上格式版本
+    ChecksumType checksum_type; // 数据块校验算法
+    FileHasher file_hash;   // 首次读取数据块时按顺序计算的流式hash
+    uint32_t hashed_chunks; // 已计入file_hash的块数
+    bool merkle_enabled;    // 是否下发窗口摘要（仅v2）
+    MerkleTree merkle;      // 窗口摘要Merkle树
     uint32_t total_windows;
+    uint32_t window_capacity; // windows数组长度（流式会话随数据到达增长）
+    bool streaming;           // 流式会话：总块数未知，数据到达即发送
+    bool stream_eof;          // 流已结束，total_chunks为最终块数
+    uint8_t *stream_buf;      // 最近STREAM_BUFFER_WINDOWS个窗口的数据（按chunk_id取模存放）
+    uint16_t *stream_lens;    // stream_buf中各块的数据长度
     FILE *input_file;
+    const uint8_t *input_map; // 输入文件的只读映射（--mmap），数据块直接取自映射
+    size_t input_size;
     MasterWindowState *windows;
+    uint64_t *retransmit_bitmaps; // 各窗口需要重传的块（每窗口window_words个字，随windows扩容）
     bool broadcast_completed;   // 是否完成初始广播
-    uint32_t known_uavs_bitmap; // 已知UAV集合（动态发现）
+    uint64_t known_uavs_bitmap[UAV_BITMAP_WORDS]; // 已知UAV集合（动态发现）
 } MasterSession;
 
 // ========== 工具函数声明 ==========
 
-// CRC16校验
+// CRC16校验 (slice-by-8查表实现)
 uint16_t crc16(const uint8_t *data, size_t len);
 
-// 简单hash计算
+// CRC16逐位参考实现 (结果与crc16相同，用于校验与基准对比)
+uint16_t crc16_bitwise(const uint8_t *data, size_t len);
+
+// CRC32C校验 (运行时选择硬件指令或slice-by-8软件实现)
+uint32_t crc32c(const uint8_t *data, size_t len);
+
+// CRC32C软件实现 (slice-by-8)
+uint32_t crc32c_sw(const uint8_t *data, size_t len);
+
+// 当前CPU是否支持CRC32C硬件指令
+bool crc32c_hw_available();
+
+// 当前CRC32C实现名称 ("SSE4.2" / "ARMv8 CRC" / "slice-by-8")
+const char *crc32c_impl_name();
+
+// 校验算法名称
+const char *checksum_name(ChecksumType type);
+
+// 计算数据块校验值并设置标志位 (编码前调用；CRC32C写在data[data_len]之后，报文缓冲区须留出4字节)
+void chunk_set_checksum(DataChunk *chunk, ChecksumType type);
+
+// 同上，但数据取自data（data_len字节，如文件映射），chunk->data中只写入CRC32C尾部
+void chunk_set_checksum_from(DataChunk *chunk, const uint8_t *data, ChecksumType type);
+
+// 按数据块标志位校验数据 (解码后调用)
+bool chunk_verify_checksum(const DataChunk *chunk);
+
+// 简单hash计算 (FNV-1a)
+#define SIMPLE_HASH_INIT 0x811C9DC5u // FNV-1a初始值
 uint32_t simple_hash(const uint8_t *data, size_t len);
 
+// 流式hash：按文件顺序依次传入各段数据，结果与对整个文件调用simple_hash相同
+uint32_t simple_hash_update(uint32_t hash, const uint8_t *data, size_t len);
+
+// 64位快速hash (XXH3风格，运行时选择AVX2/SSE2/NEON/标量实现)，用于文件hash、块hash与Merkle节点
+uint64_t hash64(const uint8_t *data, size_t len);
+
+// 流式64位hash：分段update的结果与对整体数据调用hash64相同
+void hash64_init(Hash64State *state);
+void hash64_update(Hash64State *state, const uint8_t *data, size_t len);
+uint64_t hash64_final(const Hash64State *state);
+
+// 当前hash64实现名称 ("avx2" / "sse2" / "neon" / "scalar")
+const char *hash64_impl_name();
+
+// 强制使用指定实现 (用于基准对比；CPU不支持时返回false)
+bool hash64_use_impl(const char *name);
+
+// 文件hash (按会话宣告的算法流式计算；FNV-1a 32位结果零扩展为64位)
+void file_hasher_init(FileHasher *hasher, FileHashType type);
+void file_hasher_update(FileHasher *hasher, const uint8_t *data, size_t len);
+uint64_t file_hasher_final(const FileHasher *hasher);
+const char *file_hash_name(FileHashType type);
+
+// 窗口摘要：窗口内按顺序排列的各块hash的hash
+uint64_t merkle_window_digest(const uint64_t *chunk_hashes, uint32_t count);
+
+// 构建Merkle树 (叶子为各窗口摘要；每层奇数个节点时最后一个直接提升到上一层)
+bool merkle_build(MerkleTree *tree, const uint64_t *leaves, uint32_t count);
+
+// Merkle根
+uint64_t merkle_root(const MerkleTree *tree);
+
+// 生成第index个叶子的认证路径，返回路径长度
+int merkle_proof(const MerkleTree *tree, uint32_t index, uint64_t *proof);
+
+// 用认证路径验证第index个叶子 (leaf_count须与构建时相同)
+bool merkle_verify(uint64_t root, uint32_t leaf_count, uint32_t index, uint64_t leaf, const uint64_t *proof,
+                   int proof_len);
+
+// 释放Merkle树
+void merkle_free(MerkleTree *tree);
+
+// GF(2^8)区域乘加 dst ^= c*src (运行时选择AVX2/SSSE3/NEON查表或标量实现)
+void gf256_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+
+// 当前GF(2^8)实现名称 ("avx2" / "ssse3" / "neon" / "scalar")
+const char *gf256_impl_name();
+
+// 强制使用指定实现 (用于基准对比；CPU不支持时返回false)
+bool gf256_use_impl(const char *name);
+
+// 修复符号repair_index中源块source_index的系数 (柯西矩阵元素)
+uint8_t fec_coefficient(uint32_t repair_index, uint32_t source_index);
+
+// 由m个修复符号恢复m个缺失源块：syndromes为已减去全部已知源块贡献的修复符号（repair_index对应），
+// 解出的缺失块（missing_index对应）写入out，各len字节
+bool fec_solve(const uint8_t *repair_index, const uint8_t *missing_index, int m, uint8_t *const *syndromes,
+               uint8_t *const *out, size_t len);
+
 // 创建组播socket
 int create_multicast_socket(bool sender);
 
@@ -185,9 +519,18 @@ int send_multicast(int sock, const void *data, size_t len);
 // 接收组播消息 (旧接口，内部使用)
 int recv_multicast(int sock, void *buffer, size_t len, struct sockaddr_in *src_addr);
 
+// 批量发送组播消息 (sendmmsg，返回成功发送的报文数)
+int send_multicast_batch(int sock, struct mmsghdr *msgs, int count);
+
+// 批量接收组播消息 (recvmmsg，阻塞直到至少收到1个报文)
+int recv_multicast_batch(int sock, struct mmsghdr *msgs, int count);
+
 // 获取当前时间（毫秒）
 uint64_t get_time_ms();
 
+// 获取单调时钟时间（纳秒）
+uint64_t get_monotonic_ns();
+
 // 打印bitmap（调试用）
 void print_bitmap(uint64_t bitmap);
 
@@ -197,12 +540,123 @@ int count_set_bits(uint64_t bitmap);
 // 判断bitmap1是否包含bitmap2的所有缺失块
 bool bitmap_covers(uint64_t bitmap1, uint64_t bitmap2);
 
+// ========== 多字位图 (位i在第i/64个字的第i%64位) ==========
+
+// 置位/测试第bit位
+void bitmap_set(uint64_t *bitmap, uint32_t bit);
+bool bitmap_test(const uint64_t *bitmap, uint32_t bit);
+
+// dst |= src (SSE2/NEON每次128位)
+void bitmap_or(uint64_t *dst, const uint64_t *src, uint32_t words);
+
+// 前nbits位中未置位的位：missing = ~received（末字超出nbits的位清零）
+void bitmap_missing(uint64_t *missing, const uint64_t *received, uint32_t nbits);
+
+// 置位数 (运行时选择AVX2查表/POPCNT/标量实现)
+uint32_t bitmap_popcount(const uint64_t *bitmap, uint32_t words);
+
+// 从start开始的第一个置位/未置位的位，没有时返回nbits (整128位全0/全1时一次跳过)
+uint32_t bitmap_next_set(const uint64_t *bitmap, uint32_t start, uint32_t nbits);
+uint32_t bitmap_next_zero(const uint64_t *bitmap, uint32_t start, uint32_t nbits);
+
+// a中置位的位在b中都置位
+bool bitmap_is_subset(const uint64_t *a, const uint64_t *b, uint32_t words);
+
+// 当前bitmap_popcount实现名称 ("avx2" / "popcnt" / "neon" / "scalar")
+const char *bitmap_impl_name();
+
+// 强制使用指定bitmap_popcount实现 (用于基准对比；CPU不支持时返回false)
+bool bitmap_use_impl(const char *name);
+
+// ========== 线上格式编解码 ==========
+
+// 将缓冲区中主机字节序的消息原地编码为指定版本的线上格式，返回应发送的字节数
+size_t wire_encode(void *msg, uint8_t version);
+
+// 校验收到的报文长度（payload_len与实际接收长度）并原地解码为主机字节序，非法报文返回false
+// （msg须为缓冲池的报文缓冲区，至少sizeof(NackMessage)字节：NACK省略的位图字在解码时补0）
+bool wire_decode(void *msg, size_t len);
+
+// ========== 块大小与路径MTU ==========
+
+// 探测到组播组的路径MTU（路由选出的出口接口的MTU，IP_MTU），失败时返回0
+uint32_t path_mtu_probe();
+
+// 一个报文在指定MTU下能承载的块大小（扣除IP/UDP头与REPAIR消息头，按8字节向下取整，不超过MAX_CHUNK_SIZE）
+uint32_t chunk_size_for_mtu(uint32_t mtu);
+
+// 承载chunk_size字节数据块/修复符号的报文缓冲区大小（不小于最长的控制报文）
+size_t packet_size_for_chunk(uint32_t chunk_size);
+
 // ========== 传输层接口 (新) ==========
 
+// 传输后端
+typedef enum
+{
+    TRANSPORT_BACKEND_THREADS = 0, // Tx/Rx线程 + sendmmsg/recvmmsg（默认）
+    TRANSPORT_BACKEND_IO_URING,    // io_uring：多发接收 + 提供缓冲环 + 固定缓冲区零拷贝发送
+    TRANSPORT_BACKEND_SIM,         // 模拟网络：在接收侧按SimNetConfig施加丢包/时延/带宽/乱序
+} TransportBackend;
+
+// 模拟网络参数（百分比均为0-100）
+// 每个节点的入口链路独立建模：先按Gilbert-Elliott模型（未配置时为独立丢包）决定是否丢弃，
+// 再按带宽排队、加上时延与抖动，部分报文额外延迟以产生乱序。随机数由seed与node_id确定，可复现
+typedef struct
+{
+    double loss_pct;          // 独立丢包率（Good状态丢包率）
+    double burst_enter_pct;   // Gilbert-Elliott: Good -> Bad 的转移概率，0表示不启用突发丢包
+    double burst_exit_pct;    // Gilbert-Elliott: Bad -> Good 的转移概率
+    double burst_loss_pct;    // Bad状态丢包率
+    uint32_t delay_us;        // 单向时延
+    uint32_t jitter_us;       // 时延抖动（均匀分布 ±jitter）
+    uint64_t rate_bps;        // 链路带宽，0表示不限
+    double reorder_pct;       // 额外延迟的报文比例
+    uint32_t reorder_us;      // 乱序报文的额外延迟
+    uint64_t seed;            // 随机数种子
+    uint32_t node_id;         // 节点编号（与seed一起派生各节点独立的随机序列）
+    uint32_t node_count;      // 本进程承载的节点数（node_id起连续编号）；>1时丢包改为按节点独立判定
+    bool local;               // true: 进程内网络（不使用socket，发送的报文回环给本节点）
+} SimNetConfig;
+
+// 解析模拟网络参数，格式: key=value[,key=value...]
+// 键: loss, burst_enter, burst_exit, burst_loss (百分比), delay_ms, jitter_ms, rate_kbps,
+//     reorder (百分比), reorder_ms, seed, net=udp|local
+bool sim_parse_config(const char *spec, SimNetConfig *cfg);
+
+// 设置模拟网络参数 (需在以TRANSPORT_BACKEND_SIM调用transport_init_backend之前调用)
+void transport_set_sim(const SimNetConfig *cfg);
+
+// 进程承载多个节点时，按节点独立的丢包模型判断该节点是否丢弃当前报文
+// (每个报文对每个节点调用一次；非模拟网络后端或单节点时总是返回false)
+bool transport_sim_node_drop(uint32_t node_id);
+
+// 启用UDP GSO/GRO分段卸载 (需在transport_init*之前调用；socket选项被拒绝时自动退回逐报文收发，
+// io_uring后端不使用)
+void transport_set_offload(bool enable);
+
+// 在PACKET_POOL_SIZE之外为调用方长期持有的报文（如重传缓存）预留缓冲池容量 (需在transport_init*之前调用)
+void transport_reserve_packets(size_t count);
+
+// 设置缓冲池中每个报文缓冲区的容量 (需在transport_init*之前调用，默认MAX_PACKET_SIZE；
+// 按选定的块大小设置，见packet_size_for_chunk)
+void transport_set_packet_size(size_t size);
+
+// 每个报文缓冲区占用的内存（含PacketBuf头部），用于按内存预算折算报文数
+size_t transport_packet_footprint();
+
+// 解析后端名称: socket | uring | sim
+bool transport_parse_backend(const char *name, TransportBackend *backend);
+
+// 按指定后端初始化传输层 (io_uring不可用时自动退回Tx/Rx线程)
+bool transport_init_backend(TransportBackend backend, bool is_sender);
+
+// 当前使用的传输后端名称
+const char *transport_backend_name();
+
 // 初始化传输层 (启动Tx/Rx线程)
 bool transport_init(bool is_sender);
 
-// 发送报文 (放入发送队列)
+// 发送报文 (拷贝到缓冲池后放入发送队列，适用于控制报文)
 void transport_send(const void *data, size_t len);
 
 // 接收报文 (从接收队列取出，阻塞直到有数据)
@@ -211,4 +665,70 @@ size_t transport_recv(void *buffer, size_t max_len);
 // 关闭传输层
 void transport_close();
 
+// ========== 事件循环运行时 (epoll + timerfd) ==========
+
+// 报文处理函数 (取得报文的一个引用，处理完后需packet_release)
+typedef void (*PacketHandler)(PacketBuf *pkt, void *arg);
+
+// 定时器/文件描述符回调
+typedef void (*EventTimerCallback)(void *arg);
+typedef void (*EventFdCallback)(void *arg);
+
+// 以事件循环模式初始化传输层 (不创建Tx/Rx线程，收到的报文在evloop_run中交给handler)
+bool transport_init_event_loop(bool is_sender, PacketHandler handler, void *arg);
+
+// 立即发送已积攒的数据报文 (事件循环/io_uring后端攒批发送，线程模式下为空操作)
+void transport_flush();
+
+// 初始化/关闭事件循环 (transport_init_event_loop/transport_close会自动调用)
+bool evloop_init();
+void evloop_close();
+
+// 监听文件描述符可读事件
+bool evloop_add_fd(int fd, EventFdCallback callback, void *arg);
+
+// 启动一次性定时器，返回定时器ID (失败返回-1)
+int evloop_timer_start(uint32_t delay_ms, EventTimerCallback callback, void *arg);
+
+// 取消定时器 (已触发或已取消的ID会被忽略)
+void evloop_timer_cancel(int timer_id);
+
+// 运行事件循环直到evloop_stop被调用
+void evloop_run();
+
+// 运行事件循环ms毫秒（期间照常处理报文与定时器）
+void evloop_run_for(uint32_t ms);
+
+// 请求事件循环返回
+void evloop_stop();
+
+// ========== 零拷贝报文接口 ==========
+
+// 从缓冲池分配报文（引用计数为1，缓冲池耗尽时阻塞）
+PacketBuf *packet_alloc();
+
+// 增加报文引用
+void packet_ref(PacketBuf *pkt);
+
+// 释放报文引用，归零时归还缓冲池
+void packet_release(PacketBuf *pkt);
+
+// 将外部数据段拷入data，之后报文可按连续缓冲区访问
+void packet_linearize(PacketBuf *pkt);
+
+// 发送缓冲池中的报文 (转移调用方持有的一个引用，Tx线程发送后释放)
+void transport_send_packet(PacketBuf *pkt);
+
+// 接收报文句柄 (阻塞直到有数据，调用方处理完后需packet_release)
+PacketBuf *transport_recv_packet();
+
+// 设置发送速率 (rate_bps=0表示不限速，burst_bytes为令牌桶容量)
+void transport_set_pacing(uint64_t rate_bps, uint32_t burst_bytes);
+
+// 获取传输层统计 (批大小分布等)
+void transport_get_stats(TransportStats *stats);
+
+// 打印传输层统计
+void transport_print_stats(const char *tag);
+
 #endif // BROADCAST_PROTOCOL_H
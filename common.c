@@ -1,18 +1,83 @@
 #include "broadcast_protocol.h"
 
+#include <endian.h>
+#include <limits.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <netinet/udp.h>
+#include <linux/futex.h>
+#include <linux/io_uring.h>
+
+// ========== 发送速率控制（令牌桶） ==========
+typedef struct
+{
+    pthread_mutex_t mutex;   // 保护速率参数（运行时可调整）
+    uint64_t rate_bps;       // 目标速率（bit/s），0表示不限速
+    uint32_t burst_bytes;    // 令牌桶容量（最大突发字节数）
+    double tokens;           // 当前令牌（字节）
+    uint64_t last_refill_ns; // 上次补充令牌的时间（CLOCK_MONOTONIC）
+    uint64_t last_send_ns;   // 上次发送的时间，用于统计有效发送时长
+} TokenBucket;
+
+// 接收报文的交付方式（放入接收队列/交给处理函数/进入模拟链路）
+typedef void (*RxDeliverFunc)(PacketBuf **pkts, int count);
+
+// 传输后端操作表：transport_*接口按当前后端分发
+typedef struct
+{
+    const char *name;
+    void (*send_packet)(PacketBuf *pkt, bool flush); // flush=true: 连同已积攒的报文立即发出
+    PacketBuf *(*recv_packet)();                      // 阻塞接收，回调交付的后端返回NULL
+    void (*flush)();
+    void (*close)();
+} TransportOps;
+
 // ========== 全局传输层状态 ==========
 static struct
 {
+    const TransportOps *ops;
+    RxDeliverFunc rx_deliver; // Rx线程收到报文后的去向
     int sock;
+    struct sockaddr_in dest_addr; // 组播目的地址
     PacketQueue tx_queue;
     PacketQueue rx_queue;
     pthread_t tx_thread;
     pthread_t rx_thread;
     bool running;
+    TransportStats stats;
+    TokenBucket pacer;
+
+    // UDP GSO/GRO：offload_requested由transport_set_offload设置，gso/gro为socket实际接受的选项
+    bool offload_requested;
+    size_t reserved_packets; // transport_reserve_packets预留的额外缓冲池容量
+    size_t packet_size;      // transport_set_packet_size设置的报文缓冲区容量，0表示MAX_PACKET_SIZE
+    bool gso;
+    bool gro;
+    uint8_t *gro_bufs; // GRO_RX_BATCH个GRO_RX_BUF_SIZE字节的接收缓冲区
+
+    // 事件循环模式：无Tx/Rx线程，发送在调用线程内批量完成，接收由epoll回调分发
+    PacketHandler rx_handler;
+    void *rx_handler_arg;
+    PacketBuf *tx_pending[TRANSPORT_BATCH_SIZE]; // 待发送的一批报文
+    int tx_pending_count;
+    PacketBuf *rx_bufs[TRANSPORT_BATCH_SIZE];    // recvmmsg接收缓冲区
 } g_transport;
 
-// ========== CRC16校验实现 ==========
-uint16_t crc16(const uint8_t *data, size_t len)
+// ========== 校验和实现 ==========
+// CRC16(Modbus, 反射多项式0xA001)与CRC32C(Castagnoli, 反射多项式0x82F63B78)的软件实现均为
+// slice-by-8：每次处理8字节，用8张256项的表代替逐位移位，结果与逐位实现完全相同。
+// CRC32C在CPU支持时（x86 SSE4.2 / ARMv8 CRC扩展）使用硬件指令，首次调用时检测并选择实现。
+
+static uint16_t g_crc16_table[8][256];
+static uint32_t g_crc32c_table[8][256];
+static uint32_t (*g_crc32c_impl)(uint32_t crc, const uint8_t *data, size_t len);
+static pthread_once_t g_checksum_once = PTHREAD_ONCE_INIT;
+
+uint16_t crc16_bitwise(const uint8_t *data, size_t len)
 {
     uint16_t crc = 0xFFFF;
     for (size_t i = 0; i < len; i++)
@@ -33,312 +98,4567 @@ uint16_t crc16(const uint8_t *data, size_t len)
     return crc;
 }
 
-// ========== 简单hash计算 ==========
-uint32_t simple_hash(const uint8_t *data, size_t len)
+// 按小端读取8字节（slice-by-8按数据流顺序处理字节；hash64的标量实现同样使用）
+static inline uint64_t load_le64(const uint8_t *p)
 {
-    uint32_t hash = 0x811C9DC5; // FNV-1a初始值
-    for (size_t i = 0; i < len; i++)
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return le64toh(v);
+}
+
+static uint32_t crc32c_sw_update(uint32_t crc, const uint8_t *data, size_t len)
+{
+    while (len >= 8)
     {
-        hash ^= data[i];
-        hash *= 0x01000193;
+        uint64_t x = load_le64(data) ^ crc;
+        crc = g_crc32c_table[7][x & 0xFF] ^ g_crc32c_table[6][(x >> 8) & 0xFF] ^
+              g_crc32c_table[5][(x >> 16) & 0xFF] ^ g_crc32c_table[4][(x >> 24) & 0xFF] ^
+              g_crc32c_table[3][(x >> 32) & 0xFF] ^ g_crc32c_table[2][(x >> 40) & 0xFF] ^
+              g_crc32c_table[1][(x >> 48) & 0xFF] ^ g_crc32c_table[0][x >> 56];
+        data += 8;
+        len -= 8;
     }
-    return hash;
+    while (len--)
+    {
+        crc = (crc >> 8) ^ g_crc32c_table[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
 }
 
-// ========== 创建组播socket ==========
-int create_multicast_socket(bool sender)
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+
+__attribute__((target("sse4.2"))) static uint32_t crc32c_hw_update(uint32_t crc, const uint8_t *data, size_t len)
 {
-    int sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0)
+    uint64_t crc64 = crc;
+    while (len >= 8)
     {
-        perror("socket creation failed");
-        return -1;
+        uint64_t v;
+        memcpy(&v, data, sizeof(v));
+        crc64 = _mm_crc32_u64(crc64, v);
+        data += 8;
+        len -= 8;
     }
-
-    // 设置socket选项允许地址重用
-    int reuse = 1;
-    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0)
+    crc = (uint32_t)crc64;
+    while (len--)
     {
-        perror("setsockopt SO_REUSEADDR failed");
-        close(sock);
-        return -1;
+        crc = _mm_crc32_u8(crc, *data++);
     }
+    return crc;
+}
 
-    if (sender)
-    {
-        // 发送方：设置TTL（跳数限制）
-        unsigned char ttl = 32;
-        if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0)
-        {
-            perror("setsockopt IP_MULTICAST_TTL failed");
-            close(sock);
-            return -1;
-        }
+static bool crc32c_hw_detect()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+}
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
 
-        // 启用回环（本地测试时需要，实际部署时可以禁用）
-        unsigned char loop = 1; // 改为1，启用回环
-        if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0)
-        {
-            perror("setsockopt IP_MULTICAST_LOOP failed");
-            close(sock);
-            return -1;
-        }
+__attribute__((target("+crc"))) static uint32_t crc32c_hw_update(uint32_t crc, const uint8_t *data, size_t len)
+{
+    while (len >= 8)
+    {
+        uint64_t v;
+        memcpy(&v, data, sizeof(v));
+        crc = __crc32cd(crc, v);
+        data += 8;
+        len -= 8;
     }
-    else
+    while (len--)
     {
-        // 接收方：绑定端口
-        struct sockaddr_in local_addr;
-        memset(&local_addr, 0, sizeof(local_addr));
-        local_addr.sin_family = AF_INET;
-        local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-        local_addr.sin_port = htons(MULTICAST_PORT);
+        crc = __crc32cb(crc, *data++);
+    }
+    return crc;
+}
 
-        if (bind(sock, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0)
+static bool crc32c_hw_detect()
+{
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+#else
+#define crc32c_hw_update NULL
+
+static bool crc32c_hw_detect()
+{
+    return false;
+}
+#endif
+
+static void checksum_init()
+{
+    for (int i = 0; i < 256; i++)
+    {
+        uint16_t c16 = i;
+        uint32_t c32 = i;
+        for (int j = 0; j < 8; j++)
         {
-            perror("bind failed");
-            close(sock);
-            return -1;
+            c16 = (c16 & 1) ? (c16 >> 1) ^ 0xA001 : c16 >> 1;
+            c32 = (c32 & 1) ? (c32 >> 1) ^ 0x82F63B78 : c32 >> 1;
         }
-
-        // 加入组播组
-        struct ip_mreq mreq;
-        mreq.imr_multiaddr.s_addr = inet_addr(MULTICAST_GROUP);
-        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
-        if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+        g_crc16_table[0][i] = c16;
+        g_crc32c_table[0][i] = c32;
+    }
+    // table[k][i]：字节i之后再经过k个0字节的CRC
+    for (int k = 1; k < 8; k++)
+    {
+        for (int i = 0; i < 256; i++)
         {
-            perror("setsockopt IP_ADD_MEMBERSHIP failed");
-            close(sock);
-            return -1;
+            uint16_t c16 = g_crc16_table[k - 1][i];
+            uint32_t c32 = g_crc32c_table[k - 1][i];
+            g_crc16_table[k][i] = (c16 >> 8) ^ g_crc16_table[0][c16 & 0xFF];
+            g_crc32c_table[k][i] = (c32 >> 8) ^ g_crc32c_table[0][c32 & 0xFF];
         }
     }
 
-    return sock;
+    g_crc32c_impl = crc32c_hw_detect() ? crc32c_hw_update : crc32c_sw_update;
 }
 
-// ========== 发送组播消息 ==========
-int send_multicast(int sock, const void *data, size_t len)
+uint16_t crc16(const uint8_t *data, size_t len)
 {
-    struct sockaddr_in dest_addr;
-    memset(&dest_addr, 0, sizeof(dest_addr));
-    dest_addr.sin_family = AF_INET;
-    dest_addr.sin_addr.s_addr = inet_addr(MULTICAST_GROUP);
-    dest_addr.sin_port = htons(MULTICAST_PORT);
+    pthread_once(&g_checksum_once, checksum_init);
 
-    ssize_t sent = sendto(sock, data, len, 0,
-                          (struct sockaddr *)&dest_addr, sizeof(dest_addr));
-    if (sent < 0)
+    uint16_t crc = 0xFFFF;
+    while (len >= 8)
     {
-        perror("sendto failed");
-        return -1;
+        uint64_t x = load_le64(data) ^ crc;
+        crc = g_crc16_table[7][x & 0xFF] ^ g_crc16_table[6][(x >> 8) & 0xFF] ^ g_crc16_table[5][(x >> 16) & 0xFF] ^
+              g_crc16_table[4][(x >> 24) & 0xFF] ^ g_crc16_table[3][(x >> 32) & 0xFF] ^
+              g_crc16_table[2][(x >> 40) & 0xFF] ^ g_crc16_table[1][(x >> 48) & 0xFF] ^
+              g_crc16_table[0][x >> 56];
+        data += 8;
+        len -= 8;
     }
-    return sent;
+    while (len--)
+    {
+        crc = (crc >> 8) ^ g_crc16_table[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
 }
 
-// ========== 接收组播消息 ==========
-int recv_multicast(int sock, void *buffer, size_t len, struct sockaddr_in *src_addr)
+uint32_t crc32c(const uint8_t *data, size_t len)
 {
-    socklen_t addr_len = sizeof(*src_addr);
-    ssize_t recv_len = recvfrom(sock, buffer, len, 0,
-                                (struct sockaddr *)src_addr, &addr_len);
-    if (recv_len < 0)
-    {
-        perror("recvfrom failed");
-        return -1;
-    }
-    return recv_len;
+    pthread_once(&g_checksum_once, checksum_init);
+    return ~g_crc32c_impl(0xFFFFFFFF, data, len);
 }
 
-// ========== 获取当前时间（毫秒） ==========
-uint64_t get_time_ms()
+uint32_t crc32c_sw(const uint8_t *data, size_t len)
 {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    pthread_once(&g_checksum_once, checksum_init);
+    return ~crc32c_sw_update(0xFFFFFFFF, data, len);
 }
 
-// ========== 打印bitmap ==========
-void print_bitmap(uint64_t bitmap)
+bool crc32c_hw_available()
 {
-    for (int i = 0; i < 64; i++)
-    {
-        printf("%d", (bitmap & (1ULL << i)) ? 1 : 0);
-        if ((i + 1) % 8 == 0)
-            printf(" ");
-    }
-    printf("\n");
+    pthread_once(&g_checksum_once, checksum_init);
+    return g_crc32c_impl != crc32c_sw_update;
 }
 
-// ========== 计算bitmap中置位(1)的数量 ==========
-int count_set_bits(uint64_t bitmap)
+const char *crc32c_impl_name()
 {
-    int count = 0;
-    for (int i = 0; i < 64; i++)
+    if (!crc32c_hw_available())
     {
-        if (bitmap & (1ULL << i))
-        {
-            count++;
-        }
+        return "slice-by-8";
     }
-    return count;
+#if defined(__x86_64__)
+    return "SSE4.2";
+#else
+    return "ARMv8 CRC";
+#endif
 }
 
-// ========== 判断bitmap1是否包含bitmap2的所有缺失块 ==========
-bool bitmap_covers(uint64_t bitmap1, uint64_t bitmap2)
+const char *checksum_name(ChecksumType type)
 {
-    // bitmap中0表示缺失，1表示已收到
-    // bitmap1包含bitmap2，意味着bitmap2缺的块在bitmap1中也缺
-    uint64_t missing1 = ~bitmap1; // bitmap1缺失的块
-    uint64_t missing2 = ~bitmap2; // bitmap2缺失的块
-
-    // 如果missing2是missing1的子集，则bitmap1覆盖bitmap2
-    return (missing2 & missing1) == missing2;
+    return type == CHECKSUM_CRC32C ? "CRC32C" : "CRC16";
 }
 
-// ========== 队列操作函数 ==========
-
-static void queue_init(PacketQueue *q)
+void chunk_set_checksum(DataChunk *chunk, ChecksumType type)
 {
-    q->head = 0;
-    q->tail = 0;
-    q->count = 0;
-    pthread_mutex_init(&q->mutex, NULL);
-    pthread_cond_init(&q->not_empty, NULL);
-    pthread_cond_init(&q->not_full, NULL);
+    chunk_set_checksum_from(chunk, chunk->data, type);
 }
 
-static void queue_push(PacketQueue *q, const void *data, size_t len)
+void chunk_set_checksum_from(DataChunk *chunk, const uint8_t *data, ChecksumType type)
 {
-    pthread_mutex_lock(&q->mutex);
-
-    // 如果队列满，等待（阻塞）
-    while (q->count >= QUEUE_CAPACITY)
+    if (type == CHECKSUM_CRC32C)
     {
-        pthread_cond_wait(&q->not_full, &q->mutex);
+        // crc字段置0，CRC32C放在数据之后（主机字节序，wire_encode统一转换）
+        uint32_t crc = crc32c(data, chunk->data_len);
+        chunk->header.ver_flags |= WIRE_FLAG_CRC32C;
+        chunk->crc = 0;
+        memcpy(chunk->data + chunk->data_len, &crc, sizeof(crc));
+    }
+    else
+    {
+        chunk->header.ver_flags &= ~WIRE_FLAG_CRC32C;
+        chunk->crc = crc16(data, chunk->data_len);
     }
-
-    memcpy(q->data[q->tail], data, len);
-    q->lens[q->tail] = len;
-    q->tail = (q->tail + 1) % QUEUE_CAPACITY;
-    q->count++;
-
-    pthread_cond_signal(&q->not_empty);
-    pthread_mutex_unlock(&q->mutex);
 }
 
-static size_t queue_pop(PacketQueue *q, void *buffer, size_t max_len)
+bool chunk_verify_checksum(const DataChunk *chunk)
 {
-    pthread_mutex_lock(&q->mutex);
-
-    // 如果队列空，等待（阻塞）
-    while (q->count == 0)
+    if (WIRE_GET_FLAGS(chunk->header.ver_flags) & WIRE_FLAG_CRC32C)
     {
-        pthread_cond_wait(&q->not_empty, &q->mutex);
+        uint32_t crc;
+        memcpy(&crc, chunk->data + chunk->data_len, sizeof(crc));
+        return crc32c(chunk->data, chunk->data_len) == crc;
     }
+    return crc16(chunk->data, chunk->data_len) == chunk->crc;
+}
 
-    size_t len = q->lens[q->head];
-    if (len > max_len)
+// ========== 简单hash计算 ==========
+uint32_t simple_hash_update(uint32_t hash, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
     {
-        len = max_len; // 截断
+        hash ^= data[i];
+        hash *= 0x01000193;
     }
-    memcpy(buffer, q->data[q->head], len);
-    q->head = (q->head + 1) % QUEUE_CAPACITY;
-    q->count--;
-
-    pthread_cond_signal(&q->not_full);
-    pthread_mutex_unlock(&q->mutex);
+    return hash;
+}
 
-    return len;
+uint32_t simple_hash(const uint8_t *data, size_t len)
+{
+    return simple_hash_update(SIMPLE_HASH_INIT, data, len);
 }
 
-// ========== 传输层线程函数 ==========
+// ========== 64位快速hash ==========
+// XXH3风格的非密码学hash：8个64位累加器，每次处理64字节条带（stripe）：
+//   acc[i] += lo32(d^k) * hi32(d^k)，acc[i^1] += d
+// 每16个条带用密钥扰乱一次累加器，结束时不足一个条带的尾部补0处理，最后与长度一起折叠混合。
+// 累加与扰乱按CPU选择AVX2/SSE2/NEON或标量实现，各实现结果完全相同。
 
-static void *tx_thread_func(void *arg)
+#define HASH64_STRIPES_PER_BLOCK 16
+#define HASH64_SECRET_SIZE 192
+#define HASH64_SCRAMBLE_OFFSET (HASH64_SECRET_SIZE - HASH64_STRIPE_SIZE)
+#define HASH64_TAIL_OFFSET 7   // 尾部条带使用的密钥偏移
+#define HASH64_MERGE_OFFSET 11 // 折叠累加器使用的密钥偏移
+#define PRIME32_1 0x9E3779B1U
+#define PRIME32_2 0x85EBCA77U
+#define PRIME32_3 0xC2B2AE3DU
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+typedef struct
 {
-    uint8_t buffer[MAX_PACKET_SIZE];
-    while (g_transport.running)
+    const char *name;
+    void (*accumulate)(uint64_t *acc, const uint8_t *input, size_t stripes, const uint8_t *secret);
+    void (*scramble)(uint64_t *acc, const uint8_t *secret);
+} Hash64Impl;
+
+static uint8_t g_hash64_secret[HASH64_SECRET_SIZE];
+static const Hash64Impl *g_hash64_impl;
+static pthread_once_t g_hash64_once = PTHREAD_ONCE_INIT;
+
+// 条带i使用secret + 8*i处的64字节密钥
+static void hash64_accumulate_scalar(uint64_t *acc, const uint8_t *input, size_t stripes, const uint8_t *secret)
+{
+    for (size_t n = 0; n < stripes; n++, input += HASH64_STRIPE_SIZE, secret += 8)
     {
-        size_t len = queue_pop(&g_transport.tx_queue, buffer, sizeof(buffer));
-        if (len > 0)
+        for (int i = 0; i < 8; i++)
         {
-            send_multicast(g_transport.sock, buffer, len);
+            uint64_t data = load_le64(input + 8 * i);
+            uint64_t key = data ^ load_le64(secret + 8 * i);
+            acc[i ^ 1] += data;
+            acc[i] += (key & 0xFFFFFFFF) * (key >> 32);
         }
     }
-    return NULL;
 }
 
-static void *rx_thread_func(void *arg)
+static void hash64_scramble_scalar(uint64_t *acc, const uint8_t *secret)
 {
-    uint8_t buffer[MAX_PACKET_SIZE];
-    struct sockaddr_in src_addr;
-    while (g_transport.running)
+    for (int i = 0; i < 8; i++)
     {
-        int len = recv_multicast(g_transport.sock, buffer, sizeof(buffer), &src_addr);
-        if (len > 0)
-        {
-            queue_push(&g_transport.rx_queue, buffer, len);
-        }
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= load_le64(secret + 8 * i);
+        acc[i] = a * PRIME32_1;
     }
-    return NULL;
 }
 
-// ========== 传输层接口实现 ==========
+static const Hash64Impl g_hash64_scalar = {"scalar", hash64_accumulate_scalar, hash64_scramble_scalar};
 
-bool transport_init(bool is_sender)
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+static void hash64_accumulate_sse2(uint64_t *acc, const uint8_t *input, size_t stripes, const uint8_t *secret)
 {
-    g_transport.sock = create_multicast_socket(is_sender);
-    if (g_transport.sock < 0)
+    __m128i *xacc = (__m128i *)acc;
+    for (size_t n = 0; n < stripes; n++, input += HASH64_STRIPE_SIZE, secret += 8)
     {
-        return false;
+        for (int i = 0; i < 4; i++)
+        {
+            __m128i data = _mm_loadu_si128((const __m128i *)(input + 16 * i));
+            __m128i key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i *)(secret + 16 * i)));
+            __m128i key_hi = _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1));
+            __m128i product = _mm_mul_epu32(key, key_hi);
+            __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            __m128i sum = _mm_add_epi64(_mm_loadu_si128(xacc + i), swapped);
+            _mm_storeu_si128(xacc + i, _mm_add_epi64(sum, product));
+        }
     }
+}
 
-    queue_init(&g_transport.tx_queue);
-    queue_init(&g_transport.rx_queue);
-    g_transport.running = true;
-
-    // 启动Tx线程
-    if (pthread_create(&g_transport.tx_thread, NULL, tx_thread_func, NULL) != 0)
+static void hash64_scramble_sse2(uint64_t *acc, const uint8_t *secret)
+{
+    __m128i *xacc = (__m128i *)acc;
+    const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+    for (int i = 0; i < 4; i++)
     {
-        perror("Failed to create Tx thread");
-        close(g_transport.sock);
-        return false;
+        __m128i a = _mm_loadu_si128(xacc + i);
+        a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+        a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i *)(secret + 16 * i)));
+        __m128i lo = _mm_mul_epu32(a, prime);
+        __m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+        _mm_storeu_si128(xacc + i, _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
     }
+}
 
-    // 启动Rx线程
-    if (pthread_create(&g_transport.rx_thread, NULL, rx_thread_func, NULL) != 0)
+__attribute__((target("avx2"))) static void hash64_accumulate_avx2(uint64_t *acc, const uint8_t *input,
+                                                                   size_t stripes, const uint8_t *secret)
+{
+    __m256i a0 = _mm256_loadu_si256((const __m256i *)acc);
+    __m256i a1 = _mm256_loadu_si256((const __m256i *)(acc + 4));
+    for (size_t n = 0; n < stripes; n++, input += HASH64_STRIPE_SIZE, secret += 8)
     {
-        perror("Failed to create Rx thread");
-        g_transport.running = false;
-        pthread_join(g_transport.tx_thread, NULL);
-        close(g_transport.sock);
-        return false;
+        __m256i d0 = _mm256_loadu_si256((const __m256i *)input);
+        __m256i d1 = _mm256_loadu_si256((const __m256i *)(input + 32));
+        __m256i k0 = _mm256_xor_si256(d0, _mm256_loadu_si256((const __m256i *)secret));
+        __m256i k1 = _mm256_xor_si256(d1, _mm256_loadu_si256((const __m256i *)(secret + 32)));
+        __m256i p0 = _mm256_mul_epu32(k0, _mm256_shuffle_epi32(k0, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m256i p1 = _mm256_mul_epu32(k1, _mm256_shuffle_epi32(k1, _MM_SHUFFLE(0, 3, 0, 1)));
+        a0 = _mm256_add_epi64(a0, _mm256_add_epi64(p0, _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2))));
+        a1 = _mm256_add_epi64(a1, _mm256_add_epi64(p1, _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2))));
     }
-
-    return true;
+    _mm256_storeu_si256((__m256i *)acc, a0);
+    _mm256_storeu_si256((__m256i *)(acc + 4), a1);
 }
 
-void transport_send(const void *data, size_t len)
+__attribute__((target("avx2"))) static void hash64_scramble_avx2(uint64_t *acc, const uint8_t *secret)
 {
-    if (!g_transport.running)
-        return;
-    queue_push(&g_transport.tx_queue, data, len);
+    const __m256i prime = _mm256_set1_epi32((int)PRIME32_1);
+    for (int i = 0; i < 2; i++)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(acc + 4 * i));
+        a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+        a = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i *)(secret + 32 * i)));
+        __m256i lo = _mm256_mul_epu32(a, prime);
+        __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+        _mm256_storeu_si256((__m256i *)(acc + 4 * i), _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)));
+    }
 }
 
-size_t transport_recv(void *buffer, size_t max_len)
+static const Hash64Impl g_hash64_sse2 = {"sse2", hash64_accumulate_sse2, hash64_scramble_sse2};
+static const Hash64Impl g_hash64_avx2 = {"avx2", hash64_accumulate_avx2, hash64_scramble_avx2};
+#elif defined(__aarch64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+
+static void hash64_accumulate_neon(uint64_t *acc, const uint8_t *input, size_t stripes, const uint8_t *secret)
 {
-    if (!g_transport.running)
-        return 0;
-    return queue_pop(&g_transport.rx_queue, buffer, max_len);
+    uint64x2_t a[4];
+    for (int i = 0; i < 4; i++)
+    {
+        a[i] = vld1q_u64(acc + 2 * i);
+    }
+    for (size_t n = 0; n < stripes; n++, input += HASH64_STRIPE_SIZE, secret += 8)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            uint64x2_t data = vreinterpretq_u64_u8(vld1q_u8(input + 16 * i));
+            uint64x2_t key = veorq_u64(data, vreinterpretq_u64_u8(vld1q_u8(secret + 16 * i)));
+            a[i] = vaddq_u64(a[i], vextq_u64(data, data, 1));
+            a[i] = vmlal_u32(a[i], vmovn_u64(key), vshrn_n_u64(key, 32));
+        }
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        vst1q_u64(acc + 2 * i, a[i]);
+    }
 }
 
-void transport_close()
+static void hash64_scramble_neon(uint64_t *acc, const uint8_t *secret)
 {
-    g_transport.running = false;
-    // 唤醒可能阻塞的线程
-    pthread_cancel(g_transport.tx_thread);
+    const uint32x2_t prime = vdup_n_u32(PRIME32_1);
+    for (int i = 0; i < 4; i++)
+    {
+        uint64x2_t a = vld1q_u64(acc + 2 * i);
+        a = veorq_u64(a, vshrq_n_u64(a, 47));
+        a = veorq_u64(a, vreinterpretq_u64_u8(vld1q_u8(secret + 16 * i)));
+        uint64x2_t hi = vshlq_n_u64(vmull_u32(vshrn_n_u64(a, 32), prime), 32);
+        vst1q_u64(acc + 2 * i, vmlal_u32(hi, vmovn_u64(a), prime));
+    }
+}
+
+static const Hash64Impl g_hash64_neon = {"neon", hash64_accumulate_neon, hash64_scramble_neon};
+#endif
+
+// 本机可用的实现（按优先级从高到低）
+static const Hash64Impl *const g_hash64_impls[] = {
+#if defined(__x86_64__)
+    &g_hash64_avx2,
+    &g_hash64_sse2,
+#elif defined(__aarch64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    &g_hash64_neon,
+#endif
+    &g_hash64_scalar,
+};
+
+static bool hash64_impl_supported(const Hash64Impl *impl)
+{
+#if defined(__x86_64__)
+    if (impl == &g_hash64_avx2)
+    {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return true;
+}
+
+static void hash64_init_once()
+{
+    // 密钥由固定种子派生，两端一致
+    uint64_t x = PRIME64_5;
+    for (int i = 0; i < HASH64_SECRET_SIZE; i += 8)
+    {
+        x += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z = htole64(z ^ (z >> 31));
+        memcpy(g_hash64_secret + i, &z, sizeof(z));
+    }
+
+    for (size_t i = 0; i < sizeof(g_hash64_impls) / sizeof(g_hash64_impls[0]); i++)
+    {
+        if (hash64_impl_supported(g_hash64_impls[i]))
+        {
+            g_hash64_impl = g_hash64_impls[i];
+            break;
+        }
+    }
+}
+
+const char *hash64_impl_name()
+{
+    pthread_once(&g_hash64_once, hash64_init_once);
+    return g_hash64_impl->name;
+}
+
+bool hash64_use_impl(const char *name)
+{
+    pthread_once(&g_hash64_once, hash64_init_once);
+    for (size_t i = 0; i < sizeof(g_hash64_impls) / sizeof(g_hash64_impls[0]); i++)
+    {
+        if (strcmp(g_hash64_impls[i]->name, name) == 0 && hash64_impl_supported(g_hash64_impls[i]))
+        {
+            g_hash64_impl = g_hash64_impls[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+void hash64_init(Hash64State *state)
+{
+    pthread_once(&g_hash64_once, hash64_init_once);
+
+    static const uint64_t init_acc[8] = {PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3,
+                                         PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1};
+    memcpy(state->acc, init_acc, sizeof(init_acc));
+    state->buf_len = 0;
+    state->block_stripes = 0;
+    state->total_len = 0;
+}
+
+// 处理若干完整条带，跨过块边界时扰乱累加器
+static void hash64_consume(Hash64State *state, const uint8_t *input, size_t stripes)
+{
+    const Hash64Impl *impl = g_hash64_impl;
+    while (stripes > 0)
+    {
+        size_t n = HASH64_STRIPES_PER_BLOCK - state->block_stripes;
+        if (n > stripes)
+        {
+            n = stripes;
+        }
+        impl->accumulate(state->acc, input, n, g_hash64_secret + 8 * state->block_stripes);
+        input += n * HASH64_STRIPE_SIZE;
+        stripes -= n;
+        state->block_stripes += n;
+        if (state->block_stripes == HASH64_STRIPES_PER_BLOCK)
+        {
+            impl->scramble(state->acc, g_hash64_secret + HASH64_SCRAMBLE_OFFSET);
+            state->block_stripes = 0;
+        }
+    }
+}
+
+void hash64_update(Hash64State *state, const uint8_t *data, size_t len)
+{
+    state->total_len += len;
+
+    // 先补满上次剩下的不完整条带
+    if (state->buf_len > 0)
+    {
+        size_t n = HASH64_STRIPE_SIZE - state->buf_len;
+        if (n > len)
+        {
+            n = len;
+        }
+        memcpy(state->buf + state->buf_len, data, n);
+        state->buf_len += n;
+        data += n;
+        len -= n;
+        if (state->buf_len < HASH64_STRIPE_SIZE)
+        {
+            return;
+        }
+        hash64_consume(state, state->buf, 1);
+        state->buf_len = 0;
+    }
+
+    // 完整条带直接在输入上处理，不拷贝
+    size_t stripes = len / HASH64_STRIPE_SIZE;
+    hash64_consume(state, data, stripes);
+    data += stripes * HASH64_STRIPE_SIZE;
+    len -= stripes * HASH64_STRIPE_SIZE;
+
+    memcpy(state->buf, data, len);
+    state->buf_len = len;
+}
+
+static uint64_t hash64_mul_fold(uint64_t a, uint64_t b)
+{
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+uint64_t hash64_final(const Hash64State *state)
+{
+    uint64_t acc[8];
+    memcpy(acc, state->acc, sizeof(acc));
+
+    // 尾部不完整条带补0后处理（长度在合并时计入，补0不会产生碰撞）
+    if (state->buf_len > 0)
+    {
+        uint8_t tail[HASH64_STRIPE_SIZE] = {0};
+        memcpy(tail, state->buf, state->buf_len);
+        g_hash64_impl->accumulate(acc, tail, 1, g_hash64_secret + HASH64_TAIL_OFFSET);
+    }
+
+    uint64_t hash = state->total_len * PRIME64_1;
+    const uint8_t *key = g_hash64_secret + HASH64_MERGE_OFFSET;
+    for (int i = 0; i < 4; i++)
+    {
+        hash += hash64_mul_fold(acc[2 * i] ^ load_le64(key + 16 * i), acc[2 * i + 1] ^ load_le64(key + 16 * i + 8));
+    }
+
+    // avalanche
+    hash ^= hash >> 37;
+    hash *= 0x165667919E3779F9ULL;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+uint64_t hash64(const uint8_t *data, size_t len)
+{
+    Hash64State state;
+    hash64_init(&state);
+    hash64_update(&state, data, len);
+    return hash64_final(&state);
+}
+
+// ========== 文件hash ==========
+void file_hasher_init(FileHasher *hasher, FileHashType type)
+{
+    hasher->type = type;
+    hasher->fnv = SIMPLE_HASH_INIT;
+    if (type == FILE_HASH_HASH64)
+    {
+        hash64_init(&hasher->h64);
+    }
+}
+
+void file_hasher_update(FileHasher *hasher, const uint8_t *data, size_t len)
+{
+    if (hasher->type == FILE_HASH_HASH64)
+    {
+        hash64_update(&hasher->h64, data, len);
+    }
+    else
+    {
+        hasher->fnv = simple_hash_update(hasher->fnv, data, len);
+    }
+}
+
+uint64_t file_hasher_final(const FileHasher *hasher)
+{
+    return hasher->type == FILE_HASH_HASH64 ? hash64_final(&hasher->h64) : hasher->fnv;
+}
+
+const char *file_hash_name(FileHashType type)
+{
+    return type == FILE_HASH_HASH64 ? "hash64" : "FNV-1a 32";
+}
+
+// ========== Merkle树 ==========
+// 叶子为各窗口摘要，内部节点为hash64(0x01 || left || right)（小端），
+// 每层奇数个节点时最后一个节点不做hash直接提升到上一层。
+
+static uint64_t merkle_parent(uint64_t left, uint64_t right)
+{
+    uint8_t buf[1 + 2 * sizeof(uint64_t)];
+    buf[0] = 0x01; // 与叶子区分
+    left = htole64(left);
+    right = htole64(right);
+    memcpy(buf + 1, &left, sizeof(left));
+    memcpy(buf + 1 + sizeof(left), &right, sizeof(right));
+    return hash64(buf, sizeof(buf));
+}
+
+uint64_t merkle_window_digest(const uint64_t *chunk_hashes, uint32_t count)
+{
+    // 窗口最多MAX_WINDOW_SIZE块，按WINDOW_SIZE个hash一段流式计算（结果与整体hash64相同）
+    Hash64State state;
+    hash64_init(&state);
+    uint64_t buf[WINDOW_SIZE];
+    for (uint32_t i = 0; i < count; i += WINDOW_SIZE)
+    {
+        uint32_t n = count - i < WINDOW_SIZE ? count - i : WINDOW_SIZE;
+        for (uint32_t j = 0; j < n; j++)
+        {
+            buf[j] = htole64(chunk_hashes[i + j]);
+        }
+        hash64_update(&state, (const uint8_t *)buf, n * sizeof(uint64_t));
+    }
+    return hash64_final(&state);
+}
+
+bool merkle_build(MerkleTree *tree, const uint64_t *leaves, uint32_t count)
+{
+    memset(tree, 0, sizeof(*tree));
+    tree->leaf_count = count;
+    if (count == 0)
+    {
+        return true;
+    }
+
+    // 各层节点数向上取整（奇数时最后一个节点直接上提），总数按各层实际大小累加
+    size_t total = 0;
+    for (uint32_t size = count; ; size = (size + 1) / 2)
+    {
+        total += size;
+        if (size == 1)
+        {
+            break;
+        }
+    }
+    tree->nodes = malloc(total * sizeof(uint64_t));
+    if (!tree->nodes)
+    {
+        perror("Failed to allocate Merkle tree");
+        return false;
+    }
+    memcpy(tree->nodes, leaves, count * sizeof(uint64_t));
+    tree->level_offset[0] = 0;
+    tree->level_size[0] = count;
+    tree->level_count = 1;
+
+    while (tree->level_size[tree->level_count - 1] > 1)
+    {
+        uint32_t level = tree->level_count;
+        uint32_t size = tree->level_size[level - 1];
+        const uint64_t *below = tree->nodes + tree->level_offset[level - 1];
+        uint64_t *out = tree->nodes + tree->level_offset[level - 1] + size;
+
+        for (uint32_t i = 0; 2 * i < size; i++)
+        {
+            out[i] = (2 * i + 1 < size) ? merkle_parent(below[2 * i], below[2 * i + 1]) : below[2 * i];
+        }
+        tree->level_offset[level] = tree->level_offset[level - 1] + size;
+        tree->level_size[level] = (size + 1) / 2;
+        tree->level_count++;
+    }
+    return true;
+}
+
+uint64_t merkle_root(const MerkleTree *tree)
+{
+    if (tree->level_count == 0)
+    {
+        return 0;
+    }
+    return tree->nodes[tree->level_offset[tree->level_count - 1]];
+}
+
+int merkle_proof(const MerkleTree *tree, uint32_t index, uint64_t *proof)
+{
+    int len = 0;
+    for (uint32_t level = 0; level + 1 < tree->level_count; level++)
+    {
+        uint32_t sibling = index ^ 1;
+        if (sibling < tree->level_size[level])
+        {
+            proof[len++] = tree->nodes[tree->level_offset[level] + sibling];
+        }
+        index >>= 1;
+    }
+    return len;
+}
+
+bool merkle_verify(uint64_t root, uint32_t leaf_count, uint32_t index, uint64_t leaf, const uint64_t *proof,
+                   int proof_len)
+{
+    if (index >= leaf_count)
+    {
+        return false;
+    }
+
+    uint64_t hash = leaf;
+    int used = 0;
+    for (uint32_t size = leaf_count; size > 1; size = (size + 1) / 2)
+    {
+        if ((index ^ 1) < size)
+        {
+            if (used >= proof_len)
+            {
+                return false;
+            }
+            uint64_t sibling = proof[used++];
+            hash = (index & 1) ? merkle_parent(sibling, hash) : merkle_parent(hash, sibling);
+        }
+        index >>= 1;
+    }
+    return used == proof_len && hash == root;
+}
+
+void merkle_free(MerkleTree *tree)
+{
+    free(tree->nodes);
+    memset(tree, 0, sizeof(*tree));
+}
+
+// ========== GF(2^8)运算与前向纠错 ==========
+// 域多项式x^8+x^4+x^3+x^2+1（0x11D）。区域乘加dst ^= c*src是编解码的热点：SIMD实现把c*x拆成
+// c*(x低4位) ^ c*(x高4位<<4)，两张16项的表用一次字节查表指令（SSSE3/AVX2 pshufb、NEON tbl）处理16/32字节。
+// 纠删码为系统柯西Reed-Solomon码：源块i对应点y_i=i，修复符号j对应点x_j=FEC_MAX_SOURCE+j，
+// 修复符号j = sum_i D_i/(x_j^y_i)。柯西矩阵的任意方子阵可逆，因此任意m个修复符号都能恢复任意m个缺失块。
+
+typedef struct
+{
+    const char *name;
+    void (*mul_add)(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);
+} Gf256Impl;
+
+static uint8_t g_gf256_exp[512];
+static uint8_t g_gf256_log[256];
+static uint8_t g_gf256_mul_table[256][256];
+static const Gf256Impl *g_gf256_impl;
+static pthread_once_t g_gf256_once = PTHREAD_ONCE_INIT;
+
+static uint8_t gf256_mul(uint8_t a, uint8_t b)
+{
+    return g_gf256_mul_table[a][b];
+}
+
+static uint8_t gf256_inv(uint8_t a)
+{
+    return g_gf256_exp[255 - g_gf256_log[a]];
+}
+
+static void gf256_mul_add_scalar(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+    const uint8_t *row = g_gf256_mul_table[c];
+    for (size_t i = 0; i < len; i++)
+    {
+        dst[i] ^= row[src[i]];
+    }
+}
+
+static const Gf256Impl g_gf256_scalar = {"scalar", gf256_mul_add_scalar};
+
+// c*x的低/高半字节查表：lo[n] = c*n，hi[n] = c*(n<<4)
+static void gf256_nibble_tables(uint8_t c, uint8_t *lo, uint8_t *hi)
+{
+    for (int n = 0; n < 16; n++)
+    {
+        lo[n] = g_gf256_mul_table[c][n];
+        hi[n] = g_gf256_mul_table[c][n << 4];
+    }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("ssse3"))) static void gf256_mul_add_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c,
+                                                                 size_t len)
+{
+    uint8_t lo[16], hi[16];
+    gf256_nibble_tables(c, lo, hi);
+    const __m128i tlo = _mm_loadu_si128((const __m128i *)lo);
+    const __m128i thi = _mm_loadu_si128((const __m128i *)hi);
+    const __m128i mask = _mm_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(tlo, _mm_and_si128(x, mask)),
+                                  _mm_shuffle_epi8(thi, _mm_and_si128(_mm_srli_epi64(x, 4), mask)));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i *)(dst + i)), p));
+    }
+    gf256_mul_add_scalar(dst + i, src + i, c, len - i);
+}
+
+__attribute__((target("avx2"))) static void gf256_mul_add_avx2(uint8_t *dst, const uint8_t *src, uint8_t c,
+                                                               size_t len)
+{
+    uint8_t lo[16], hi[16];
+    gf256_nibble_tables(c, lo, hi);
+    const __m256i tlo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lo));
+    const __m256i thi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hi));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(tlo, _mm256_and_si256(x, mask)),
+                                     _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask)));
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(dst + i)), p));
+    }
+    gf256_mul_add_scalar(dst + i, src + i, c, len - i);
+}
+
+static const Gf256Impl g_gf256_ssse3 = {"ssse3", gf256_mul_add_ssse3};
+static const Gf256Impl g_gf256_avx2 = {"avx2", gf256_mul_add_avx2};
+#elif defined(__aarch64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+static void gf256_mul_add_neon(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+    uint8_t lo[16], hi[16];
+    gf256_nibble_tables(c, lo, hi);
+    const uint8x16_t tlo = vld1q_u8(lo);
+    const uint8x16_t thi = vld1q_u8(hi);
+    const uint8x16_t mask = vdupq_n_u8(0x0F);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        uint8x16_t x = vld1q_u8(src + i);
+        uint8x16_t p = veorq_u8(vqtbl1q_u8(tlo, vandq_u8(x, mask)), vqtbl1q_u8(thi, vshrq_n_u8(x, 4)));
+        vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), p));
+    }
+    gf256_mul_add_scalar(dst + i, src + i, c, len - i);
+}
+
+static const Gf256Impl g_gf256_neon = {"neon", gf256_mul_add_neon};
+#endif
+
+// 本机可用的实现（按优先级从高到低）
+static const Gf256Impl *const g_gf256_impls[] = {
+#if defined(__x86_64__)
+    &g_gf256_avx2,
+    &g_gf256_ssse3,
+#elif defined(__aarch64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    &g_gf256_neon,
+#endif
+    &g_gf256_scalar,
+};
+
+static bool gf256_impl_supported(const Gf256Impl *impl)
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (impl == &g_gf256_avx2)
+    {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (impl == &g_gf256_ssse3)
+    {
+        return __builtin_cpu_supports("ssse3");
+    }
+#endif
+    return true;
+}
+
+static void gf256_init_once()
+{
+    uint16_t x = 1;
+    for (int i = 0; i < 255; i++)
+    {
+        g_gf256_exp[i] = x;
+        g_gf256_log[x] = i;
+        x <<= 1;
+        if (x & 0x100)
+        {
+            x ^= 0x11D;
+        }
+    }
+    for (int i = 255; i < 512; i++)
+    {
+        g_gf256_exp[i] = g_gf256_exp[i - 255];
+    }
+    for (int a = 1; a < 256; a++)
+    {
+        for (int b = 1; b < 256; b++)
+        {
+            g_gf256_mul_table[a][b] = g_gf256_exp[g_gf256_log[a] + g_gf256_log[b]];
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(g_gf256_impls) / sizeof(g_gf256_impls[0]); i++)
+    {
+        if (gf256_impl_supported(g_gf256_impls[i]))
+        {
+            g_gf256_impl = g_gf256_impls[i];
+            break;
+        }
+    }
+}
+
+void gf256_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+    pthread_once(&g_gf256_once, gf256_init_once);
+    if (c != 0)
+    {
+        g_gf256_impl->mul_add(dst, src, c, len);
+    }
+}
+
+const char *gf256_impl_name()
+{
+    pthread_once(&g_gf256_once, gf256_init_once);
+    return g_gf256_impl->name;
+}
+
+bool gf256_use_impl(const char *name)
+{
+    pthread_once(&g_gf256_once, gf256_init_once);
+    for (size_t i = 0; i < sizeof(g_gf256_impls) / sizeof(g_gf256_impls[0]); i++)
+    {
+        if (strcmp(g_gf256_impls[i]->name, name) == 0 && gf256_impl_supported(g_gf256_impls[i]))
+        {
+            g_gf256_impl = g_gf256_impls[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t fec_coefficient(uint32_t repair_index, uint32_t source_index)
+{
+    pthread_once(&g_gf256_once, gf256_init_once);
+    return gf256_inv((uint8_t)((FEC_MAX_SOURCE + repair_index) ^ source_index));
+}
+
+// 高斯-约当消元求逆（n*n，按行存放，原地替换为逆矩阵）；奇异时返回false
+static bool gf256_invert(uint8_t *matrix, int n)
+{
+    uint8_t inv[FEC_MAX_SOURCE * FEC_MAX_SOURCE];
+    memset(inv, 0, (size_t)n * n);
+    for (int i = 0; i < n; i++)
+    {
+        inv[i * n + i] = 1;
+    }
+
+    for (int col = 0; col < n; col++)
+    {
+        int pivot = col;
+        while (pivot < n && matrix[pivot * n + col] == 0)
+        {
+            pivot++;
+        }
+        if (pivot == n)
+        {
+            return false;
+        }
+        if (pivot != col)
+        {
+            for (int k = 0; k < n; k++)
+            {
+                uint8_t t = matrix[col * n + k];
+                matrix[col * n + k] = matrix[pivot * n + k];
+                matrix[pivot * n + k] = t;
+                t = inv[col * n + k];
+                inv[col * n + k] = inv[pivot * n + k];
+                inv[pivot * n + k] = t;
+            }
+        }
+
+        uint8_t scale = gf256_inv(matrix[col * n + col]);
+        for (int k = 0; k < n; k++)
+        {
+            matrix[col * n + k] = gf256_mul(matrix[col * n + k], scale);
+            inv[col * n + k] = gf256_mul(inv[col * n + k], scale);
+        }
+        for (int row = 0; row < n; row++)
+        {
+            uint8_t factor = matrix[row * n + col];
+            if (row == col || factor == 0)
+            {
+                continue;
+            }
+            for (int k = 0; k < n; k++)
+            {
+                matrix[row * n + k] ^= gf256_mul(factor, matrix[col * n + k]);
+                inv[row * n + k] ^= gf256_mul(factor, inv[col * n + k]);
+            }
+        }
+    }
+    memcpy(matrix, inv, (size_t)n * n);
+    return true;
+}
+
+bool fec_solve(const uint8_t *repair_index, const uint8_t *missing_index, int m, uint8_t *const *syndromes,
+               uint8_t *const *out, size_t len)
+{
+    if (m <= 0 || m > FEC_MAX_SOURCE)
+    {
+        return false;
+    }
+
+    uint8_t matrix[FEC_MAX_SOURCE * FEC_MAX_SOURCE];
+    for (int r = 0; r < m; r++)
+    {
+        for (int c = 0; c < m; c++)
+        {
+            matrix[r * m + c] = fec_coefficient(repair_index[r], missing_index[c]);
+        }
+    }
+    if (!gf256_invert(matrix, m))
+    {
+        return false;
+    }
+
+    for (int b = 0; b < m; b++)
+    {
+        memset(out[b], 0, len);
+        for (int r = 0; r < m; r++)
+        {
+            gf256_mul_add(out[b], syndromes[r], matrix[b * m + r], len);
+        }
+    }
+    return true;
+}
+
+// ========== 创建组播socket ==========
+int create_multicast_socket(bool sender)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+        perror("socket creation failed");
+        return -1;
+    }
+
+    // 设置socket选项允许地址重用
+    int reuse = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0)
+    {
+        perror("setsockopt SO_REUSEADDR failed");
+        close(sock);
+        return -1;
+    }
+
+    if (sender)
+    {
+        // 发送方：设置TTL（跳数限制）
+        unsigned char ttl = 32;
+        if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0)
+        {
+            perror("setsockopt IP_MULTICAST_TTL failed");
+            close(sock);
+            return -1;
+        }
+
+        // 启用回环（本地测试时需要，实际部署时可以禁用）
+        unsigned char loop = 1; // 改为1，启用回环
+        if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0)
+        {
+            perror("setsockopt IP_MULTICAST_LOOP failed");
+            close(sock);
+            return -1;
+        }
+    }
+    else
+    {
+        // 接收方：绑定端口
+        struct sockaddr_in local_addr;
+        memset(&local_addr, 0, sizeof(local_addr));
+        local_addr.sin_family = AF_INET;
+        local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        local_addr.sin_port = htons(MULTICAST_PORT);
+
+        if (bind(sock, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0)
+        {
+            perror("bind failed");
+            close(sock);
+            return -1;
+        }
+
+        // 加入组播组
+        struct ip_mreq mreq;
+        mreq.imr_multiaddr.s_addr = inet_addr(MULTICAST_GROUP);
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+        {
+            perror("setsockopt IP_ADD_MEMBERSHIP failed");
+            close(sock);
+            return -1;
+        }
+    }
+
+    return sock;
+}
+
+// ========== 发送组播消息 ==========
+int send_multicast(int sock, const void *data, size_t len)
+{
+    struct sockaddr_in dest_addr;
+    memset(&dest_addr, 0, sizeof(dest_addr));
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_addr.s_addr = inet_addr(MULTICAST_GROUP);
+    dest_addr.sin_port = htons(MULTICAST_PORT);
+
+    ssize_t sent = sendto(sock, data, len, 0,
+                          (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+    if (sent < 0)
+    {
+        perror("sendto failed");
+        return -1;
+    }
+    return sent;
+}
+
+// ========== 接收组播消息 ==========
+int recv_multicast(int sock, void *buffer, size_t len, struct sockaddr_in *src_addr)
+{
+    socklen_t addr_len = sizeof(*src_addr);
+    ssize_t recv_len = recvfrom(sock, buffer, len, 0,
+                                (struct sockaddr *)src_addr, &addr_len);
+    if (recv_len < 0)
+    {
+        perror("recvfrom failed");
+        return -1;
+    }
+    return recv_len;
+}
+
+// ========== 批量发送组播消息 ==========
+int send_multicast_batch(int sock, struct mmsghdr *msgs, int count)
+{
+    int sent_total = 0;
+    // sendmmsg可能只发送部分报文，循环直到全部发出
+    while (sent_total < count)
+    {
+        int sent = sendmmsg(sock, msgs + sent_total, count - sent_total, 0);
+        if (sent < 0)
+        {
+            perror("sendmmsg failed");
+            return sent_total > 0 ? sent_total : -1;
+        }
+        sent_total += sent;
+    }
+    return sent_total;
+}
+
+// ========== 批量接收组播消息 ==========
+int recv_multicast_batch(int sock, struct mmsghdr *msgs, int count)
+{
+    // MSG_WAITFORONE: 阻塞等待第一个报文，之后只取已到达的报文
+    int received = recvmmsg(sock, msgs, count, MSG_WAITFORONE, NULL);
+    if (received < 0)
+    {
+        perror("recvmmsg failed");
+        return -1;
+    }
+    return received;
+}
+
+// ========== 获取当前时间（毫秒） ==========
+uint64_t get_time_ms()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// ========== 获取单调时钟时间（纳秒） ==========
+uint64_t get_monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// ========== 打印bitmap ==========
+void print_bitmap(uint64_t bitmap)
+{
+    for (int i = 0; i < 64; i++)
+    {
+        printf("%d", (bitmap & (1ULL << i)) ? 1 : 0);
+        if ((i + 1) % 8 == 0)
+            printf(" ");
+    }
+    printf("\n");
+}
+
+// ========== 计算bitmap中置位(1)的数量 ==========
+int count_set_bits(uint64_t bitmap)
+{
+    int count = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        if (bitmap & (1ULL << i))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+// ========== 判断bitmap1是否包含bitmap2的所有缺失块 ==========
+bool bitmap_covers(uint64_t bitmap1, uint64_t bitmap2)
+{
+    // bitmap中0表示缺失，1表示已收到
+    // bitmap1包含bitmap2，意味着bitmap2缺的块在bitmap1中也缺
+    uint64_t missing1 = ~bitmap1; // bitmap1缺失的块
+    uint64_t missing2 = ~bitmap2; // bitmap2缺失的块
+
+    // 如果missing2是missing1的子集，则bitmap1覆盖bitmap2
+    return (missing2 & missing1) == missing2;
+}
+
+// ========== 多字位图 ==========
+// 窗口大于64块时，窗口接收位图、重传位图与NACK缺块位图由多个64位字组成。按位或、取缺失位与查找
+// 每次处理128位（SSE2/NEON分别是x86-64/AArch64的基线指令集，无需运行时检测）；计数是检查窗口
+// 是否收齐的热点，运行时选择AVX2半字节查表（vpshufb + vpsadbw）、POPCNT指令或标量实现
+
+#if defined(__x86_64__)
+#define BITMAP_SIMD_SSE2 1 // <immintrin.h>已在hash64部分包含
+#elif defined(__aarch64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BITMAP_SIMD_NEON 1
+#endif
+
+void bitmap_set(uint64_t *bitmap, uint32_t bit)
+{
+    bitmap[bit / 64] |= 1ULL << (bit % 64);
+}
+
+bool bitmap_test(const uint64_t *bitmap, uint32_t bit)
+{
+    return (bitmap[bit / 64] >> (bit % 64)) & 1;
+}
+
+void bitmap_or(uint64_t *dst, const uint64_t *src, uint32_t words)
+{
+    uint32_t i = 0;
+#if defined(BITMAP_SIMD_SSE2)
+    for (; i + 2 <= words; i += 2)
+    {
+        __m128i v = _mm_or_si128(_mm_loadu_si128((const __m128i *)(dst + i)), _mm_loadu_si128((const __m128i *)(src + i)));
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+#elif defined(BITMAP_SIMD_NEON)
+    for (; i + 2 <= words; i += 2)
+    {
+        vst1q_u64(dst + i, vorrq_u64(vld1q_u64(dst + i), vld1q_u64(src + i)));
+    }
+#endif
+    for (; i < words; i++)
+    {
+        dst[i] |= src[i];
+    }
+}
+
+void bitmap_missing(uint64_t *missing, const uint64_t *received, uint32_t nbits)
+{
+    uint32_t words = (nbits + 63) / 64;
+    uint32_t i = 0;
+#if defined(BITMAP_SIMD_SSE2)
+    const __m128i ones = _mm_set1_epi32(-1);
+    for (; i + 2 <= words; i += 2)
+    {
+        _mm_storeu_si128((__m128i *)(missing + i), _mm_andnot_si128(_mm_loadu_si128((const __m128i *)(received + i)), ones));
+    }
+#elif defined(BITMAP_SIMD_NEON)
+    for (; i + 2 <= words; i += 2)
+    {
+        vst1q_u64(missing + i, vreinterpretq_u64_u32(vmvnq_u32(vreinterpretq_u32_u64(vld1q_u64(received + i)))));
+    }
+#endif
+    for (; i < words; i++)
+    {
+        missing[i] = ~received[i];
+    }
+    if (nbits % 64)
+    {
+        missing[words - 1] &= (1ULL << (nbits % 64)) - 1;
+    }
+}
+
+// 查找从start开始第一个与skip不同的位（skip为0查找置位，为全1查找未置位）
+static uint32_t bitmap_find(const uint64_t *bitmap, uint32_t start, uint32_t nbits, uint64_t skip)
+{
+    if (start >= nbits)
+    {
+        return nbits;
+    }
+    uint32_t words = (nbits + 63) / 64;
+    uint32_t i = start / 64;
+
+    // 起始字中start之前的位不参与查找
+    uint64_t word = (bitmap[i] ^ skip) & (~0ULL << (start % 64));
+    i++;
+    while (word == 0)
+    {
+#if defined(BITMAP_SIMD_SSE2)
+        const __m128i s = _mm_set1_epi64x((long long)skip);
+        while (i + 2 <= words &&
+               _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bitmap + i)), s)) == 0xFFFF)
+        {
+            i += 2;
+        }
+#elif defined(BITMAP_SIMD_NEON)
+        const uint64x2_t s = vdupq_n_u64(skip);
+        while (i + 2 <= words && vmaxvq_u32(vreinterpretq_u32_u64(veorq_u64(vld1q_u64(bitmap + i), s))) == 0)
+        {
+            i += 2;
+        }
+#endif
+        if (i >= words)
+        {
+            return nbits;
+        }
+        word = bitmap[i] ^ skip;
+        i++;
+    }
+    uint32_t bit = (i - 1) * 64 + __builtin_ctzll(word);
+    return bit < nbits ? bit : nbits;
+}
+
+uint32_t bitmap_next_set(const uint64_t *bitmap, uint32_t start, uint32_t nbits)
+{
+    return bitmap_find(bitmap, start, nbits, 0);
+}
+
+uint32_t bitmap_next_zero(const uint64_t *bitmap, uint32_t start, uint32_t nbits)
+{
+    return bitmap_find(bitmap, start, nbits, ~0ULL);
+}
+
+bool bitmap_is_subset(const uint64_t *a, const uint64_t *b, uint32_t words)
+{
+    uint32_t i = 0;
+    uint64_t extra = 0;
+#if defined(BITMAP_SIMD_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 2 <= words; i += 2)
+    {
+        // a & ~b：a中有而b中没有的位
+        acc = _mm_or_si128(acc, _mm_andnot_si128(_mm_loadu_si128((const __m128i *)(b + i)),
+                                                 _mm_loadu_si128((const __m128i *)(a + i))));
+    }
+    extra = _mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF;
+#elif defined(BITMAP_SIMD_NEON)
+    uint64x2_t acc = vdupq_n_u64(0);
+    for (; i + 2 <= words; i += 2)
+    {
+        acc = vorrq_u64(acc, vbicq_u64(vld1q_u64(a + i), vld1q_u64(b + i)));
+    }
+    extra = vmaxvq_u32(vreinterpretq_u32_u64(acc)) != 0;
+#endif
+    for (; i < words; i++)
+    {
+        extra |= a[i] & ~b[i];
+    }
+    return extra == 0;
+}
+
+typedef struct
+{
+    const char *name;
+    uint32_t (*popcount)(const uint64_t *bitmap, uint32_t words);
+} BitmapImpl;
+
+static const BitmapImpl *g_bitmap_impl;
+static pthread_once_t g_bitmap_once = PTHREAD_ONCE_INIT;
+
+static uint32_t bitmap_popcount_scalar(const uint64_t *bitmap, uint32_t words)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < words; i++)
+    {
+        count += __builtin_popcountll(bitmap[i]);
+    }
+    return count;
+}
+
+static const BitmapImpl g_bitmap_scalar = {"scalar", bitmap_popcount_scalar};
+
+#if defined(__x86_64__)
+__attribute__((target("popcnt"))) static uint32_t bitmap_popcount_popcnt(const uint64_t *bitmap, uint32_t words)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < words; i++)
+    {
+        count += __builtin_popcountll(bitmap[i]);
+    }
+    return count;
+}
+
+// 每字节的置位数由高低半字节查表相加，vpsadbw把每8字节的计数横向求和到64位
+__attribute__((target("avx2"))) static uint32_t bitmap_popcount_avx2(const uint64_t *bitmap, uint32_t words)
+{
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1,
+                                           2, 2, 3, 2, 3, 3, 4);
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    __m256i acc = _mm256_setzero_si256();
+
+    uint32_t i = 0;
+    for (; i + 4 <= words; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(bitmap + i));
+        __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(v, mask)),
+                                      _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi64(v, 4), mask)));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    uint32_t count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    return count + bitmap_popcount_popcnt(bitmap + i, words - i);
+}
+
+static const BitmapImpl g_bitmap_popcnt = {"popcnt", bitmap_popcount_popcnt};
+static const BitmapImpl g_bitmap_avx2 = {"avx2", bitmap_popcount_avx2};
+#elif defined(BITMAP_SIMD_NEON)
+static uint32_t bitmap_popcount_neon(const uint64_t *bitmap, uint32_t words)
+{
+    uint32_t count = 0;
+    uint32_t i = 0;
+    for (; i + 2 <= words; i += 2)
+    {
+        count += vaddvq_u8(vcntq_u8(vreinterpretq_u8_u64(vld1q_u64(bitmap + i))));
+    }
+    return count + bitmap_popcount_scalar(bitmap + i, words - i);
+}
+
+static const BitmapImpl g_bitmap_neon = {"neon", bitmap_popcount_neon};
+#endif
+
+// 本机可用的实现（按优先级从高到低）
+static const BitmapImpl *const g_bitmap_impls[] = {
+#if defined(__x86_64__)
+    &g_bitmap_avx2,
+    &g_bitmap_popcnt,
+#elif defined(BITMAP_SIMD_NEON)
+    &g_bitmap_neon,
+#endif
+    &g_bitmap_scalar,
+};
+
+static bool bitmap_impl_supported(const BitmapImpl *impl)
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (impl == &g_bitmap_avx2)
+    {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (impl == &g_bitmap_popcnt)
+    {
+        return __builtin_cpu_supports("popcnt");
+    }
+#endif
+    return true;
+}
+
+static void bitmap_init_once()
+{
+    for (size_t i = 0; i < sizeof(g_bitmap_impls) / sizeof(g_bitmap_impls[0]); i++)
+    {
+        if (bitmap_impl_supported(g_bitmap_impls[i]))
+        {
+            g_bitmap_impl = g_bitmap_impls[i];
+            break;
+        }
+    }
+}
+
+uint32_t bitmap_popcount(const uint64_t *bitmap, uint32_t words)
+{
+    pthread_once(&g_bitmap_once, bitmap_init_once);
+    return g_bitmap_impl->popcount(bitmap, words);
+}
+
+const char *bitmap_impl_name()
+{
+    pthread_once(&g_bitmap_once, bitmap_init_once);
+    return g_bitmap_impl->name;
+}
+
+bool bitmap_use_impl(const char *name)
+{
+    pthread_once(&g_bitmap_once, bitmap_init_once);
+    for (size_t i = 0; i < sizeof(g_bitmap_impls) / sizeof(g_bitmap_impls[0]); i++)
+    {
+        if (strcmp(g_bitmap_impls[i]->name, name) == 0 && bitmap_impl_supported(g_bitmap_impls[i]))
+        {
+            g_bitmap_impl = g_bitmap_impls[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+// ========== 线上格式编解码 ==========
+// v2格式的多字节字段统一使用大端字节序，编码/解码都是原地进行：
+// 发送方在缓冲池报文中构造好消息后编码一次，接收方在recvmmsg写入的缓冲区上解码。
+
+// 各消息类型载荷的最小长度（v2数据块不含数据部分）
+static size_t wire_min_payload(uint8_t msg_type)
+{
+    switch (msg_type)
+    {
+    case MSG_SESSION_ANNOUNCE:
+        return offsetof(SessionAnnounce, merkle_root) - sizeof(MessageHeader);
+    case MSG_DATA_CHUNK:
+        return offsetof(DataChunk, data) - sizeof(MessageHeader);
+    case MSG_STATUS_REQ:
+        return offsetof(StatusRequest, total_chunks) - sizeof(MessageHeader);
+    case MSG_NACK:
+        return offsetof(NackMessage, missing_bitmap) + sizeof(uint64_t) - sizeof(MessageHeader);
+    case MSG_END:
+        return offsetof(EndMessage, file_hash64) - sizeof(MessageHeader);
+    case MSG_WINDOW_DIGEST:
+        return offsetof(WindowDigestMessage, proof) - sizeof(MessageHeader);
+    case MSG_REPAIR:
+        return offsetof(RepairSymbol, data) - sizeof(MessageHeader);
+    default:
+        return 0;
+    }
+}
+
+// v1定长格式在固定部分之后总是携带的变长部分长度
+static size_t wire_v1_var_payload(uint8_t msg_type)
+{
+    switch (msg_type)
+    {
+    case MSG_DATA_CHUNK:
+    case MSG_REPAIR:
+        return DEFAULT_CHUNK_SIZE;
+    case MSG_WINDOW_DIGEST:
+        return MERKLE_MAX_DEPTH * sizeof(uint64_t);
+    default:
+        return 0;
+    }
+}
+
+// 按消息类型转换字节序（主机序与大端互换，编码和解码是同一操作）
+static void wire_swap_fields(void *msg)
+{
+    MessageHeader *header = (MessageHeader *)msg;
+    header->payload_len = htobe16(header->payload_len);
+
+    switch (header->msg_type)
+    {
+    case MSG_SESSION_ANNOUNCE:
+    {
+        SessionAnnounce *announce = (SessionAnnounce *)msg;
+        announce->file_id = htobe16(announce->file_id);
+        announce->total_chunks = htobe32(announce->total_chunks);
+        announce->window_size = htobe16(announce->window_size);
+        announce->chunk_size = htobe32(announce->chunk_size);
+        announce->merkle_root = htobe64(announce->merkle_root);
+        break;
+    }
+    case MSG_DATA_CHUNK:
+    {
+        DataChunk *chunk = (DataChunk *)msg;
+        chunk->file_id = htobe16(chunk->file_id);
+        chunk->chunk_id = htobe32(chunk->chunk_id);
+        chunk->data_len = htobe16(chunk->data_len);
+        chunk->crc = htobe16(chunk->crc);
+        break;
+    }
+    case MSG_STATUS_REQ:
+    {
+        StatusRequest *req = (StatusRequest *)msg;
+        req->file_id = htobe16(req->file_id);
+        req->window_id = htobe32(req->window_id);
+        req->round_id = htobe16(req->round_id);
+        req->total_chunks = htobe32(req->total_chunks);
+        break;
+    }
+    case MSG_NACK:
+    {
+        NackMessage *nack = (NackMessage *)msg;
+        nack->file_id = htobe16(nack->file_id);
+        nack->window_id = htobe32(nack->window_id);
+        nack->round_id = htobe16(nack->round_id);
+        for (int i = 0; i < MAX_WINDOW_WORDS; i++)
+        {
+            nack->missing_bitmap[i] = htobe64(nack->missing_bitmap[i]);
+        }
+        break;
+    }
+    case MSG_END:
+    {
+        EndMessage *end_msg = (EndMessage *)msg;
+        end_msg->file_id = htobe16(end_msg->file_id);
+        end_msg->total_chunks = htobe32(end_msg->total_chunks);
+        end_msg->file_hash = htobe32(end_msg->file_hash);
+        end_msg->file_hash64 = htobe64(end_msg->file_hash64);
+        break;
+    }
+    case MSG_WINDOW_DIGEST:
+    {
+        WindowDigestMessage *digest = (WindowDigestMessage *)msg;
+        digest->file_id = htobe16(digest->file_id);
+        digest->window_id = htobe32(digest->window_id);
+        digest->digest = htobe64(digest->digest);
+        for (int i = 0; i < digest->proof_len && i < MERKLE_MAX_DEPTH; i++)
+        {
+            digest->proof[i] = htobe64(digest->proof[i]);
+        }
+        break;
+    }
+    case MSG_REPAIR:
+    {
+        RepairSymbol *repair = (RepairSymbol *)msg;
+        repair->file_id = htobe16(repair->file_id);
+        repair->block_id = htobe32(repair->block_id);
+        repair->last_len = htobe16(repair->last_len);
+        repair->symbol_len = htobe16(repair->symbol_len);
+        repair->crc = htobe32(repair->crc);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// v2数据块使用CRC32C时，数据之后追加的校验值长度
+static size_t wire_chunk_trailer_len(const DataChunk *chunk)
+{
+    return (WIRE_GET_FLAGS(chunk->header.ver_flags) & WIRE_FLAG_CRC32C) ? sizeof(uint32_t) : 0;
+}
+
+// 原地转换CRC32C尾部的字节序（data_len须为主机字节序且已校验）
+static void wire_swap_chunk_trailer(DataChunk *chunk)
+{
+    if (wire_chunk_trailer_len(chunk))
+    {
+        uint32_t crc;
+        memcpy(&crc, chunk->data + chunk->data_len, sizeof(crc));
+        crc = htobe32(crc);
+        memcpy(chunk->data + chunk->data_len, &crc, sizeof(crc));
+    }
+}
+
+size_t wire_encode(void *msg, uint8_t version)
+{
+    MessageHeader *header = (MessageHeader *)msg;
+
+    // 编码前ver_flags只包含标志位（低4位），v1不携带标志
+    uint8_t flags = WIRE_GET_FLAGS(header->ver_flags);
+    header->ver_flags = WIRE_VER_FLAGS(version, flags);
+
+    size_t payload_len = wire_min_payload(header->msg_type);
+    if (version == WIRE_VERSION_V1)
+    {
+        // v1固定发送完整结构体
+        payload_len += wire_v1_var_payload(header->msg_type);
+    }
+    else if (header->msg_type == MSG_DATA_CHUNK)
+    {
+        // v2只携带实际数据（及可选的CRC32C尾部）
+        DataChunk *chunk = (DataChunk *)msg;
+        payload_len += chunk->data_len + wire_chunk_trailer_len(chunk);
+        wire_swap_chunk_trailer(chunk);
+    }
+    else if (header->msg_type == MSG_SESSION_ANNOUNCE && (flags & WIRE_FLAG_MERKLE))
+    {
+        payload_len += sizeof(uint64_t);
+    }
+    else if (header->msg_type == MSG_END && (flags & WIRE_FLAG_HASH64))
+    {
+        payload_len += sizeof(uint64_t);
+    }
+    else if (header->msg_type == MSG_STATUS_REQ && (flags & WIRE_FLAG_STREAM))
+    {
+        payload_len += sizeof(uint32_t);
+    }
+    else if (header->msg_type == MSG_WINDOW_DIGEST)
+    {
+        payload_len += ((WindowDigestMessage *)msg)->proof_len * sizeof(uint64_t);
+    }
+    else if (header->msg_type == MSG_REPAIR)
+    {
+        payload_len += ((RepairSymbol *)msg)->symbol_len;
+    }
+    else if (header->msg_type == MSG_NACK)
+    {
+        // 只携带到最后一个非0字（64块以内的窗口与旧格式相同，只有1个字）
+        const NackMessage *nack = (const NackMessage *)msg;
+        int words = MAX_WINDOW_WORDS;
+        while (words > 1 && nack->missing_bitmap[words - 1] == 0)
+        {
+            words--;
+        }
+        payload_len += (words - 1) * sizeof(uint64_t);
+    }
+
+    header->payload_len = payload_len;
+
+    if (version != WIRE_VERSION_V1)
+    {
+        wire_swap_fields(msg);
+    }
+    return sizeof(MessageHeader) + payload_len;
+}
+
+bool wire_decode(void *msg, size_t len)
+{
+    if (len < sizeof(MessageHeader))
+    {
+        return false;
+    }
+
+    MessageHeader *header = (MessageHeader *)msg;
+    size_t min_payload = wire_min_payload(header->msg_type);
+    if (min_payload == 0)
+    {
+        return false; // 未知消息类型
+    }
+
+    uint8_t version = WIRE_GET_VERSION(header->ver_flags);
+    if (version == WIRE_VERSION_V1)
+    {
+        // 旧格式：定长结构体，长度至少为完整结构体
+        size_t full_payload = min_payload + wire_v1_var_payload(header->msg_type);
+        if (len < sizeof(MessageHeader) + full_payload)
+        {
+            return false;
+        }
+    }
+    else if (version == WIRE_VERSION_V2)
+    {
+        wire_swap_fields(msg);
+
+        // payload_len必须与实际收到的长度一致，且不小于该消息的固定部分
+        if (header->payload_len < min_payload || sizeof(MessageHeader) + header->payload_len > len)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        return false; // 不支持的版本
+    }
+
+    if ((header->msg_type == MSG_SESSION_ANNOUNCE && (WIRE_GET_FLAGS(header->ver_flags) & WIRE_FLAG_MERKLE)) ||
+        (header->msg_type == MSG_END && (WIRE_GET_FLAGS(header->ver_flags) & WIRE_FLAG_HASH64)))
+    {
+        if (header->payload_len < min_payload + sizeof(uint64_t))
+        {
+            return false;
+        }
+    }
+    if (header->msg_type == MSG_STATUS_REQ && (WIRE_GET_FLAGS(header->ver_flags) & WIRE_FLAG_STREAM) &&
+        header->payload_len < min_payload + sizeof(uint32_t))
+    {
+        return false;
+    }
+
+    if (header->msg_type == MSG_WINDOW_DIGEST)
+    {
+        const WindowDigestMessage *digest = (const WindowDigestMessage *)msg;
+        if (digest->proof_len > MERKLE_MAX_DEPTH ||
+            (version == WIRE_VERSION_V2 && header->payload_len < min_payload + digest->proof_len * sizeof(uint64_t)))
+        {
+            return false;
+        }
+    }
+
+    if (header->msg_type == MSG_NACK)
+    {
+        // 未携带的位图字为0（v1只有第1个字）
+        NackMessage *nack = (NackMessage *)msg;
+        size_t words = version == WIRE_VERSION_V2 ? (header->payload_len - min_payload) / sizeof(uint64_t) + 1 : 1;
+        if (words < MAX_WINDOW_WORDS)
+        {
+            memset(&nack->missing_bitmap[words], 0, (MAX_WINDOW_WORDS - words) * sizeof(uint64_t));
+        }
+    }
+
+    if (header->msg_type == MSG_REPAIR)
+    {
+        const RepairSymbol *repair = (const RepairSymbol *)msg;
+        size_t max_data = version == WIRE_VERSION_V2 ? header->payload_len - min_payload : DEFAULT_CHUNK_SIZE;
+        if (repair->symbol_len > MAX_CHUNK_SIZE || repair->symbol_len > max_data ||
+            repair->last_len > repair->symbol_len)
+        {
+            return false;
+        }
+    }
+
+    if (header->msg_type == MSG_DATA_CHUNK)
+    {
+        DataChunk *chunk = (DataChunk *)msg;
+        size_t max_data = len - offsetof(DataChunk, data);
+        if (version == WIRE_VERSION_V2)
+        {
+            size_t trailer_len = wire_chunk_trailer_len(chunk);
+            if (header->payload_len < min_payload + trailer_len)
+            {
+                return false;
+            }
+            max_data = header->payload_len - min_payload - trailer_len;
+        }
+        if (chunk->data_len > MAX_CHUNK_SIZE || chunk->data_len > max_data)
+        {
+            return false;
+        }
+        if (version == WIRE_VERSION_V2)
+        {
+            wire_swap_chunk_trailer(chunk);
+        }
+    }
+
+    return true;
+}
+
+// ========== 块大小与路径MTU ==========
+// 组播没有路径MTU发现，按路由选出的出口接口MTU确定块大小：IP_MTU在已connect的UDP socket上
+// 返回内核对该目的地址使用的MTU（接口MTU或路由上配置的mtu）
+
+uint32_t path_mtu_probe()
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+        perror("socket creation failed");
+        return 0;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(MULTICAST_GROUP);
+    addr.sin_port = htons(MULTICAST_PORT);
+
+    int mtu = 0;
+    socklen_t optlen = sizeof(mtu);
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockopt(sock, IPPROTO_IP, IP_MTU, &mtu, &optlen) < 0)
+    {
+        perror("Path MTU probe failed");
+        mtu = 0;
+    }
+    close(sock);
+    return mtu > 0 ? (uint32_t)mtu : 0;
+}
+
+uint32_t chunk_size_for_mtu(uint32_t mtu)
+{
+    // 修复符号的消息头比数据块（含CRC32C尾部）长，按修复符号计算
+    size_t overhead = IP_UDP_HEADER_LEN + offsetof(RepairSymbol, data);
+    if (mtu > MAX_MTU)
+    {
+        mtu = MAX_MTU;
+    }
+    if (mtu < overhead + 8)
+    {
+        return 0;
+    }
+    uint32_t chunk_size = (uint32_t)(mtu - overhead) & ~7u;
+    return chunk_size < MAX_CHUNK_SIZE ? chunk_size : MAX_CHUNK_SIZE;
+}
+
+size_t packet_size_for_chunk(uint32_t chunk_size)
+{
+    size_t data_size = offsetof(RepairSymbol, data) + chunk_size;
+    if (data_size < offsetof(DataChunk, data) + chunk_size + sizeof(uint32_t))
+    {
+        data_size = offsetof(DataChunk, data) + chunk_size + sizeof(uint32_t);
+    }
+    // NACK解码时把省略的位图字补0，缓冲区至少要容纳完整的NackMessage
+    return data_size > sizeof(NackMessage) ? data_size : sizeof(NackMessage);
+}
+
+// ========== 报文缓冲池 ==========
+// 预分配固定数量的报文缓冲区，通过引用计数在应用层、队列和Tx/Rx线程之间传递，
+// 报文从构造（或recvmmsg写入）到发送（或解析）全程不再拷贝载荷。
+// 每个缓冲区的容量在初始化时按选定的块大小确定（transport_set_packet_size），巨帧时才按巨帧分配。
+
+static struct
+{
+    uint8_t *mem;         // 预分配的缓冲区（capacity个，间隔stride字节）
+    size_t stride;        // 相邻缓冲区的间隔（PacketBuf头部 + 报文容量，按缓存行对齐）
+    size_t buf_size;      // 每个缓冲区的报文容量
+    PacketBuf *free_list; // 空闲链表
+    size_t capacity;
+    size_t free_count;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+} g_packet_pool = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .not_empty = PTHREAD_COND_INITIALIZER,
+};
+
+// 报文缓冲区的容量
+static size_t packet_buf_size()
+{
+    return g_transport.packet_size ? g_transport.packet_size : MAX_PACKET_SIZE;
+}
+
+// 每个缓冲区占用的内存（PacketBuf头部 + 报文容量，按缓存行对齐）
+static size_t packet_buf_stride()
+{
+    return (sizeof(PacketBuf) + packet_buf_size() + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+}
+
+static bool packet_pool_init(size_t capacity)
+{
+    g_packet_pool.stride = packet_buf_stride();
+    g_packet_pool.buf_size = packet_buf_size();
+    g_packet_pool.mem = calloc(capacity, g_packet_pool.stride);
+    if (!g_packet_pool.mem)
+    {
+        perror("Failed to allocate packet pool");
+        return false;
+    }
+
+    g_packet_pool.capacity = capacity;
+    g_packet_pool.free_list = NULL;
+    for (size_t i = 0; i < capacity; i++)
+    {
+        PacketBuf *pkt = (PacketBuf *)(g_packet_pool.mem + i * g_packet_pool.stride);
+        pkt->next = g_packet_pool.free_list;
+        g_packet_pool.free_list = pkt;
+    }
+    g_packet_pool.free_count = capacity;
+    return true;
+}
+
+static void packet_pool_destroy()
+{
+    free(g_packet_pool.mem);
+    g_packet_pool.mem = NULL;
+    g_packet_pool.free_list = NULL;
+    g_packet_pool.capacity = 0;
+    g_packet_pool.free_count = 0;
+}
+
+PacketBuf *packet_alloc()
+{
+    pthread_mutex_lock(&g_packet_pool.mutex);
+
+    // 缓冲池耗尽时等待（阻塞），相当于原队列满时的背压
+    while (g_packet_pool.free_list == NULL)
+    {
+        pthread_cond_wait(&g_packet_pool.not_empty, &g_packet_pool.mutex);
+    }
+
+    PacketBuf *pkt = g_packet_pool.free_list;
+    g_packet_pool.free_list = pkt->next;
+    g_packet_pool.free_count--;
+
+    pthread_mutex_unlock(&g_packet_pool.mutex);
+
+    pkt->next = NULL;
+    pkt->refcnt = 1;
+    pkt->len = 0;
+    pkt->ext_len = 0;
+    return pkt;
+}
+
+// 非阻塞分配，缓冲池耗尽时返回NULL
+static PacketBuf *packet_try_alloc()
+{
+    pthread_mutex_lock(&g_packet_pool.mutex);
+    PacketBuf *pkt = g_packet_pool.free_list;
+    if (pkt)
+    {
+        g_packet_pool.free_list = pkt->next;
+        g_packet_pool.free_count--;
+    }
+    pthread_mutex_unlock(&g_packet_pool.mutex);
+
+    if (pkt)
+    {
+        pkt->next = NULL;
+        pkt->refcnt = 1;
+        pkt->len = 0;
+        pkt->ext_len = 0;
+    }
+    return pkt;
+}
+
+// 缓冲池的内存区间（用于注册为io_uring固定缓冲区）
+static void packet_pool_region(void **base, size_t *len)
+{
+    *base = g_packet_pool.mem;
+    *len = g_packet_pool.capacity * g_packet_pool.stride;
+}
+
+void packet_ref(PacketBuf *pkt)
+{
+    __atomic_add_fetch(&pkt->refcnt, 1, __ATOMIC_RELAXED);
+}
+
+void packet_release(PacketBuf *pkt)
+{
+    if (__atomic_sub_fetch(&pkt->refcnt, 1, __ATOMIC_ACQ_REL) != 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&g_packet_pool.mutex);
+    pkt->next = g_packet_pool.free_list;
+    g_packet_pool.free_list = pkt;
+    g_packet_pool.free_count++;
+    pthread_cond_signal(&g_packet_pool.not_empty);
+    pthread_mutex_unlock(&g_packet_pool.mutex);
+}
+
+void packet_linearize(PacketBuf *pkt)
+{
+    if (pkt->ext_len > 0)
+    {
+        memcpy(pkt->data + pkt->ext_offset, pkt->ext_data, pkt->ext_len);
+        pkt->ext_len = 0;
+    }
+}
+
+// 报文的分散/聚集视图：data头部、外部数据段、data尾部（空段省略），返回iovec个数（最多3个）
+static int packet_iov(const PacketBuf *pkt, struct iovec *iov)
+{
+    if (pkt->ext_len == 0)
+    {
+        iov[0].iov_base = (void *)pkt->data;
+        iov[0].iov_len = pkt->len;
+        return 1;
+    }
+
+    int n = 0;
+    size_t tail = pkt->ext_offset + pkt->ext_len;
+    if (pkt->ext_offset > 0)
+    {
+        iov[n].iov_base = (void *)pkt->data;
+        iov[n++].iov_len = pkt->ext_offset;
+    }
+    iov[n].iov_base = (void *)pkt->ext_data;
+    iov[n++].iov_len = pkt->ext_len;
+    if (pkt->len > tail)
+    {
+        iov[n].iov_base = (void *)(pkt->data + tail);
+        iov[n++].iov_len = pkt->len - tail;
+    }
+    return n;
+}
+
+// ========== 队列操作函数 ==========
+// 队列中只保存报文句柄，入队/出队不拷贝数据
+
+#ifdef USE_MUTEX_QUEUE
+
+static void queue_init(PacketQueue *q)
+{
+    q->head = 0;
+    q->tail = 0;
+    q->count = 0;
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+}
+
+// 批量入队：一次加锁放入尽可能多的报文，队列满时等待
+static void queue_push_batch(PacketQueue *q, PacketBuf **pkts, int count)
+{
+    int pushed = 0;
+
+    pthread_mutex_lock(&q->mutex);
+    while (pushed < count)
+    {
+        while (q->count >= QUEUE_CAPACITY)
+        {
+            pthread_cond_wait(&q->not_full, &q->mutex);
+        }
+
+        while (pushed < count && q->count < QUEUE_CAPACITY)
+        {
+            q->pkts[q->tail] = pkts[pushed];
+            q->tail = (q->tail + 1) % QUEUE_CAPACITY;
+            q->count++;
+            pushed++;
+        }
+
+        pthread_cond_signal(&q->not_empty);
+    }
+    pthread_mutex_unlock(&q->mutex);
+}
+
+// 批量出队：阻塞直到至少有1个报文，一次加锁最多取出max_count个
+static int queue_pop_batch(PacketQueue *q, PacketBuf **pkts, int max_count)
+{
+    pthread_mutex_lock(&q->mutex);
+
+    while (q->count == 0)
+    {
+        pthread_cond_wait(&q->not_empty, &q->mutex);
+    }
+
+    int popped = 0;
+    while (popped < max_count && q->count > 0)
+    {
+        pkts[popped++] = q->pkts[q->head];
+        q->head = (q->head + 1) % QUEUE_CAPACITY;
+        q->count--;
+    }
+
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->mutex);
+
+    return popped;
+}
+
+#else
+
+// 无锁单生产者/单消费者环形队列：
+//   - 生产者只写tail，消费者只写head，二者位于不同缓存行
+//   - 队列空/满时先自旋SPSC_SPIN_COUNT次，仍未就绪才在futex上休眠
+//   - 只有对端确实在休眠时才调用futex唤醒，繁忙时交接报文不进入内核
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+static void futex_wait(uint32_t *addr, uint32_t expected)
+{
+    // 带超时兜底，并在醒来后检查取消请求（transport_close使用pthread_cancel）
+    struct timespec timeout = {0, 100 * 1000 * 1000};
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, &timeout, NULL, 0);
+    pthread_testcancel();
+}
+
+static void futex_wake(uint32_t *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// 发布索引后，仅在对端休眠时唤醒
+static inline void ring_notify(uint32_t *index, uint32_t *waiting)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_RELAXED))
+    {
+        futex_wake(index);
+    }
+}
+
+static void queue_init(PacketQueue *q)
+{
+    memset(q, 0, sizeof(*q));
+    pthread_mutex_init(&q->producer_lock, NULL);
+}
+
+// 消费者等待队列非空，返回最新的tail
+static uint32_t ring_wait_not_empty(PacketQueue *q, uint32_t head)
+{
+    uint32_t tail;
+    for (int spin = 0; spin < SPSC_SPIN_COUNT; spin++)
+    {
+        tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+        if (tail != head)
+        {
+            return tail;
+        }
+        cpu_relax();
+    }
+
+    while (1)
+    {
+        __atomic_store_n(&q->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+        tail = __atomic_load_n(&q->tail, __ATOMIC_SEQ_CST);
+        if (tail != head)
+        {
+            break;
+        }
+        futex_wait(&q->tail, tail);
+    }
+    __atomic_store_n(&q->consumer_waiting, 0, __ATOMIC_RELAXED);
+    return tail;
+}
+
+// 生产者等待队列有空位，返回最新的head
+static uint32_t ring_wait_not_full(PacketQueue *q, uint32_t tail)
+{
+    uint32_t head;
+    for (int spin = 0; spin < SPSC_SPIN_COUNT; spin++)
+    {
+        head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+        if (tail - head < QUEUE_CAPACITY)
+        {
+            return head;
+        }
+        cpu_relax();
+    }
+
+    while (1)
+    {
+        __atomic_store_n(&q->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        head = __atomic_load_n(&q->head, __ATOMIC_SEQ_CST);
+        if (tail - head < QUEUE_CAPACITY)
+        {
+            break;
+        }
+        futex_wait(&q->head, head);
+    }
+    __atomic_store_n(&q->producer_waiting, 0, __ATOMIC_RELAXED);
+    return head;
+}
+
+// 批量入队：一次发布整批报文，队列满时自适应等待
+static void queue_push_batch(PacketQueue *q, PacketBuf **pkts, int count)
+{
+    // 生产端锁在单发送线程时无竞争，只是一次原子操作
+    pthread_mutex_lock(&q->producer_lock);
+
+    uint32_t tail = q->tail;
+    int pushed = 0;
+    while (pushed < count)
+    {
+        uint32_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+        if (tail - head >= QUEUE_CAPACITY)
+        {
+            head = ring_wait_not_full(q, tail);
+        }
+
+        while (pushed < count && tail - head < QUEUE_CAPACITY)
+        {
+            q->pkts[tail & (SPSC_RING_SLOTS - 1)] = pkts[pushed++];
+            tail++;
+        }
+
+        __atomic_store_n(&q->tail, tail, __ATOMIC_RELEASE);
+        ring_notify(&q->tail, &q->consumer_waiting);
+    }
+
+    pthread_mutex_unlock(&q->producer_lock);
+}
+
+// 批量出队：阻塞直到至少有1个报文，一次最多取出max_count个
+static int queue_pop_batch(PacketQueue *q, PacketBuf **pkts, int max_count)
+{
+    uint32_t head = q->head;
+    uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    if (tail == head)
+    {
+        tail = ring_wait_not_empty(q, head);
+    }
+
+    int popped = 0;
+    while (popped < max_count && head != tail)
+    {
+        pkts[popped++] = q->pkts[head & (SPSC_RING_SLOTS - 1)];
+        head++;
+    }
+
+    __atomic_store_n(&q->head, head, __ATOMIC_RELEASE);
+    ring_notify(&q->head, &q->producer_waiting);
+
+    return popped;
+}
+
+#endif // USE_MUTEX_QUEUE
+
+static void queue_push(PacketQueue *q, PacketBuf *pkt)
+{
+    queue_push_batch(q, &pkt, 1);
+}
+
+static PacketBuf *queue_pop(PacketQueue *q)
+{
+    PacketBuf *pkt = NULL;
+    queue_pop_batch(q, &pkt, 1);
+    return pkt;
+}
+
+// ========== 令牌桶发送调度 ==========
+// 按CLOCK_MONOTONIC的绝对截止时间补充令牌：usleep多睡的时间会自动折算成令牌，
+// 不会像每包usleep那样累积误差；令牌足够时整批短突发发送。
+
+static void pacer_refill(TokenBucket *tb, uint64_t now_ns)
+{
+    double elapsed = (double)(now_ns - tb->last_refill_ns) / 1e9;
+    tb->tokens += elapsed * tb->rate_bps / 8.0;
+    if (tb->tokens > tb->burst_bytes)
+    {
+        tb->tokens = tb->burst_bytes;
+    }
+    tb->last_refill_ns = now_ns;
+}
+
+// 返回本次允许发送的报文数（至少1个），令牌不足时休眠到足够发送第一个报文的时刻
+static int pacer_admit(TokenBucket *tb, PacketBuf **pkts, int count)
+{
+    pthread_mutex_lock(&tb->mutex);
+
+    uint64_t now_ns = get_monotonic_ns();
+    if (tb->rate_bps == 0)
+    {
+        tb->last_send_ns = now_ns;
+        pthread_mutex_unlock(&tb->mutex);
+        return count;
+    }
+
+    pacer_refill(tb, now_ns);
+
+    if (tb->tokens < pkts[0]->len)
+    {
+        double deficit = pkts[0]->len - tb->tokens;
+        uint64_t deadline_ns = now_ns + (uint64_t)(deficit * 8.0 * 1e9 / tb->rate_bps);
+        uint64_t rate_bps = tb->rate_bps;
+        pthread_mutex_unlock(&tb->mutex);
+
+        struct timespec deadline = {
+            .tv_sec = deadline_ns / 1000000000ULL,
+            .tv_nsec = deadline_ns % 1000000000ULL,
+        };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) != 0)
+        {
+            // 被信号中断，继续等待同一截止时间
+        }
+        g_transport.stats.pacing_waits++;
+
+        pthread_mutex_lock(&tb->mutex);
+        now_ns = get_monotonic_ns();
+        if (tb->rate_bps != rate_bps)
+        {
+            // 等待期间速率被调整，丢弃按旧速率计算的令牌
+            tb->tokens = 0;
+            tb->last_refill_ns = now_ns;
+        }
+        pacer_refill(tb, now_ns);
+    }
+
+    int admitted = 0;
+    while (admitted < count && (tb->tokens >= pkts[admitted]->len || admitted == 0))
+    {
+        tb->tokens -= pkts[admitted]->len;
+        admitted++;
+    }
+
+    // 统计有效发送时长：两次发送间隔过长视为空闲，不计入
+    if (tb->last_send_ns != 0 && now_ns - tb->last_send_ns < PACING_IDLE_GAP_NS)
+    {
+        g_transport.stats.pacing_active_ns += now_ns - tb->last_send_ns;
+    }
+    tb->last_send_ns = now_ns;
+
+    pthread_mutex_unlock(&tb->mutex);
+    return admitted;
+}
+
+// ========== 传输层线程函数 ==========
+
+// 逐报文发送：每个报文一个mmsghdr，一次sendmmsg发出
+static int transmit_plain(PacketBuf **pkts, int count)
+{
+    struct iovec iovecs[TRANSPORT_BATCH_SIZE * 3];
+    struct mmsghdr msgs[TRANSPORT_BATCH_SIZE];
+
+    memset(msgs, 0, sizeof(msgs[0]) * count);
+    int iov_count = 0;
+    for (int i = 0; i < count; i++)
+    {
+        msgs[i].msg_hdr.msg_name = &g_transport.dest_addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(g_transport.dest_addr);
+        msgs[i].msg_hdr.msg_iov = &iovecs[iov_count];
+        msgs[i].msg_hdr.msg_iovlen = packet_iov(pkts[i], &iovecs[iov_count]);
+        iov_count += msgs[i].msg_hdr.msg_iovlen;
+    }
+
+    int sent = send_multicast_batch(g_transport.sock, msgs, count);
+    return sent > 0 ? sent : 0;
+}
+
+// GSO发送：连续的等长报文（最后一个可以更短）合并为一个超大报文，由内核按UDP_SEGMENT分段，
+// 单个报文不附带控制消息。返回已发出的报文数
+static int transmit_gso(PacketBuf **pkts, int count)
+{
+    struct iovec iovecs[TRANSPORT_BATCH_SIZE * 3];
+    struct mmsghdr msgs[TRANSPORT_BATCH_SIZE];
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    } ctrl[TRANSPORT_BATCH_SIZE];
+    int group_first[TRANSPORT_BATCH_SIZE + 1];
+
+    memset(msgs, 0, sizeof(msgs[0]) * count);
+    int groups = 0;
+    int iov_count = 0;
+    int i = 0;
+    while (i < count)
+    {
+        size_t seg = pkts[i]->len;
+        size_t bytes = seg;
+        int n = 1;
+        while (i + n < count && n < UDP_GSO_MAX_SEGMENTS && bytes + pkts[i + n]->len <= UDP_GSO_MAX_BYTES &&
+               pkts[i + n - 1]->len == seg && pkts[i + n]->len <= seg)
+        {
+            bytes += pkts[i + n]->len;
+            n++;
+        }
+
+        // 内核按字节数分段，与报文由几个iovec组成无关
+        struct msghdr *hdr = &msgs[groups].msg_hdr;
+        hdr->msg_iov = &iovecs[iov_count];
+        for (int k = 0; k < n; k++)
+        {
+            iov_count += packet_iov(pkts[i + k], &iovecs[iov_count]);
+        }
+        hdr->msg_iovlen = &iovecs[iov_count] - hdr->msg_iov;
+        hdr->msg_name = &g_transport.dest_addr;
+        hdr->msg_namelen = sizeof(g_transport.dest_addr);
+        if (n > 1)
+        {
+            hdr->msg_control = ctrl[groups].buf;
+            hdr->msg_controllen = sizeof(ctrl[groups].buf);
+            struct cmsghdr *cm = CMSG_FIRSTHDR(hdr);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso_size = seg;
+            memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+        }
+
+        group_first[groups++] = i;
+        i += n;
+    }
+    group_first[groups] = count;
+
+    int sent_groups = send_multicast_batch(g_transport.sock, msgs, groups);
+    if (sent_groups < 0)
+    {
+        sent_groups = 0;
+    }
+    for (int g = 0; g < sent_groups; g++)
+    {
+        int n = group_first[g + 1] - group_first[g];
+        if (n > 1)
+        {
+            g_transport.stats.tx_gso_sends++;
+            g_transport.stats.tx_gso_segments += n;
+        }
+    }
+    return group_first[sent_groups];
+}
+
+// 按令牌桶拆分为若干短突发，每个突发用一次sendmmsg发出，发送后释放报文
+static void transport_transmit(PacketBuf **pkts, int count)
+{
+    int offset = 0;
+    while (offset < count)
+    {
+        int burst = pacer_admit(&g_transport.pacer, pkts + offset, count - offset);
+
+        int sent;
+        if (g_transport.gso)
+        {
+            sent = transmit_gso(pkts + offset, burst);
+            if (sent < burst)
+            {
+                // 发送路径不支持GSO（如网卡无校验和卸载时返回EIO）：关闭GSO，剩余报文逐个发送
+                fprintf(stderr, "UDP GSO send failed, falling back to per-packet sends\n");
+                g_transport.gso = false;
+                sent += transmit_plain(pkts + offset + sent, burst - sent);
+            }
+        }
+        else
+        {
+            sent = transmit_plain(pkts + offset, burst);
+        }
+
+        for (int i = 0; i < sent; i++)
+        {
+            g_transport.stats.tx_bytes += pkts[offset + i]->len;
+        }
+        g_transport.stats.tx_packets += sent;
+        g_transport.stats.tx_batch_hist[burst]++;
+
+        for (int i = 0; i < burst; i++)
+        {
+            packet_release(pkts[offset + i]);
+        }
+        offset += burst;
+    }
+}
+
+// 为一批接收缓冲区填充recvmmsg参数
+static void rx_prepare_msgs(PacketBuf **pkts, struct iovec *iovecs, struct mmsghdr *msgs,
+                            struct sockaddr_in *src_addrs, int count)
+{
+    memset(msgs, 0, sizeof(msgs[0]) * count);
+    for (int i = 0; i < count; i++)
+    {
+        iovecs[i].iov_base = pkts[i]->data;
+        iovecs[i].iov_len = g_packet_pool.buf_size;
+        msgs[i].msg_hdr.msg_name = &src_addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(src_addrs[i]);
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+// GRO接收：一次recvmmsg读取若干（可能已合并的）报文，按UDP_GRO给出的分段大小拆回单个报文，
+// 每凑满一批交给deliver。返回读到的报文数，0表示没有数据
+static int rx_read_gro(int flags, RxDeliverFunc deliver)
+{
+    struct iovec iovecs[GRO_RX_BATCH];
+    struct mmsghdr msgs[GRO_RX_BATCH];
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctrl[GRO_RX_BATCH];
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < GRO_RX_BATCH; i++)
+    {
+        iovecs[i].iov_base = g_transport.gro_bufs + (size_t)i * GRO_RX_BUF_SIZE;
+        iovecs[i].iov_len = GRO_RX_BUF_SIZE;
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = ctrl[i].buf;
+        msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i].buf);
+    }
+
+    int count = recvmmsg(g_transport.sock, msgs, GRO_RX_BATCH, flags, NULL);
+    if (count <= 0)
+    {
+        return 0;
+    }
+
+    PacketBuf *pkts[TRANSPORT_BATCH_SIZE];
+    int npkts = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const uint8_t *data = iovecs[i].iov_base;
+        size_t len = msgs[i].msg_len;
+
+        // 没有UDP_GRO控制消息表示未合并，整个报文就是一个分段
+        size_t seg = len;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cm; cm = CMSG_NXTHDR(&msgs[i].msg_hdr, cm))
+        {
+            if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO)
+            {
+                int gso_size;
+                memcpy(&gso_size, CMSG_DATA(cm), sizeof(gso_size));
+                seg = gso_size;
+            }
+        }
+        if (seg == 0 || seg > g_packet_pool.buf_size)
+        {
+            continue; // 超过单个缓冲区的报文无法拆分，丢弃
+        }
+
+        g_transport.stats.rx_gro_reads++;
+        for (size_t off = 0; off < len; off += seg)
+        {
+            size_t n = (len - off < seg) ? len - off : seg;
+            PacketBuf *pkt = packet_alloc();
+            memcpy(pkt->data, data + off, n);
+            pkt->len = n;
+            pkts[npkts++] = pkt;
+            g_transport.stats.rx_gro_segments++;
+
+            if (npkts == TRANSPORT_BATCH_SIZE)
+            {
+                g_transport.stats.rx_packets += npkts;
+                g_transport.stats.rx_batch_hist[npkts]++;
+                deliver(pkts, npkts);
+                npkts = 0;
+            }
+        }
+    }
+
+    if (npkts > 0)
+    {
+        g_transport.stats.rx_packets += npkts;
+        g_transport.stats.rx_batch_hist[npkts]++;
+        deliver(pkts, npkts);
+    }
+    return count;
+}
+
+static void rx_deliver_queue(PacketBuf **pkts, int count)
+{
+    queue_push_batch(&g_transport.rx_queue, pkts, count);
+}
+
+static void *tx_thread_func(void *arg)
+{
+    PacketBuf *pkts[TRANSPORT_BATCH_SIZE];
+
+    while (g_transport.running)
+    {
+        // 一次取出一批报文，直接从缓冲池发送
+        int count = queue_pop_batch(&g_transport.tx_queue, pkts, TRANSPORT_BATCH_SIZE);
+        transport_transmit(pkts, count);
+    }
+    return NULL;
+}
+
+static void *rx_thread_func(void *arg)
+{
+    PacketBuf *pkts[TRANSPORT_BATCH_SIZE];
+    struct iovec iovecs[TRANSPORT_BATCH_SIZE];
+    struct mmsghdr msgs[TRANSPORT_BATCH_SIZE];
+    struct sockaddr_in src_addrs[TRANSPORT_BATCH_SIZE];
+
+    if (g_transport.gro)
+    {
+        // GRO模式：接收到独立的大缓冲区，拆分时拷贝到缓冲池报文
+        while (g_transport.running)
+        {
+            rx_read_gro(MSG_WAITFORONE, g_transport.rx_deliver);
+        }
+        return NULL;
+    }
+
+    for (int i = 0; i < TRANSPORT_BATCH_SIZE; i++)
+    {
+        pkts[i] = packet_alloc();
+    }
+
+    while (g_transport.running)
+    {
+        rx_prepare_msgs(pkts, iovecs, msgs, src_addrs, TRANSPORT_BATCH_SIZE);
+
+        // recvmmsg直接写入缓冲池中的报文，整批句柄一次加锁放入接收队列
+        int count = recv_multicast_batch(g_transport.sock, msgs, TRANSPORT_BATCH_SIZE);
+        if (count <= 0)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            pkts[i]->len = msgs[i].msg_len;
+        }
+
+        g_transport.stats.rx_packets += count;
+        g_transport.stats.rx_batch_hist[count]++;
+        g_transport.rx_deliver(pkts, count);
+
+        // 已交出的缓冲区由消费者释放，这里补充新的缓冲区
+        for (int i = 0; i < count; i++)
+        {
+            pkts[i] = packet_alloc();
+        }
+    }
+    return NULL;
+}
+
+// ========== 事件循环（epoll + timerfd） ==========
+// 单线程运行时：socket可读事件、NACK退避定时器和STATUS_REQ等待超时都在同一线程处理，
+// 所有定时器共用一个timerfd（按最早到期时间设置），不为单个事件创建线程。
+
+// 定时器ID = 槽位复用计数的低15位 << 16 | 槽位号：始终非负，槽位号不与其他槽位混淆
+#define EVLOOP_TIMER_SLOT_BITS 16
+#define EVLOOP_TIMER_SLOT_MASK ((1u << EVLOOP_TIMER_SLOT_BITS) - 1)
+#define EVLOOP_TIMER_GEN_MASK 0x7FFFu
+_Static_assert(EVLOOP_MAX_TIMERS <= (1 << EVLOOP_TIMER_SLOT_BITS), "EVLOOP_MAX_TIMERS exceeds the timer ID slot field");
+
+typedef struct
+{
+    bool active;
+    uint32_t generation;  // 定时器槽位复用计数，用于识别已失效的定时器ID
+    uint64_t deadline_ns; // 到期时间（CLOCK_MONOTONIC）
+    EventTimerCallback callback;
+    void *arg;
+} EventTimer;
+
+typedef struct
+{
+    int fd;
+    EventFdCallback callback;
+    void *arg;
+} EventSource;
+
+static struct
+{
+    int epoll_fd;
+    int timer_fd;
+    bool stop;
+    EventTimer timers[EVLOOP_MAX_TIMERS];
+    EventSource sources[EVLOOP_MAX_FDS];
+    int source_count;
+} g_evloop = {.epoll_fd = -1, .timer_fd = -1};
+
+bool evloop_init()
+{
+    g_evloop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (g_evloop.epoll_fd < 0)
+    {
+        perror("epoll_create1 failed");
+        return false;
+    }
+
+    g_evloop.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (g_evloop.timer_fd < 0)
+    {
+        perror("timerfd_create failed");
+        close(g_evloop.epoll_fd);
+        g_evloop.epoll_fd = -1;
+        return false;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // NULL表示timerfd
+    if (epoll_ctl(g_evloop.epoll_fd, EPOLL_CTL_ADD, g_evloop.timer_fd, &ev) < 0)
+    {
+        perror("epoll_ctl timerfd failed");
+        evloop_close();
+        return false;
+    }
+
+    memset(g_evloop.timers, 0, sizeof(g_evloop.timers));
+    g_evloop.source_count = 0;
+    g_evloop.stop = false;
+    return true;
+}
+
+void evloop_close()
+{
+    if (g_evloop.timer_fd >= 0)
+    {
+        close(g_evloop.timer_fd);
+        g_evloop.timer_fd = -1;
+    }
+    if (g_evloop.epoll_fd >= 0)
+    {
+        close(g_evloop.epoll_fd);
+        g_evloop.epoll_fd = -1;
+    }
+}
+
+bool evloop_add_fd(int fd, EventFdCallback callback, void *arg)
+{
+    if (g_evloop.source_count >= EVLOOP_MAX_FDS)
+    {
+        fprintf(stderr, "evloop: too many event sources\n");
+        return false;
+    }
+
+    EventSource *src = &g_evloop.sources[g_evloop.source_count];
+    src->fd = fd;
+    src->callback = callback;
+    src->arg = arg;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = src;
+    if (epoll_ctl(g_evloop.epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        perror("epoll_ctl add failed");
+        return false;
+    }
+
+    g_evloop.source_count++;
+    return true;
+}
+
+// 将timerfd设置为最早到期的定时器
+static void evloop_rearm()
+{
+    uint64_t earliest = 0;
+    for (int i = 0; i < EVLOOP_MAX_TIMERS; i++)
+    {
+        if (g_evloop.timers[i].active &&
+            (earliest == 0 || g_evloop.timers[i].deadline_ns < earliest))
+        {
+            earliest = g_evloop.timers[i].deadline_ns;
+        }
+    }
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its)); // 全0表示停止定时器
+    if (earliest != 0)
+    {
+        its.it_value.tv_sec = earliest / 1000000000ULL;
+        its.it_value.tv_nsec = earliest % 1000000000ULL;
+    }
+    timerfd_settime(g_evloop.timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+int evloop_timer_start(uint32_t delay_ms, EventTimerCallback callback, void *arg)
+{
+    for (int i = 0; i < EVLOOP_MAX_TIMERS; i++)
+    {
+        EventTimer *timer = &g_evloop.timers[i];
+        if (timer->active)
+        {
+            continue;
+        }
+
+        timer->active = true;
+        timer->generation = (timer->generation + 1) & EVLOOP_TIMER_GEN_MASK;
+        // 0ms也至少推迟1ns，timerfd的全0值表示停止
+        timer->deadline_ns = get_monotonic_ns() + (uint64_t)delay_ms * 1000000ULL + 1;
+        timer->callback = callback;
+        timer->arg = arg;
+        evloop_rearm();
+        return (int)((timer->generation << EVLOOP_TIMER_SLOT_BITS) | (uint32_t)i);
+    }
+
+    fprintf(stderr, "evloop: no free timer slot\n");
+    return -1;
+}
+
+void evloop_timer_cancel(int timer_id)
+{
+    if (timer_id < 0)
+    {
+        return;
+    }
+
+    uint32_t slot = (uint32_t)timer_id & EVLOOP_TIMER_SLOT_MASK;
+    if (slot >= EVLOOP_MAX_TIMERS)
+    {
+        return;
+    }
+    EventTimer *timer = &g_evloop.timers[slot];
+    if (timer->active && timer->generation == ((uint32_t)timer_id >> EVLOOP_TIMER_SLOT_BITS))
+    {
+        timer->active = false;
+        evloop_rearm();
+    }
+}
+
+// 触发所有已到期的定时器
+static void evloop_fire_timers()
+{
+    uint64_t expirations;
+    while (read(g_evloop.timer_fd, &expirations, sizeof(expirations)) > 0)
+    {
+    }
+
+    uint64_t now_ns = get_monotonic_ns();
+    for (int i = 0; i < EVLOOP_MAX_TIMERS; i++)
+    {
+        EventTimer *timer = &g_evloop.timers[i];
+        if (timer->active && timer->deadline_ns <= now_ns)
+        {
+            // 回调中可能重新启动定时器，先标记失效
+            timer->active = false;
+            timer->callback(timer->arg);
+        }
+    }
+    evloop_rearm();
+}
+
+static void evloop_stop_cb(void *arg)
+{
+    g_evloop.stop = true;
+}
+
+void evloop_stop()
+{
+    g_evloop.stop = true;
+}
+
+void evloop_run()
+{
+    struct epoll_event events[EVLOOP_MAX_FDS + 1];
+
+    g_evloop.stop = false;
+    while (!g_evloop.stop)
+    {
+        // 进入等待前把本轮积攒的报文一次发出
+        transport_flush();
+
+        int n = epoll_wait(g_evloop.epoll_fd, events, EVLOOP_MAX_FDS + 1, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            EventSource *src = (EventSource *)events[i].data.ptr;
+            if (src == NULL)
+            {
+                evloop_fire_timers();
+            }
+            else
+            {
+                src->callback(src->arg);
+            }
+        }
+    }
+    transport_flush();
+}
+
+void evloop_run_for(uint32_t ms)
+{
+    // 等待超时也由timerfd驱动，期间照常处理收到的报文和其他定时器
+    int timer_id = evloop_timer_start(ms, evloop_stop_cb, NULL);
+    evloop_run();
+    evloop_timer_cancel(timer_id);
+}
+
+// ========== io_uring传输后端 ==========
+// 不依赖liburing，直接使用io_uring系统调用：
+//   - 接收：一个多发(multishot)RECV请求 + 提供缓冲环(provided buffer ring)，
+//     内核直接把报文写入缓冲池中的PacketBuf，每个报文只产生一个CQE，不需要反复提交
+//   - 发送：数据块先在提交队列中攒批，一次io_uring_enter提交；缓冲池整体注册为固定缓冲区，
+//     使用SEND_ZC + IORING_RECVSEND_FIXED_BUF从缓冲池直接发送，通知CQE到达后再释放报文
+//   - 不创建额外线程：发送在调用线程中提交，完成事件由接收方(transport_recv_packet)回收
+
+#define UR_USER_DATA_RECV 0ULL // 多发接收请求
+#define UR_USER_DATA_WAKE 1ULL // 关闭时唤醒阻塞的接收方
+// 其余user_data为发送报文的PacketBuf指针
+
+static struct
+{
+    int ring_fd;
+    unsigned features;
+
+    // 提交队列
+    void *sq_ptr;
+    size_t sq_len;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    uint32_t sq_entries;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+    uint32_t sq_unsubmitted; // 已填写未提交的SQE数
+    uint32_t sq_data_pending; // 其中数据报文数（用于批大小统计）
+
+    // 完成队列
+    void *cq_ptr;
+    size_t cq_len;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // 提供缓冲环：第bid个槽位对应recv_bufs[bid]
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_len;
+    uint16_t buf_ring_tail;
+    PacketBuf *recv_bufs[UR_RECV_BUFS];
+    bool recv_armed;
+
+    // 已完成、等待应用取走的接收报文
+    PacketBuf *rx_ready[UR_RECV_BUFS];
+    int rx_ready_head;
+    int rx_ready_count;
+
+    bool fixed_buffers; // 缓冲池是否已注册为固定缓冲区
+
+    pthread_mutex_t tx_mutex; // 保护待发送批次与令牌桶（多个线程都可能发送）
+    pthread_mutex_t sq_mutex; // 提交队列（发送方与重新布置接收的回收方共用）
+    pthread_mutex_t cq_mutex; // 完成队列的回收者
+} g_uring = {.ring_fd = -1};
+
+static int uring_setup(uint32_t entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags)
+{
+    return (int)syscall(__NR_io_uring_enter, g_uring.ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(uint32_t opcode, void *arg, uint32_t nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, g_uring.ring_fd, opcode, arg, nr_args);
+}
+
+// 探测内核是否支持本后端依赖的操作码（SEND_ZC与多发RECV同在6.0引入）
+static bool uring_probe_ops()
+{
+    size_t probe_len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_len);
+    if (!probe)
+    {
+        return false;
+    }
+
+    bool ok = false;
+    if (uring_register(IORING_REGISTER_PROBE, probe, 256) >= 0)
+    {
+        ok = probe->last_op >= IORING_OP_SEND_ZC &&
+             (probe->ops[IORING_OP_RECV].flags & IO_URING_OP_SUPPORTED) &&
+             (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+// 取一个空闲SQE（调用方持有sq_mutex），提交队列满时先提交
+static struct io_uring_sqe *uring_get_sqe()
+{
+    uint32_t head = __atomic_load_n(g_uring.sq_head, __ATOMIC_ACQUIRE);
+    uint32_t tail = *g_uring.sq_tail;
+    if (tail - head >= g_uring.sq_entries)
+    {
+        uring_enter(g_uring.sq_unsubmitted, 0, 0);
+        g_uring.sq_unsubmitted = 0;
+        head = __atomic_load_n(g_uring.sq_head, __ATOMIC_ACQUIRE);
+        if (tail - head >= g_uring.sq_entries)
+        {
+            return NULL;
+        }
+    }
+
+    uint32_t index = tail & *g_uring.sq_mask;
+    struct io_uring_sqe *sqe = &g_uring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    g_uring.sq_array[index] = index;
+    __atomic_store_n(g_uring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    g_uring.sq_unsubmitted++;
+    return sqe;
+}
+
+// 提交已填写的SQE（调用方持有sq_mutex）
+static void uring_submit_locked()
+{
+    if (g_uring.sq_unsubmitted == 0)
+    {
+        return;
+    }
+
+    int ret = uring_enter(g_uring.sq_unsubmitted, 0, 0);
+    if (ret < 0)
+    {
+        perror("io_uring_enter submit failed");
+    }
+    if (g_uring.sq_data_pending > 0)
+    {
+        uint32_t batch = g_uring.sq_data_pending;
+        g_transport.stats.tx_batch_hist[batch > TRANSPORT_BATCH_SIZE ? TRANSPORT_BATCH_SIZE : batch]++;
+    }
+    g_uring.sq_unsubmitted = 0;
+    g_uring.sq_data_pending = 0;
+}
+
+// 布置多发接收请求（调用方持有sq_mutex）
+static void uring_arm_recv_locked()
+{
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    if (!sqe)
+    {
+        return;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = g_transport.sock;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = UR_BUF_GROUP;
+    sqe->user_data = UR_USER_DATA_RECV;
+    g_uring.recv_armed = true;
+}
+
+// 把PacketBuf放回提供缓冲环的bid槽位
+static void uring_provide_buffer(uint16_t bid, PacketBuf *pkt)
+{
+    g_uring.recv_bufs[bid] = pkt;
+
+    struct io_uring_buf *buf = &g_uring.buf_ring->bufs[g_uring.buf_ring_tail & (UR_RECV_BUFS - 1)];
+    buf->addr = (uint64_t)(uintptr_t)pkt->data;
+    buf->len = g_packet_pool.buf_size;
+    buf->bid = bid;
+    g_uring.buf_ring_tail++;
+    __atomic_store_n(&g_uring.buf_ring->tail, g_uring.buf_ring_tail, __ATOMIC_RELEASE);
+}
+
+// 为已被取走的槽位补充缓冲区（缓冲池暂时耗尽时留到下次回收再补）
+static void uring_refill_buffers()
+{
+    for (uint16_t bid = 0; bid < UR_RECV_BUFS; bid++)
+    {
+        if (g_uring.recv_bufs[bid] == NULL)
+        {
+            PacketBuf *pkt = packet_try_alloc();
+            if (!pkt)
+            {
+                break;
+            }
+            uring_provide_buffer(bid, pkt);
+        }
+    }
+}
+
+// 回收完成队列（调用方持有cq_mutex），返回处理的CQE数
+static int uring_reap_locked()
+{
+    uint32_t head = *g_uring.cq_head;
+    uint32_t tail = __atomic_load_n(g_uring.cq_tail, __ATOMIC_ACQUIRE);
+    int reaped = 0;
+    int received = 0;
+    bool rearm = false;
+
+    while (head != tail)
+    {
+        struct io_uring_cqe *cqe = &g_uring.cqes[head & *g_uring.cq_mask];
+        uint64_t user_data = cqe->user_data;
+
+        if (user_data == UR_USER_DATA_RECV)
+        {
+            if (cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER))
+            {
+                uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                PacketBuf *pkt = g_uring.recv_bufs[bid];
+                g_uring.recv_bufs[bid] = NULL;
+                pkt->len = cqe->res;
+
+                int slot = (g_uring.rx_ready_head + g_uring.rx_ready_count) % UR_RECV_BUFS;
+                g_uring.rx_ready[slot] = pkt;
+                g_uring.rx_ready_count++;
+                received++;
+            }
+            // 没有IORING_CQE_F_MORE表示多发请求已终止（如缓冲区耗尽-ENOBUFS），需要重新布置
+            if (!(cqe->flags & IORING_CQE_F_MORE))
+            {
+                g_uring.recv_armed = false;
+                rearm = true;
+            }
+        }
+        else if (user_data != UR_USER_DATA_WAKE)
+        {
+            PacketBuf *pkt = (PacketBuf *)(uintptr_t)user_data;
+            if (cqe->flags & IORING_CQE_F_NOTIF)
+            {
+                // 零拷贝发送的通知：内核不再引用该缓冲区
+                packet_release(pkt);
+            }
+            else
+            {
+                if (cqe->res >= 0)
+                {
+                    g_transport.stats.tx_packets++;
+                    g_transport.stats.tx_bytes += cqe->res;
+                }
+                else
+                {
+                    fprintf(stderr, "io_uring send failed: %s\n", strerror(-cqe->res));
+                }
+                if (!(cqe->flags & IORING_CQE_F_MORE))
+                {
+                    packet_release(pkt); // 不会再有通知CQE
+                }
+            }
+        }
+
+        head++;
+        reaped++;
+    }
+
+    __atomic_store_n(g_uring.cq_head, head, __ATOMIC_RELEASE);
+
+    if (received > 0)
+    {
+        g_transport.stats.rx_packets += received;
+        g_transport.stats.rx_batch_hist[received > TRANSPORT_BATCH_SIZE ? TRANSPORT_BATCH_SIZE : received]++;
+    }
+    if (reaped > 0)
+    {
+        uring_refill_buffers();
+    }
+    if (rearm && g_transport.running)
+    {
+        pthread_mutex_lock(&g_uring.sq_mutex);
+        uring_arm_recv_locked();
+        uring_submit_locked();
+        pthread_mutex_unlock(&g_uring.sq_mutex);
+    }
+    return reaped;
+}
+
+static void uring_destroy()
+{
+    if (g_uring.buf_ring)
+    {
+        munmap(g_uring.buf_ring, g_uring.buf_ring_len);
+        g_uring.buf_ring = NULL;
+    }
+    if (g_uring.sqes)
+    {
+        munmap(g_uring.sqes, g_uring.sqes_len);
+        g_uring.sqes = NULL;
+    }
+    if (g_uring.cq_ptr && g_uring.cq_ptr != g_uring.sq_ptr)
+    {
+        munmap(g_uring.cq_ptr, g_uring.cq_len);
+    }
+    g_uring.cq_ptr = NULL;
+    if (g_uring.sq_ptr)
+    {
+        munmap(g_uring.sq_ptr, g_uring.sq_len);
+        g_uring.sq_ptr = NULL;
+    }
+    if (g_uring.ring_fd >= 0)
+    {
+        close(g_uring.ring_fd);
+        g_uring.ring_fd = -1;
+    }
+}
+
+// 创建io_uring并注册缓冲区（缓冲池与socket需已初始化），失败返回false
+static bool uring_create()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = UR_CQ_ENTRIES;
+
+    g_uring.ring_fd = uring_setup(UR_SQ_ENTRIES, &params);
+    if (g_uring.ring_fd < 0)
+    {
+        perror("io_uring_setup failed");
+        return false;
+    }
+    g_uring.features = params.features;
+
+    if (!uring_probe_ops())
+    {
+        fprintf(stderr, "io_uring: kernel lacks multishot RECV/SEND_ZC support\n");
+        uring_destroy();
+        return false;
+    }
+
+    // 映射SQ/CQ环与SQE数组
+    g_uring.sq_len = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    g_uring.cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (g_uring.cq_len > g_uring.sq_len)
+        {
+            g_uring.sq_len = g_uring.cq_len;
+        }
+    }
+
+    g_uring.sq_ptr = mmap(NULL, g_uring.sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          g_uring.ring_fd, IORING_OFF_SQ_RING);
+    if (g_uring.sq_ptr == MAP_FAILED)
+    {
+        g_uring.sq_ptr = NULL;
+        perror("io_uring mmap SQ failed");
+        uring_destroy();
+        return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        g_uring.cq_ptr = g_uring.sq_ptr;
+    }
+    else
+    {
+        g_uring.cq_ptr = mmap(NULL, g_uring.cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              g_uring.ring_fd, IORING_OFF_CQ_RING);
+        if (g_uring.cq_ptr == MAP_FAILED)
+        {
+            g_uring.cq_ptr = NULL;
+            perror("io_uring mmap CQ failed");
+            uring_destroy();
+            return false;
+        }
+    }
+
+    g_uring.sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    g_uring.sqes = mmap(NULL, g_uring.sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        g_uring.ring_fd, IORING_OFF_SQES);
+    if (g_uring.sqes == MAP_FAILED)
+    {
+        g_uring.sqes = NULL;
+        perror("io_uring mmap SQEs failed");
+        uring_destroy();
+        return false;
+    }
+
+    uint8_t *sq = g_uring.sq_ptr;
+    uint8_t *cq = g_uring.cq_ptr;
+    g_uring.sq_head = (uint32_t *)(sq + params.sq_off.head);
+    g_uring.sq_tail = (uint32_t *)(sq + params.sq_off.tail);
+    g_uring.sq_mask = (uint32_t *)(sq + params.sq_off.ring_mask);
+    g_uring.sq_array = (uint32_t *)(sq + params.sq_off.array);
+    g_uring.sq_entries = params.sq_entries;
+    g_uring.cq_head = (uint32_t *)(cq + params.cq_off.head);
+    g_uring.cq_tail = (uint32_t *)(cq + params.cq_off.tail);
+    g_uring.cq_mask = (uint32_t *)(cq + params.cq_off.ring_mask);
+    g_uring.cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    g_uring.sq_unsubmitted = 0;
+    g_uring.sq_data_pending = 0;
+
+    // 注册提供缓冲环（接收缓冲区来自缓冲池）
+    g_uring.buf_ring_len = UR_RECV_BUFS * sizeof(struct io_uring_buf);
+    g_uring.buf_ring = mmap(NULL, g_uring.buf_ring_len, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (g_uring.buf_ring == MAP_FAILED)
+    {
+        g_uring.buf_ring = NULL;
+        perror("io_uring buffer ring allocation failed");
+        uring_destroy();
+        return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)g_uring.buf_ring;
+    reg.ring_entries = UR_RECV_BUFS;
+    reg.bgid = UR_BUF_GROUP;
+    if (uring_register(IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        perror("io_uring register buffer ring failed");
+        uring_destroy();
+        return false;
+    }
+
+    g_uring.buf_ring_tail = 0;
+    g_uring.buf_ring->tail = 0;
+    for (uint16_t bid = 0; bid < UR_RECV_BUFS; bid++)
+    {
+        uring_provide_buffer(bid, packet_alloc());
+    }
+
+    // 整个缓冲池注册为一个固定缓冲区，发送时按偏移引用（失败时退化为普通SEND_ZC）
+    struct iovec pool_iov;
+    packet_pool_region(&pool_iov.iov_base, &pool_iov.iov_len);
+    g_uring.fixed_buffers = uring_register(IORING_REGISTER_BUFFERS, &pool_iov, 1) >= 0;
+    if (!g_uring.fixed_buffers)
+    {
+        perror("io_uring register buffers failed, sending without fixed buffers");
+    }
+
+    g_uring.rx_ready_head = 0;
+    g_uring.rx_ready_count = 0;
+    pthread_mutex_init(&g_uring.tx_mutex, NULL);
+    pthread_mutex_init(&g_uring.sq_mutex, NULL);
+    pthread_mutex_init(&g_uring.cq_mutex, NULL);
+
+    pthread_mutex_lock(&g_uring.sq_mutex);
+    uring_arm_recv_locked();
+    uring_submit_locked();
+    pthread_mutex_unlock(&g_uring.sq_mutex);
+    return true;
+}
+
+// 将一批报文排入提交队列（按令牌桶限速），不立即提交
+static void uring_queue_sends(PacketBuf **pkts, int count)
+{
+    int offset = 0;
+    while (offset < count)
+    {
+        int burst = pacer_admit(&g_transport.pacer, pkts + offset, count - offset);
+
+        pthread_mutex_lock(&g_uring.sq_mutex);
+        for (int i = 0; i < burst; i++)
+        {
+            PacketBuf *pkt = pkts[offset + i];
+            struct io_uring_sqe *sqe = uring_get_sqe();
+            if (!sqe)
+            {
+                packet_release(pkt);
+                continue;
+            }
+
+            // SEND_ZC只接受连续缓冲区（固定缓冲区模式下还须位于缓冲池内），外部数据段先拷入报文
+            packet_linearize(pkt);
+            sqe->opcode = IORING_OP_SEND_ZC;
+            sqe->fd = g_transport.sock;
+            sqe->addr = (uint64_t)(uintptr_t)pkt->data;
+            sqe->len = pkt->len;
+            sqe->addr2 = (uint64_t)(uintptr_t)&g_transport.dest_addr;
+            sqe->addr_len = sizeof(g_transport.dest_addr);
+            if (g_uring.fixed_buffers)
+            {
+                sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+                sqe->buf_index = 0;
+            }
+            sqe->user_data = (uint64_t)(uintptr_t)pkt;
+            g_uring.sq_data_pending++;
+        }
+
+        // 一个突发作为一批提交
+        uring_submit_locked();
+        pthread_mutex_unlock(&g_uring.sq_mutex);
+        offset += burst;
+    }
+
+    // 发送线程顺便回收完成事件，避免缓冲池被已发送报文占满
+    if (pthread_mutex_trylock(&g_uring.cq_mutex) == 0)
+    {
+        uring_reap_locked();
+        pthread_mutex_unlock(&g_uring.cq_mutex);
+    }
+}
+
+// 提交已积攒的一批报文（调用方持有tx_mutex）
+static void uring_flush_locked()
+{
+    int count = g_transport.tx_pending_count;
+    g_transport.tx_pending_count = 0;
+    if (count > 0)
+    {
+        uring_queue_sends(g_transport.tx_pending, count);
+    }
+}
+
+static void uring_flush()
+{
+    pthread_mutex_lock(&g_uring.tx_mutex);
+    uring_flush_locked();
+    pthread_mutex_unlock(&g_uring.tx_mutex);
+}
+
+// 数据报文攒满一批再提交；控制报文(flush=true)连同已积攒的报文立即提交
+static void uring_send_packet(PacketBuf *pkt, bool flush)
+{
+    pthread_mutex_lock(&g_uring.tx_mutex);
+    g_transport.tx_pending[g_transport.tx_pending_count++] = pkt;
+    if (flush || g_transport.tx_pending_count == TRANSPORT_BATCH_SIZE)
+    {
+        uring_flush_locked();
+    }
+    pthread_mutex_unlock(&g_uring.tx_mutex);
+}
+
+// 阻塞直到有接收报文
+static PacketBuf *uring_recv_packet()
+{
+    pthread_mutex_lock(&g_uring.cq_mutex);
+    while (g_uring.rx_ready_count == 0 && g_transport.running)
+    {
+        if (uring_reap_locked() == 0)
+        {
+            // 等待至少一个完成事件（接收或发送完成）
+            uring_enter(0, 1, IORING_ENTER_GETEVENTS);
+        }
+    }
+
+    PacketBuf *pkt = NULL;
+    if (g_uring.rx_ready_count > 0)
+    {
+        pkt = g_uring.rx_ready[g_uring.rx_ready_head];
+        g_uring.rx_ready_head = (g_uring.rx_ready_head + 1) % UR_RECV_BUFS;
+        g_uring.rx_ready_count--;
+    }
+    pthread_mutex_unlock(&g_uring.cq_mutex);
+    return pkt;
+}
+
+static void uring_close()
+{
+    uring_flush();
+    g_transport.running = false;
+
+    // 提交一个NOP唤醒可能阻塞在io_uring_enter中的接收方
+    pthread_mutex_lock(&g_uring.sq_mutex);
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    if (sqe)
+    {
+        sqe->opcode = IORING_OP_NOP;
+        sqe->user_data = UR_USER_DATA_WAKE;
+    }
+    uring_submit_locked();
+    pthread_mutex_unlock(&g_uring.sq_mutex);
+
+    pthread_mutex_lock(&g_uring.cq_mutex);
+    uring_destroy();
+    pthread_mutex_unlock(&g_uring.cq_mutex);
+
+    close(g_transport.sock);
+    packet_pool_destroy();
+}
+
+static const TransportOps g_uring_ops = {
+    .name = "io_uring",
+    .send_packet = uring_send_packet,
+    .recv_packet = uring_recv_packet,
+    .flush = uring_flush,
+    .close = uring_close,
+};
+
+// ========== 模拟网络后端 ==========
+// 在本节点的入口链路上施加丢包/带宽/时延/抖动/乱序：
+//   - net=udp：收发仍走组播socket（Tx/Rx线程），Rx线程收到的报文先进入模拟链路
+//   - net=local：不使用socket，发送的报文直接进入本节点的模拟链路（组播回环语义）
+// 报文按交付时间放入最小堆，由调度线程到期后放入接收队列。随机数只由seed/node_id和
+// 报文到达顺序决定，相同配置的两次运行得到相同的丢包序列
+
+typedef struct
+{
+    PacketBuf *pkt;
+    uint64_t deliver_ns; // 交付时间（CLOCK_MONOTONIC）
+    uint64_t arrive_ns;  // 进入链路的时间
+    uint64_t seq;        // 到达序号，交付时间相同时保持先后顺序
+} SimPending;
+
+// 一个节点的丢包模型状态
+typedef struct
+{
+    uint64_t rng;   // xorshift64*状态
+    bool burst_bad; // Gilbert-Elliott当前是否处于Bad状态
+} SimLossState;
+
+static struct
+{
+    SimNetConfig cfg;
+    SimLossState loss;    // 单节点时的丢包状态（同时提供抖动/乱序的随机数）
+    SimLossState *nodes;  // 多节点时每个节点独立的丢包状态（cfg.node_count > 1）
+    uint64_t link_free_ns; // 链路空闲时刻（带宽排队）
+    uint64_t seq;
+
+    SimPending heap[SIM_MAX_PENDING]; // 按(deliver_ns, seq)排序的最小堆
+    int heap_count;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; // CLOCK_MONOTONIC
+} g_sim;
+
+static uint64_t sim_splitmix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static void sim_loss_init(SimLossState *state, uint64_t seed, uint32_t node_id)
+{
+    state->rng = sim_splitmix64(seed ^ sim_splitmix64(node_id));
+    if (state->rng == 0)
+    {
+        state->rng = 1; // xorshift状态不能为0
+    }
+    state->burst_bad = false;
+}
+
+// 返回[0, 1)的均匀随机数
+static double sim_random(SimLossState *state)
+{
+    state->rng ^= state->rng >> 12;
+    state->rng ^= state->rng << 25;
+    state->rng ^= state->rng >> 27;
+    return ((state->rng * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static bool sim_heap_less(const SimPending *a, const SimPending *b)
+{
+    return a->deliver_ns < b->deliver_ns || (a->deliver_ns == b->deliver_ns && a->seq < b->seq);
+}
+
+static void sim_heap_push(const SimPending *item)
+{
+    int i = g_sim.heap_count++;
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (!sim_heap_less(item, &g_sim.heap[parent]))
+        {
+            break;
+        }
+        g_sim.heap[i] = g_sim.heap[parent];
+        i = parent;
+    }
+    g_sim.heap[i] = *item;
+}
+
+static SimPending sim_heap_pop()
+{
+    SimPending top = g_sim.heap[0];
+    SimPending last = g_sim.heap[--g_sim.heap_count];
+    int i = 0;
+    while (1)
+    {
+        int child = 2 * i + 1;
+        if (child >= g_sim.heap_count)
+        {
+            break;
+        }
+        if (child + 1 < g_sim.heap_count && sim_heap_less(&g_sim.heap[child + 1], &g_sim.heap[child]))
+        {
+            child++;
+        }
+        if (!sim_heap_less(&g_sim.heap[child], &last))
+        {
+            break;
+        }
+        g_sim.heap[i] = g_sim.heap[child];
+        i = child;
+    }
+    g_sim.heap[i] = last;
+    return top;
+}
+
+// 丢包决策：Gilbert-Elliott先做状态转移，再按当前状态的丢包率抽样
+static bool sim_should_drop(SimLossState *state)
+{
+    const SimNetConfig *cfg = &g_sim.cfg;
+    if (cfg->burst_enter_pct > 0)
+    {
+        double r = sim_random(state) * 100.0;
+        if (!state->burst_bad && r < cfg->burst_enter_pct)
+        {
+            state->burst_bad = true;
+        }
+        else if (state->burst_bad && r < cfg->burst_exit_pct)
+        {
+            state->burst_bad = false;
+        }
+    }
+
+    double loss_pct = state->burst_bad ? cfg->burst_loss_pct : cfg->loss_pct;
+    return loss_pct > 0 && sim_random(state) * 100.0 < loss_pct;
+}
+
+// 报文进入模拟链路（RxDeliverFunc）
+static void sim_ingress(PacketBuf **pkts, int count)
+{
+    const SimNetConfig *cfg = &g_sim.cfg;
+    uint64_t now = get_monotonic_ns();
+    bool wake = false;
+
+    pthread_mutex_lock(&g_sim.mutex);
+    for (int i = 0; i < count; i++)
+    {
+        PacketBuf *pkt = pkts[i];
+        // 多节点时链路本身不丢包，由transport_sim_node_drop按节点判定
+        if (!g_sim.nodes && sim_should_drop(&g_sim.loss))
+        {
+            g_transport.stats.sim_lost++;
+            packet_release(pkt);
+            continue;
+        }
+        if (g_sim.heap_count == SIM_MAX_PENDING)
+        {
+            g_transport.stats.sim_overflow++;
+            packet_release(pkt);
+            continue;
+        }
+
+        // 带宽：报文在链路空闲后才开始发送，发送时长 = 长度 / 带宽
+        uint64_t depart_ns = now;
+        if (cfg->rate_bps > 0)
+        {
+            uint64_t start_ns = g_sim.link_free_ns > now ? g_sim.link_free_ns : now;
+            g_sim.link_free_ns = start_ns + pkt->len * 8ULL * 1000000000ULL / cfg->rate_bps;
+            depart_ns = g_sim.link_free_ns;
+        }
+
+        int64_t delay_ns = (int64_t)cfg->delay_us * 1000;
+        if (cfg->jitter_us > 0)
+        {
+            delay_ns += (int64_t)((sim_random(&g_sim.loss) * 2.0 - 1.0) * cfg->jitter_us * 1000.0);
+        }
+        if (cfg->reorder_pct > 0 && sim_random(&g_sim.loss) * 100.0 < cfg->reorder_pct)
+        {
+            delay_ns += (int64_t)cfg->reorder_us * 1000;
+            g_transport.stats.sim_reordered++;
+        }
+        if (delay_ns < 0)
+        {
+            delay_ns = 0;
+        }
+
+        SimPending item = {
+            .pkt = pkt,
+            .deliver_ns = depart_ns + delay_ns,
+            .arrive_ns = now,
+            .seq = g_sim.seq++,
+        };
+        if (g_sim.heap_count == 0 || sim_heap_less(&item, &g_sim.heap[0]))
+        {
+            wake = true; // 最早交付时间提前，需要唤醒调度线程重新计时
+        }
+        sim_heap_push(&item);
+    }
+    if (wake)
+    {
+        pthread_cond_signal(&g_sim.cond);
+    }
+    pthread_mutex_unlock(&g_sim.mutex);
+}
+
+// 调度线程：等待堆顶到期，把到期报文成批放入接收队列
+static void *sim_thread_func(void *arg)
+{
+    PacketBuf *batch[TRANSPORT_BATCH_SIZE];
+
+    pthread_mutex_lock(&g_sim.mutex);
+    while (g_transport.running)
+    {
+        if (g_sim.heap_count == 0)
+        {
+            pthread_cond_wait(&g_sim.cond, &g_sim.mutex);
+            continue;
+        }
+
+        uint64_t now = get_monotonic_ns();
+        if (g_sim.heap[0].deliver_ns > now)
+        {
+            struct timespec ts;
+            ts.tv_sec = g_sim.heap[0].deliver_ns / 1000000000ULL;
+            ts.tv_nsec = g_sim.heap[0].deliver_ns % 1000000000ULL;
+            pthread_cond_timedwait(&g_sim.cond, &g_sim.mutex, &ts);
+            continue;
+        }
+
+        int count = 0;
+        while (count < TRANSPORT_BATCH_SIZE && g_sim.heap_count > 0 && g_sim.heap[0].deliver_ns <= now)
+        {
+            SimPending item = sim_heap_pop();
+            g_transport.stats.sim_delay_ns += item.deliver_ns - item.arrive_ns;
+            batch[count++] = item.pkt;
+        }
+        g_transport.stats.sim_delivered += count;
+
+        // 放入接收队列可能阻塞，期间不持有锁
+        pthread_mutex_unlock(&g_sim.mutex);
+        queue_push_batch(&g_transport.rx_queue, batch, count);
+        pthread_mutex_lock(&g_sim.mutex);
+    }
+    pthread_mutex_unlock(&g_sim.mutex);
+    return NULL;
+}
+
+static bool sim_start(const SimNetConfig *cfg)
+{
+    g_sim.cfg = *cfg;
+    sim_loss_init(&g_sim.loss, cfg->seed, cfg->node_id);
+    g_sim.nodes = NULL;
+    if (cfg->node_count > 1)
+    {
+        g_sim.nodes = calloc(cfg->node_count, sizeof(SimLossState));
+        if (!g_sim.nodes)
+        {
+            perror("Failed to allocate simulated network nodes");
+            return false;
+        }
+        // 与各节点独立运行一个进程时的随机序列相同
+        for (uint32_t i = 0; i < cfg->node_count; i++)
+        {
+            sim_loss_init(&g_sim.nodes[i], cfg->seed, cfg->node_id + i);
+        }
+    }
+    g_sim.link_free_ns = 0;
+    g_sim.seq = 0;
+    g_sim.heap_count = 0;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&g_sim.mutex, NULL);
+    pthread_cond_init(&g_sim.cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&g_sim.thread, NULL, sim_thread_func, NULL) != 0)
+    {
+        perror("Failed to create simulated network thread");
+        pthread_cond_destroy(&g_sim.cond);
+        pthread_mutex_destroy(&g_sim.mutex);
+        free(g_sim.nodes);
+        g_sim.nodes = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void sim_stop()
+{
+    pthread_mutex_lock(&g_sim.mutex);
+    pthread_cond_signal(&g_sim.cond);
+    pthread_mutex_unlock(&g_sim.mutex);
+    pthread_join(g_sim.thread, NULL);
+
+    while (g_sim.heap_count > 0)
+    {
+        packet_release(sim_heap_pop().pkt);
+    }
+    pthread_cond_destroy(&g_sim.cond);
+    pthread_mutex_destroy(&g_sim.mutex);
+    free(g_sim.nodes);
+    g_sim.nodes = NULL;
+}
+
+// net=local：发送即进入本节点的模拟链路（先经过传输层令牌桶）
+static void sim_local_send_packet(PacketBuf *pkt, bool flush)
+{
+    packet_linearize(pkt); // 报文直接交给本节点接收处理
+    pacer_admit(&g_transport.pacer, &pkt, 1);
+    g_transport.stats.tx_packets++;
+    g_transport.stats.tx_bytes += pkt->len;
+    g_transport.stats.tx_batch_hist[1]++;
+    g_transport.stats.rx_packets++;
+    g_transport.stats.rx_batch_hist[1]++;
+    sim_ingress(&pkt, 1);
+}
+
+static bool sim_parse_percent(const char *value, double *out)
+{
+    char *end;
+    double v = strtod(value, &end);
+    if (end == value || *end != '\0' || v < 0 || v > 100)
+    {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+static bool sim_parse_ms(const char *value, uint32_t *out_us)
+{
+    char *end;
+    double v = strtod(value, &end);
+    if (end == value || *end != '\0' || v < 0 || v > 60000)
+    {
+        return false;
+    }
+    *out_us = (uint32_t)(v * 1000.0);
+    return true;
+}
+
+bool sim_parse_config(const char *spec, SimNetConfig *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->burst_loss_pct = 100.0;
+    cfg->seed = 1;
+    if (!spec)
+    {
+        return true;
+    }
+
+    char buf[256];
+    if (strlen(spec) >= sizeof(buf))
+    {
+        fprintf(stderr, "Simulated network spec too long\n");
+        return false;
+    }
+    strcpy(buf, spec);
+
+    char *saveptr = NULL;
+    for (char *item = strtok_r(buf, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr))
+    {
+        char *value = strchr(item, '=');
+        if (!value)
+        {
+            fprintf(stderr, "Invalid simulated network option: %s\n", item);
+            return false;
+        }
+        *value++ = '\0';
+
+        bool ok;
+        if (strcmp(item, "loss") == 0)
+            ok = sim_parse_percent(value, &cfg->loss_pct);
+        else if (strcmp(item, "burst_enter") == 0)
+            ok = sim_parse_percent(value, &cfg->burst_enter_pct);
+        else if (strcmp(item, "burst_exit") == 0)
+            ok = sim_parse_percent(value, &cfg->burst_exit_pct);
+        else if (strcmp(item, "burst_loss") == 0)
+            ok = sim_parse_percent(value, &cfg->burst_loss_pct);
+        else if (strcmp(item, "delay_ms") == 0)
+            ok = sim_parse_ms(value, &cfg->delay_us);
+        else if (strcmp(item, "jitter_ms") == 0)
+            ok = sim_parse_ms(value, &cfg->jitter_us);
+        else if (strcmp(item, "reorder") == 0)
+            ok = sim_parse_percent(value, &cfg->reorder_pct);
+        else if (strcmp(item, "reorder_ms") == 0)
+            ok = sim_parse_ms(value, &cfg->reorder_us);
+        else if (strcmp(item, "rate_kbps") == 0)
+        {
+            cfg->rate_bps = strtoull(value, NULL, 10) * 1000;
+            ok = true;
+        }
+        else if (strcmp(item, "seed") == 0)
+        {
+            cfg->seed = strtoull(value, NULL, 10);
+            ok = true;
+        }
+        else if (strcmp(item, "net") == 0)
+        {
+            ok = strcmp(value, "udp") == 0 || strcmp(value, "local") == 0;
+            cfg->local = strcmp(value, "local") == 0;
+        }
+        else
+        {
+            ok = false;
+        }
+
+        if (!ok)
+        {
+            fprintf(stderr, "Invalid simulated network option: %s=%s\n", item, value);
+            return false;
+        }
+    }
+
+    // 启用突发丢包但未给出恢复概率时，平均突发长度取4个报文
+    if (cfg->burst_enter_pct > 0 && cfg->burst_exit_pct == 0)
+    {
+        cfg->burst_exit_pct = 25.0;
+    }
+    // 未给出乱序延迟时，乱序报文额外延迟一个基础时延（至少1ms）
+    if (cfg->reorder_pct > 0 && cfg->reorder_us == 0)
+    {
+        cfg->reorder_us = cfg->delay_us > 1000 ? cfg->delay_us : 1000;
+    }
+    return true;
+}
+
+// ========== 传输层接口实现 ==========
+
+// 公共初始化：缓冲池、socket、统计与限速状态
+void transport_set_offload(bool enable)
+{
+    g_transport.offload_requested = enable;
+}
+
+void transport_reserve_packets(size_t count)
+{
+    g_transport.reserved_packets = count;
+}
+
+void transport_set_packet_size(size_t size)
+{
+    g_transport.packet_size = size < MAX_PACKET_SIZE ? size : MAX_PACKET_SIZE;
+}
+
+size_t transport_packet_footprint()
+{
+    return packet_buf_stride();
+}
+
+// 按请求打开UDP GSO/GRO，内核拒绝的选项保持关闭（逐报文收发）
+static void transport_setup_offload()
+{
+    g_transport.gso = false;
+    g_transport.gro = false;
+    g_transport.gro_bufs = NULL;
+    if (!g_transport.offload_requested)
+    {
+        return;
+    }
+
+    // UDP_SEGMENT设为0只检查内核支持，分段大小由每次发送的控制消息给出
+    int zero = 0;
+    if (setsockopt(g_transport.sock, SOL_UDP, UDP_SEGMENT, &zero, sizeof(zero)) == 0)
+    {
+        g_transport.gso = true;
+    }
+    else
+    {
+        perror("setsockopt UDP_SEGMENT failed, GSO disabled");
+    }
+
+    g_transport.gro_bufs = malloc((size_t)GRO_RX_BATCH * GRO_RX_BUF_SIZE);
+    int one = 1;
+    if (g_transport.gro_bufs && setsockopt(g_transport.sock, SOL_UDP, UDP_GRO, &one, sizeof(one)) == 0)
+    {
+        g_transport.gro = true;
+    }
+    else
+    {
+        perror("setsockopt UDP_GRO failed, GRO disabled");
+        free(g_transport.gro_bufs);
+        g_transport.gro_bufs = NULL;
+    }
+}
+
+// 关闭GRO（io_uring后端的提供缓冲区只容纳单个报文）
+static void transport_disable_offload()
+{
+    if (g_transport.gro)
+    {
+        int zero = 0;
+        setsockopt(g_transport.sock, SOL_UDP, UDP_GRO, &zero, sizeof(zero));
+    }
+    free(g_transport.gro_bufs);
+    g_transport.gro_bufs = NULL;
+    g_transport.gso = false;
+    g_transport.gro = false;
+}
+
+static bool transport_setup(bool is_sender, bool with_socket)
+{
+    if (!packet_pool_init(PACKET_POOL_SIZE + g_transport.reserved_packets))
+    {
+        return false;
+    }
+
+    g_transport.sock = -1;
+    if (with_socket)
+    {
+        g_transport.sock = create_multicast_socket(is_sender);
+        if (g_transport.sock < 0)
+        {
+            packet_pool_destroy();
+            return false;
+        }
+    }
+
+    memset(&g_transport.dest_addr, 0, sizeof(g_transport.dest_addr));
+    g_transport.dest_addr.sin_family = AF_INET;
+    g_transport.dest_addr.sin_addr.s_addr = inet_addr(MULTICAST_GROUP);
+    g_transport.dest_addr.sin_port = htons(MULTICAST_PORT);
+
+    if (with_socket)
+    {
+        transport_setup_offload();
+    }
+
+    memset(&g_transport.stats, 0, sizeof(g_transport.stats));
+    memset(&g_transport.pacer, 0, sizeof(g_transport.pacer));
+    pthread_mutex_init(&g_transport.pacer.mutex, NULL);
+    g_transport.tx_pending_count = 0;
+    return true;
+}
+
+// 释放transport_setup分配的资源
+static void transport_teardown()
+{
+    transport_disable_offload();
+    if (g_transport.sock >= 0)
+    {
+        close(g_transport.sock);
+        g_transport.sock = -1;
+    }
+    packet_pool_destroy();
+}
+
+// ---------- Tx/Rx线程后端 ----------
+
+static void threads_send_packet(PacketBuf *pkt, bool flush)
+{
+    queue_push(&g_transport.tx_queue, pkt);
+}
+
+static PacketBuf *threads_recv_packet()
+{
+    return queue_pop(&g_transport.rx_queue);
+}
+
+static void threads_flush()
+{
+    // Tx线程持续发送，无需显式提交
+}
+
+// 启动Tx/Rx线程（模拟网络的udp模式也使用）
+static bool threads_start()
+{
+    queue_init(&g_transport.tx_queue);
+    queue_init(&g_transport.rx_queue);
+    g_transport.running = true;
+
+    // 启动Tx线程
+    if (pthread_create(&g_transport.tx_thread, NULL, tx_thread_func, NULL) != 0)
+    {
+        perror("Failed to create Tx thread");
+        g_transport.running = false;
+        return false;
+    }
+
+    // 启动Rx线程
+    if (pthread_create(&g_transport.rx_thread, NULL, rx_thread_func, NULL) != 0)
+    {
+        perror("Failed to create Rx thread");
+        g_transport.running = false;
+        pthread_cancel(g_transport.tx_thread);
+        pthread_join(g_transport.tx_thread, NULL);
+        return false;
+    }
+
+    return true;
+}
+
+static void threads_stop()
+{
+    g_transport.running = false;
+    // 唤醒可能阻塞的线程
+    pthread_cancel(g_transport.tx_thread);
     pthread_cancel(g_transport.rx_thread);
 
     pthread_join(g_transport.tx_thread, NULL);
     pthread_join(g_transport.rx_thread, NULL);
+}
 
-    close(g_transport.sock);
+static void threads_close()
+{
+    threads_stop();
+    transport_teardown();
+}
+
+static const TransportOps g_threads_ops = {
+    .name = "socket threads",
+    .send_packet = threads_send_packet,
+    .recv_packet = threads_recv_packet,
+    .flush = threads_flush,
+    .close = threads_close,
+};
+
+// ---------- 事件循环后端 ----------
+
+static void evloop_flush_pending()
+{
+    if (g_transport.tx_pending_count == 0)
+    {
+        return;
+    }
+
+    int count = g_transport.tx_pending_count;
+    g_transport.tx_pending_count = 0;
+    transport_transmit(g_transport.tx_pending, count);
+}
+
+static void evloop_send_packet(PacketBuf *pkt, bool flush)
+{
+    // 攒满一批或事件循环进入等待前统一发送
+    g_transport.tx_pending[g_transport.tx_pending_count++] = pkt;
+    if (g_transport.tx_pending_count == TRANSPORT_BATCH_SIZE)
+    {
+        evloop_flush_pending();
+    }
+}
+
+static PacketBuf *evloop_recv_packet()
+{
+    return NULL; // 报文通过处理函数回调交付
+}
+
+static void evloop_transport_close()
+{
+    evloop_flush_pending();
+    g_transport.running = false;
+    evloop_close();
+    transport_teardown();
+}
+
+static const TransportOps g_evloop_ops = {
+    .name = "event loop (epoll/timerfd)",
+    .send_packet = evloop_send_packet,
+    .recv_packet = evloop_recv_packet,
+    .flush = evloop_flush_pending,
+    .close = evloop_transport_close,
+};
+
+// ---------- 模拟网络后端 ----------
+
+static SimNetConfig g_sim_config = {.burst_loss_pct = 100.0, .seed = 1};
+
+static void sim_close()
+{
+    if (g_sim.cfg.local)
+    {
+        g_transport.running = false;
+    }
+    else
+    {
+        threads_stop();
+    }
+    sim_stop();
+    transport_teardown();
+}
+
+static const TransportOps g_sim_udp_ops = {
+    .name = "simulated network (udp)",
+    .send_packet = threads_send_packet,
+    .recv_packet = threads_recv_packet,
+    .flush = threads_flush,
+    .close = sim_close,
+};
+
+static const TransportOps g_sim_local_ops = {
+    .name = "simulated network (local)",
+    .send_packet = sim_local_send_packet,
+    .recv_packet = threads_recv_packet,
+    .flush = threads_flush,
+    .close = sim_close,
+};
+
+void transport_set_sim(const SimNetConfig *cfg)
+{
+    g_sim_config = *cfg;
+}
+
+bool transport_sim_node_drop(uint32_t node_id)
+{
+    // 仅由接收线程（或事件循环）调用，各节点状态互不共享，无需加锁
+    if (!g_sim.nodes || node_id < g_sim.cfg.node_id || node_id - g_sim.cfg.node_id >= g_sim.cfg.node_count)
+    {
+        return false;
+    }
+    if (!sim_should_drop(&g_sim.nodes[node_id - g_sim.cfg.node_id]))
+    {
+        return false;
+    }
+    g_transport.stats.sim_lost++;
+    return true;
+}
+
+static bool transport_init_sim(bool is_sender)
+{
+    bool local = g_sim_config.local;
+    if (!transport_setup(is_sender, !local))
+    {
+        return false;
+    }
+
+    g_transport.ops = local ? &g_sim_local_ops : &g_sim_udp_ops;
+    g_transport.rx_deliver = sim_ingress;
+
+    // 模拟链路（互斥量、配置、随机序列、事件堆）须在Rx线程开始调用sim_ingress之前就绪；
+    // 模拟链路线程在running为false时立即退出，先置位
+    g_transport.running = true;
+    if (!sim_start(&g_sim_config))
+    {
+        g_transport.running = false;
+        transport_teardown();
+        return false;
+    }
+
+    if (local)
+    {
+        queue_init(&g_transport.rx_queue);
+    }
+    else if (!threads_start())
+    {
+        sim_stop();
+        transport_teardown();
+        return false;
+    }
+    return true;
+}
+
+// ---------- 初始化与分发 ----------
+
+bool transport_init(bool is_sender)
+{
+    if (!transport_setup(is_sender, true))
+    {
+        return false;
+    }
+
+    g_transport.ops = &g_threads_ops;
+    g_transport.rx_deliver = rx_deliver_queue;
+    if (!threads_start())
+    {
+        transport_teardown();
+        return false;
+    }
+
+    return true;
+}
+
+bool transport_init_backend(TransportBackend backend, bool is_sender)
+{
+    if (backend == TRANSPORT_BACKEND_SIM)
+    {
+        return transport_init_sim(is_sender);
+    }
+    if (backend != TRANSPORT_BACKEND_IO_URING)
+    {
+        return transport_init(is_sender);
+    }
+
+    if (!transport_setup(is_sender, true))
+    {
+        return false;
+    }
+
+    // 提供缓冲区只容纳单个报文，不使用GSO/GRO
+    transport_disable_offload();
+    if (!uring_create())
+    {
+        // 内核不支持时退回Tx/Rx线程实现
+        fprintf(stderr, "io_uring backend unavailable, falling back to socket threads\n");
+        transport_teardown();
+        return transport_init(is_sender);
+    }
+
+    g_transport.ops = &g_uring_ops;
+    g_transport.running = true;
+    return true;
+}
+
+bool transport_parse_backend(const char *name, TransportBackend *backend)
+{
+    if (strcmp(name, "socket") == 0)
+        *backend = TRANSPORT_BACKEND_THREADS;
+    else if (strcmp(name, "uring") == 0)
+        *backend = TRANSPORT_BACKEND_IO_URING;
+    else if (strcmp(name, "sim") == 0)
+        *backend = TRANSPORT_BACKEND_SIM;
+    else
+        return false;
+    return true;
+}
+
+const char *transport_backend_name()
+{
+    static char name[64];
+    if (!g_transport.ops)
+    {
+        return "none";
+    }
+    if (g_transport.gso || g_transport.gro)
+    {
+        snprintf(name, sizeof(name), "%s + GSO/GRO", g_transport.ops->name);
+        return name;
+    }
+    return g_transport.ops->name;
+}
+
+// 事件循环模式下socket可读：非阻塞recvmmsg取尽已到达的报文，逐个交给处理函数
+static void rx_deliver_handler(PacketBuf **pkts, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        g_transport.rx_handler(pkts[i], g_transport.rx_handler_arg);
+    }
+}
+
+static void transport_on_readable(void *arg)
+{
+    struct iovec iovecs[TRANSPORT_BATCH_SIZE];
+    struct mmsghdr msgs[TRANSPORT_BATCH_SIZE];
+    struct sockaddr_in src_addrs[TRANSPORT_BATCH_SIZE];
+
+    if (g_transport.gro)
+    {
+        // 读满一批说明可能还有数据，继续读到EAGAIN
+        int count = GRO_RX_BATCH;
+        while (g_transport.running && count == GRO_RX_BATCH)
+        {
+            count = rx_read_gro(MSG_DONTWAIT, rx_deliver_handler);
+        }
+        return;
+    }
+
+    while (g_transport.running)
+    {
+        rx_prepare_msgs(g_transport.rx_bufs, iovecs, msgs, src_addrs, TRANSPORT_BATCH_SIZE);
+
+        int count = recvmmsg(g_transport.sock, msgs, TRANSPORT_BATCH_SIZE, MSG_DONTWAIT, NULL);
+        if (count <= 0)
+        {
+            break; // EAGAIN：已取尽
+        }
+
+        g_transport.stats.rx_packets += count;
+        g_transport.stats.rx_batch_hist[count]++;
+
+        for (int i = 0; i < count; i++)
+        {
+            PacketBuf *pkt = g_transport.rx_bufs[i];
+            pkt->len = msgs[i].msg_len;
+            g_transport.rx_bufs[i] = packet_alloc();
+            g_transport.rx_handler(pkt, g_transport.rx_handler_arg);
+        }
+
+        if (count < TRANSPORT_BATCH_SIZE)
+        {
+            break;
+        }
+    }
+}
+
+bool transport_init_event_loop(bool is_sender, PacketHandler handler, void *arg)
+{
+    if (!evloop_init())
+    {
+        return false;
+    }
+
+    if (!transport_setup(is_sender, true))
+    {
+        return false;
+    }
+
+    g_transport.ops = &g_evloop_ops;
+    g_transport.rx_handler = handler;
+    g_transport.rx_handler_arg = arg;
+    g_transport.rx_deliver = rx_deliver_handler;
+    for (int i = 0; i < TRANSPORT_BATCH_SIZE; i++)
+    {
+        g_transport.rx_bufs[i] = packet_alloc();
+    }
+    g_transport.running = true;
+
+    if (!evloop_add_fd(g_transport.sock, transport_on_readable, NULL))
+    {
+        g_transport.running = false;
+        transport_teardown();
+        return false;
+    }
+
+    return true;
+}
+
+void transport_flush()
+{
+    if (g_transport.running)
+    {
+        g_transport.ops->flush();
+    }
+}
+
+void transport_send_packet(PacketBuf *pkt)
+{
+    if (!g_transport.running)
+    {
+        packet_release(pkt);
+        return;
+    }
+    g_transport.ops->send_packet(pkt, false);
+}
+
+PacketBuf *transport_recv_packet()
+{
+    if (!g_transport.running)
+        return NULL;
+    return g_transport.ops->recv_packet();
+}
+
+void transport_send(const void *data, size_t len)
+{
+    if (!g_transport.running || len > g_packet_pool.buf_size)
+        return;
+
+    PacketBuf *pkt = packet_alloc();
+    memcpy(pkt->data, data, len);
+    pkt->len = len;
+    // 控制报文不等待攒批，立即提交
+    g_transport.ops->send_packet(pkt, true);
+}
+
+size_t transport_recv(void *buffer, size_t max_len)
+{
+    PacketBuf *pkt = transport_recv_packet();
+    if (!pkt)
+        return 0;
+
+    size_t len = pkt->len;
+    if (len > max_len)
+    {
+        len = max_len; // 截断
+    }
+    memcpy(buffer, pkt->data, len);
+    packet_release(pkt);
+    return len;
+}
+
+void transport_close()
+{
+    if (g_transport.ops)
+    {
+        g_transport.ops->close();
+        g_transport.ops = NULL;
+    }
+}
+
+void transport_set_pacing(uint64_t rate_bps, uint32_t burst_bytes)
+{
+    TokenBucket *tb = &g_transport.pacer;
+
+    // 桶容量至少能容纳一个最大报文，否则永远无法发送
+    if (burst_bytes < packet_buf_size())
+    {
+        burst_bytes = packet_buf_size();
+    }
+
+    pthread_mutex_lock(&tb->mutex);
+    tb->rate_bps = rate_bps;
+    tb->burst_bytes = burst_bytes;
+    tb->tokens = burst_bytes;
+    tb->last_refill_ns = get_monotonic_ns();
+    g_transport.stats.pacing_rate_bps = rate_bps;
+    pthread_mutex_unlock(&tb->mutex);
+}
+
+void transport_get_stats(TransportStats *stats)
+{
+    memcpy(stats, &g_transport.stats, sizeof(*stats));
+}
+
+void transport_print_stats(const char *tag)
+{
+    TransportStats stats;
+    transport_get_stats(&stats);
+
+    printf("%s Transport stats: tx %llu packets, rx %llu packets\n", tag,
+           (unsigned long long)stats.tx_packets, (unsigned long long)stats.rx_packets);
+
+    // 打印批大小分布（只打印出现过的批大小）
+    uint64_t tx_calls = 0, rx_calls = 0;
+    for (int n = 1; n <= TRANSPORT_BATCH_SIZE; n++)
+    {
+        tx_calls += stats.tx_batch_hist[n];
+        rx_calls += stats.rx_batch_hist[n];
+    }
+    // io_uring后端：发送按提交批次统计，接收按一次回收完成队列得到的报文数统计
+    bool uring = g_transport.ops == &g_uring_ops;
+    printf("%s   %s: %llu (avg batch %.2f)\n", tag, uring ? "io_uring send submits" : "sendmmsg calls",
+           (unsigned long long)tx_calls, tx_calls ? (double)stats.tx_packets / tx_calls : 0.0);
+    printf("%s   %s: %llu (avg batch %.2f)\n", tag, uring ? "io_uring recv reaps" : "recvmmsg calls",
+           (unsigned long long)rx_calls,
+           rx_calls ? (double)stats.rx_packets / rx_calls : 0.0);
+    if (stats.tx_gso_sends > 0 || stats.rx_gro_reads > 0)
+    {
+        printf("%s   GSO: %llu sends carrying %llu segments, GRO: %llu reads split into %llu segments\n", tag,
+               (unsigned long long)stats.tx_gso_sends, (unsigned long long)stats.tx_gso_segments,
+               (unsigned long long)stats.rx_gro_reads, (unsigned long long)stats.rx_gro_segments);
+    }
+    if (stats.sim_delivered > 0 || stats.sim_lost > 0 || stats.sim_overflow > 0)
+    {
+        printf("%s   simulated network: delivered %llu (avg delay %.3f ms), lost %llu, overflow %llu, reordered %llu\n",
+               tag, (unsigned long long)stats.sim_delivered,
+               stats.sim_delivered ? stats.sim_delay_ns / 1e6 / stats.sim_delivered : 0.0,
+               (unsigned long long)stats.sim_lost, (unsigned long long)stats.sim_overflow,
+               (unsigned long long)stats.sim_reordered);
+    }
+    if (stats.pacing_rate_bps > 0)
+    {
+        double achieved_bps = stats.pacing_active_ns ? stats.tx_bytes * 8.0 * 1e9 / stats.pacing_active_ns : 0.0;
+        printf("%s   pacing: configured %.1f kbit/s, achieved %.1f kbit/s (%.1f%%) over %.3f s active, %llu waits\n",
+               tag, stats.pacing_rate_bps / 1000.0, achieved_bps / 1000.0,
+               100.0 * achieved_bps / stats.pacing_rate_bps, stats.pacing_active_ns / 1e9,
+               (unsigned long long)stats.pacing_waits);
+    }
+    printf("%s   batch size histogram (size: tx/rx):", tag);
+    for (int n = 1; n <= TRANSPORT_BATCH_SIZE; n++)
+    {
+        if (stats.tx_batch_hist[n] || stats.rx_batch_hist[n])
+        {
+            printf(" %d:%llu/%llu", n, (unsigned long long)stats.tx_batch_hist[n],
+                   (unsigned long long)stats.rx_batch_hist[n]);
+        }
+    }
+    printf("\n");
 }
@@ -1,37 +1,390 @@
 #include "broadcast_protocol.h"
 
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 static MasterSession g_session;
 static pthread_mutex_t g_session_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool g_event_loop = false; // 单线程事件循环模式（不启动NACK接收线程与Tx/Rx线程）
+static bool g_merkle = true;      // 下发窗口摘要Merkle树（仅v2）
+static bool g_mmap = false;       // 映射输入文件，数据块直接取自映射（分散/聚集发送）
+static bool g_pipeline = true;    // 读取/校验流水线（事件循环模式下不启用）
+static bool g_stream = false;     // 流式模式：从管道或仍在增长的文件读取，总大小未知
+static uint32_t g_stream_idle_ms = STREAM_IDLE_DEFAULT_MS; // 普通文件到达末尾后等待增长的时间
+static uint32_t g_inflight = 1;     // 同时在途（查询/重传中）的窗口数，1为逐窗口停等
+static uint32_t g_repair_ratio = 1; // 有重传排队时，每发送一个新窗口前最多处理的重传窗口数
+static uint32_t g_window_size = WINDOW_SIZE; // 窗口大小（块数），在SESSION_ANNOUNCE中宣告（--window）
+static uint32_t g_mtu = 0;            // 路径MTU（--mtu，0表示探测；探测失败或v1时仍为0）
+static bool g_mtu_probed = false;     // g_mtu来自探测而不是--mtu
+static uint32_t g_chunk_size = DEFAULT_CHUNK_SIZE; // 按路径MTU选定的块大小，在SESSION_ANNOUNCE中宣告
+static bool g_fec = false;          // 前向纠错：每个编码块附带修复符号，NACK改用修复符号应答
+static uint32_t g_fec_repairs = 0;  // 每个编码块广播后主动发送的修复符号数（--fec）
+
+// 各编码块（窗口内每WINDOW_SIZE块）的修复符号状态，按窗口号*window_words+组号索引（g_session_mutex保护）
+typedef struct
+{
+    uint8_t repair_needed; // 本轮NACK中单个UAV在该块缺失块数的最大值（发送这么多修复符号即可全部恢复）
+    uint16_t next_repair;  // 下一个未发送过的修复符号编号
+} FecBlockState;
+
+static FecBlockState *g_fec_blocks;
+
+static struct
+{
+    uint64_t proactive;     // 窗口广播后主动发送的修复符号数
+    uint64_t on_nack;       // 应答NACK发送的修复符号数
+    uint64_t chunks_saved;  // 与重传原始块相比少发的报文数
+} g_fec_stats;
+
+// ========== 重传缓存 ==========
+// 缓存最近发送的若干组数据块的已构造报文（持有引用，头部、CRC与数据均已编码），重传时再次提交同一报文，
+// 不再读盘、计算CRC。按块号每WINDOW_SIZE块一组（与协商的窗口大小无关，大窗口占多组），
+// 组按chunk_id / WINDOW_SIZE % windows占用槽位；只由主线程（发送与重传）访问，无需加锁
+typedef struct
+{
+    uint32_t window_id;
+    bool valid;
+    PacketBuf *pkts[WINDOW_SIZE];
+} RetransCacheWindow;
+
+static struct
+{
+    uint32_t windows; // 可缓存的组数（由内存预算折算，0表示不缓存）
+    RetransCacheWindow *slots;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions; // 被后续窗口替换的窗口数
+} g_retrans_cache;
+
+// ========== 等待（事件循环模式下等待期间继续处理NACK） ==========
+static void master_wait_ms(uint32_t ms)
+{
+    if (g_event_loop)
+    {
+        evloop_run_for(ms);
+    }
+    else
+    {
+        usleep(ms * 1000);
+    }
+}
+
+// ========== 查询应答的等待与自适应超时 ==========
+// NACK处理在窗口收齐全部已知UAV的应答时递增g_response_seq并唤醒发送循环，查询轮次随即结束；
+// 应答超时按测得的NACK往返时间（STATUS_REQ发出到NACK到达，含接收方退避）以SRTT/RTTVAR方式估计
+static pthread_cond_t g_response_cond; // 与g_session_mutex配合（CLOCK_MONOTONIC）
+static uint64_t g_response_seq;         // 有窗口收齐应答的次数（g_session_mutex保护）
+static bool g_waiting_responses;        // 事件循环模式：正在等待应答，收齐时结束本次等待
+
+static struct
+{
+    uint64_t samples;
+    uint64_t srtt_ns;
+    uint64_t rttvar_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+} g_nack_rtt;
+
+// 记录一个NACK往返时间样本（RFC 6298）；调用者持有g_session_mutex
+static void nack_rtt_sample(uint64_t rtt_ns)
+{
+    if (g_nack_rtt.samples == 0)
+    {
+        g_nack_rtt.srtt_ns = rtt_ns;
+        g_nack_rtt.rttvar_ns = rtt_ns / 2;
+        g_nack_rtt.min_ns = rtt_ns;
+        g_nack_rtt.max_ns = rtt_ns;
+    }
+    else
+    {
+        uint64_t delta = rtt_ns > g_nack_rtt.srtt_ns ? rtt_ns - g_nack_rtt.srtt_ns : g_nack_rtt.srtt_ns - rtt_ns;
+        g_nack_rtt.rttvar_ns = (3 * g_nack_rtt.rttvar_ns + delta) / 4;
+        g_nack_rtt.srtt_ns = (7 * g_nack_rtt.srtt_ns + rtt_ns) / 8;
+        if (rtt_ns < g_nack_rtt.min_ns)
+        {
+            g_nack_rtt.min_ns = rtt_ns;
+        }
+        if (rtt_ns > g_nack_rtt.max_ns)
+        {
+            g_nack_rtt.max_ns = rtt_ns;
+        }
+    }
+    g_nack_rtt.samples++;
+}
+
+// 当前的应答超时：没有样本时为STATUS_REQ_INTERVAL，否则为SRTT + 4*RTTVAR，限制在[NACK_RTO_MIN_MS, NACK_RTO_MAX_MS]
+static uint64_t nack_rto_ns()
+{
+    pthread_mutex_lock(&g_session_mutex);
+    uint64_t rto_ns = g_nack_rtt.samples ? g_nack_rtt.srtt_ns + 4 * g_nack_rtt.rttvar_ns
+                                         : STATUS_REQ_INTERVAL * 1000000ULL;
+    pthread_mutex_unlock(&g_session_mutex);
+
+    if (rto_ns < NACK_RTO_MIN_MS * 1000000ULL)
+    {
+        rto_ns = NACK_RTO_MIN_MS * 1000000ULL;
+    }
+    if (rto_ns > NACK_RTO_MAX_MS * 1000000ULL)
+    {
+        rto_ns = NACK_RTO_MAX_MS * 1000000ULL;
+    }
+    return rto_ns;
+}
+
+static uint32_t window_chunk_count(uint32_t window_id)
+{
+    uint32_t start_chunk = window_id * g_session.window_size;
+    return g_session.total_chunks - start_chunk < g_session.window_size ? g_session.total_chunks - start_chunk
+                                                                        : g_session.window_size;
+}
+
+// 窗口需要重传的块（window_words个字）；调用者持有g_session_mutex
+static uint64_t *window_retransmit_bitmap(uint32_t window_id)
+{
+    return g_session.retransmit_bitmaps + (size_t)window_id * g_session.window_words;
+}
+
+// 本轮是否有UAV报告缺块；调用者持有g_session_mutex
+static bool window_needs_retransmit(uint32_t window_id)
+{
+    uint32_t count = window_chunk_count(window_id);
+    return bitmap_next_set(window_retransmit_bitmap(window_id), 0, count) < count;
+}
+
+// 开始新一轮查询：清零上一轮的重传标记与响应位图，准备接收新的应答；调用者持有g_session_mutex
+static void window_begin_round(uint32_t window_id)
+{
+    memset(window_retransmit_bitmap(window_id), 0, g_session.window_words * sizeof(uint64_t));
+    if (g_fec_blocks)
+    {
+        for (uint32_t b = 0; b < g_session.window_words; b++)
+        {
+            g_fec_blocks[(size_t)window_id * g_session.window_words + b].repair_needed = 0;
+        }
+    }
+    MasterWindowState *window = &g_session.windows[window_id];
+    memset(window->responded_uav_bitmap, 0, sizeof(window->responded_uav_bitmap));
+}
+
+// 全部已知UAV是否都已应答本窗口最近一次查询（还没有已知UAV时视为是）；调用者持有g_session_mutex
+static bool window_all_responded(uint32_t window_id)
+{
+    return bitmap_is_subset(g_session.known_uavs_bitmap, g_session.windows[window_id].responded_uav_bitmap,
+                            UAV_BITMAP_WORDS);
+}
+
+// 窗口是否已收齐全部已知UAV的应答（还没有已知UAV时只能等超时）；调用者持有g_session_mutex
+static bool window_responses_complete(uint32_t window_id)
+{
+    return bitmap_popcount(g_session.known_uavs_bitmap, UAV_BITMAP_WORDS) > 0 && window_all_responded(window_id);
+}
+
+// 等待到deadline_ns，或g_response_seq不再等于seq（调用者检查条件时读取）为止
+static void master_wait_responses(uint64_t deadline_ns, uint64_t seq)
+{
+    uint64_t now_ns = get_monotonic_ns();
+    if (deadline_ns <= now_ns)
+    {
+        return;
+    }
+
+    if (g_event_loop)
+    {
+        // 单线程：g_response_seq只在本次等待中由NACK处理修改，收齐时由其结束事件循环
+        g_waiting_responses = true;
+        evloop_run_for((uint32_t)((deadline_ns - now_ns + 999999) / 1000000));
+        g_waiting_responses = false;
+        return;
+    }
+
+    struct timespec ts = {.tv_sec = deadline_ns / 1000000000ULL, .tv_nsec = deadline_ns % 1000000000ULL};
+    pthread_mutex_lock(&g_session_mutex);
+    while (g_response_seq == seq)
+    {
+        if (pthread_cond_timedwait(&g_response_cond, &g_session_mutex, &ts) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_session_mutex);
+}
+
+// 等待本次查询的应答：全部已知UAV应答后立即返回，最长等待一个应答超时
+static void wait_window_responses(uint32_t window_id)
+{
+    uint64_t deadline_ns = get_monotonic_ns() + nack_rto_ns();
+    while (get_monotonic_ns() < deadline_ns)
+    {
+        pthread_mutex_lock(&g_session_mutex);
+        bool complete = window_responses_complete(window_id);
+        uint64_t seq = g_response_seq;
+        pthread_mutex_unlock(&g_session_mutex);
+        if (complete)
+        {
+            break;
+        }
+        master_wait_responses(deadline_ns, seq);
+    }
+}
+
+// ========== 读取数据块 ==========
+// 映射模式下直接返回映射中的地址，否则读入buffer；*len为实际数据长度
+// （使用pread不共享文件偏移，流水线读取线程与重传可以并发读取）
+static const uint8_t *read_chunk_data(uint32_t chunk_id, uint8_t *buffer, size_t *len)
+{
+    size_t offset = (size_t)chunk_id * g_session.chunk_size;
+    if (g_session.streaming)
+    {
+        // 流式会话只能取回内存中保留的最近几个窗口
+        uint32_t buffered = STREAM_BUFFER_WINDOWS * g_session.window_size;
+        if (chunk_id >= g_session.total_chunks || g_session.total_chunks - chunk_id > buffered)
+        {
+            fprintf(stderr, "[Master] Chunk %u is no longer in the stream buffer\n", chunk_id);
+            *len = 0;
+            return buffer;
+        }
+        *len = g_session.stream_lens[chunk_id % buffered];
+        return g_session.stream_buf + (size_t)(chunk_id % buffered) * g_session.chunk_size;
+    }
+    if (g_session.input_map)
+    {
+        *len = g_session.input_size - offset < g_session.chunk_size ? g_session.input_size - offset
+                                                                    : g_session.chunk_size;
+        return g_session.input_map + offset;
+    }
+
+    ssize_t n = pread(fileno(g_session.input_file), buffer, g_session.chunk_size, (off_t)offset);
+    *len = n > 0 ? (size_t)n : 0;
+    return buffer;
+}
+
+// 只读映射整个输入文件；失败时回退到fread
+static void map_input_file()
+{
+    if (g_session.input_size == 0)
+    {
+        return; // 不能映射空文件
+    }
+
+    void *map = mmap(NULL, g_session.input_size, PROT_READ, MAP_PRIVATE, fileno(g_session.input_file), 0);
+    if (map == MAP_FAILED)
+    {
+        perror("mmap input file, falling back to fread");
+        return;
+    }
+    // 首轮广播按顺序读取，提前预读；重传只访问刚发送过的窗口，仍在页缓存中
+    madvise(map, g_session.input_size, MADV_SEQUENTIAL);
+    madvise(map, g_session.input_size, MADV_WILLNEED);
+    g_session.input_map = map;
+}
+
+// ========== 构建窗口摘要Merkle树 ==========
+// 根要在SESSION_ANNOUNCE中下发，因此在广播前顺序读一遍文件计算各窗口摘要
+static bool build_merkle_tree()
+{
+    uint64_t *digests = calloc(g_session.total_windows ? g_session.total_windows : 1, sizeof(uint64_t));
+    if (!digests)
+    {
+        perror("Failed to allocate window digests");
+        return false;
+    }
+
+    uint64_t *chunk_hashes = malloc(g_session.window_size * sizeof(uint64_t));
+    if (!chunk_hashes)
+    {
+        perror("Failed to allocate chunk hashes");
+        free(digests);
+        return false;
+    }
+
+    uint8_t buffer[MAX_CHUNK_SIZE];
+    for (uint32_t window_id = 0; window_id < g_session.total_windows; window_id++)
+    {
+        uint32_t start_chunk = window_id * g_session.window_size;
+        uint32_t count = g_session.total_chunks - start_chunk < g_session.window_size
+                             ? g_session.total_chunks - start_chunk
+                             : g_session.window_size;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            size_t bytes_read;
+            const uint8_t *data = read_chunk_data(start_chunk + i, buffer, &bytes_read);
+            chunk_hashes[i] = hash64(data, bytes_read);
+        }
+        digests[window_id] = merkle_window_digest(chunk_hashes, count);
+    }
+
+    bool ok = merkle_build(&g_session.merkle, digests, g_session.total_windows);
+    free(chunk_hashes);
+    free(digests);
+    return ok;
+}
 
 // ========== 初始化Master会话 ==========
-bool init_master_session(const char *filename, uint16_t file_id)
+bool init_master_session(const char *filename, uint16_t file_id, uint8_t wire_version, ChecksumType checksum_type,
+                         FileHashType file_hash_type)
 {
     memset(&g_session, 0, sizeof(g_session));
 
-    // 打开输入文件
-    g_session.input_file = fopen(filename, "rb");
+    // 打开输入文件（流式模式下"-"表示标准输入）
+    g_session.streaming = g_stream;
+    bool from_stdin = g_stream && strcmp(filename, "-") == 0;
+    g_session.input_file = from_stdin ? stdin : fopen(filename, "rb");
     if (!g_session.input_file)
     {
         perror("Failed to open input file");
         return false;
     }
 
-    // 获取文件大小
-    fseek(g_session.input_file, 0, SEEK_END);
-    long file_size = ftell(g_session.input_file);
-    fseek(g_session.input_file, 0, SEEK_SET);
+    // 获取文件大小（流式会话大小未知，数据到达时逐块计数）
+    long file_size = 0;
+    if (!g_session.streaming)
+    {
+        fseek(g_session.input_file, 0, SEEK_END);
+        file_size = ftell(g_session.input_file);
+        fseek(g_session.input_file, 0, SEEK_SET);
+    }
 
     // 初始化会话参数
+    g_session.input_size = file_size;
+    if (g_mmap && !g_session.streaming)
+    {
+        map_input_file();
+    }
     g_session.file_id = file_id;
-    g_session.chunk_size = MAX_CHUNK_SIZE;
-    g_session.window_size = WINDOW_SIZE;
-    g_session.total_chunks = (file_size + MAX_CHUNK_SIZE - 1) / MAX_CHUNK_SIZE;
-    g_session.total_windows = (g_session.total_chunks + WINDOW_SIZE - 1) / WINDOW_SIZE;
-    strncpy(g_session.filename, filename, sizeof(g_session.filename) - 1);
-
-    // 分配窗口状态数组
-    g_session.windows = calloc(g_session.total_windows, sizeof(MasterWindowState));
-    if (!g_session.windows)
+    g_session.wire_version = wire_version;
+    g_session.checksum_type = checksum_type;
+    file_hasher_init(&g_session.file_hash, file_hash_type);
+    g_session.hashed_chunks = 0;
+    g_session.chunk_size = g_chunk_size;
+    g_session.window_size = g_window_size;
+    g_session.window_words = (g_window_size + 63) / 64;
+    g_session.total_chunks = (file_size + g_chunk_size - 1) / g_chunk_size;
+    g_session.total_windows = (g_session.total_chunks + g_window_size - 1) / g_window_size;
+    strncpy(g_session.filename, from_stdin ? "stdin" : filename, sizeof(g_session.filename) - 1);
+
+    // 分配窗口状态数组（流式会话先分配少量，随数据到达扩容）
+    g_session.window_capacity = g_session.streaming ? 16 : g_session.total_windows;
+    g_session.windows = calloc(g_session.window_capacity, sizeof(MasterWindowState));
+    g_session.retransmit_bitmaps = calloc((size_t)g_session.window_capacity * g_session.window_words, sizeof(uint64_t));
+    if (g_fec)
+    {
+        g_fec_blocks = calloc((size_t)g_session.window_capacity * g_session.window_words, sizeof(FecBlockState));
+    }
+    if (g_session.streaming)
+    {
+        size_t buffered = (size_t)STREAM_BUFFER_WINDOWS * g_session.window_size;
+        g_session.stream_buf = malloc(buffered * g_session.chunk_size);
+        g_session.stream_lens = calloc(buffered, sizeof(uint16_t));
+        if (!g_session.stream_buf || !g_session.stream_lens)
+        {
+            perror("Failed to allocate stream buffer");
+            return false;
+        }
+    }
+    if (!g_session.windows || !g_session.retransmit_bitmaps || (g_fec && !g_fec_blocks))
     {
         perror("Failed to allocate window states");
         fclose(g_session.input_file);
@@ -42,17 +395,67 @@ bool init_master_session(const char *filename, uint16_t file_id)
     for (uint32_t i = 0; i < g_session.total_windows; i++)
     {
         g_session.windows[i].window_id = i;
-        g_session.windows[i].need_retransmit = 0;
         g_session.windows[i].round_count = 0;
         g_session.windows[i].completed = false;
     }
 
+    // Merkle根要在广播前算出，流式会话不支持
+    g_session.merkle_enabled = g_merkle && wire_version != WIRE_VERSION_V1 && !g_session.streaming;
+    if (g_session.merkle_enabled && !build_merkle_tree())
+    {
+        return false;
+    }
+
     printf("[Master] Session initialized:\n");
     printf("  File: %s\n", filename);
-    printf("  Size: %ld bytes\n", file_size);
-    printf("  Total chunks: %u\n", g_session.total_chunks);
-    printf("  Total windows: %u\n", g_session.total_windows);
-    printf("  Window size: %u chunks\n", g_session.window_size);
+    if (g_session.streaming)
+    {
+        printf("  Size: unknown (streaming, %u windows kept for retransmission)\n", STREAM_BUFFER_WINDOWS);
+    }
+    else
+    {
+        printf("  Size: %ld bytes\n", file_size);
+        printf("  Total chunks: %u\n", g_session.total_chunks);
+        printf("  Total windows: %u\n", g_session.total_windows);
+    }
+    printf("  Window size: %u chunks (%u-word bitmaps, popcount %s)\n", g_session.window_size,
+           g_session.window_words, bitmap_impl_name());
+    if (g_session.wire_version == WIRE_VERSION_V1)
+    {
+        printf("  Chunk size: %u bytes (fixed by wire format v1)\n", g_session.chunk_size);
+    }
+    else if (g_mtu)
+    {
+        printf("  Chunk size: %u bytes (path MTU %u, %s)\n", g_session.chunk_size, g_mtu,
+               g_mtu_probed ? "probed" : "--mtu");
+    }
+    else
+    {
+        printf("  Chunk size: %u bytes (path MTU unknown)\n", g_session.chunk_size);
+    }
+    if (g_fec)
+    {
+        printf("  FEC: %u repair symbols per %d-chunk block, NACKs answered with repair symbols (GF(256) %s)\n",
+               g_fec_repairs, WINDOW_SIZE, gf256_impl_name());
+    }
+    printf("  Wire format: v%u\n", g_session.wire_version);
+    if (g_session.input_map)
+    {
+        printf("  Input: mmap%s\n", g_session.wire_version == WIRE_VERSION_V1 ? "" : ", scatter-gather sends");
+    }
+    else
+    {
+        printf("  Input: fread\n");
+    }
+    printf("  Checksum: %s%s\n", checksum_name(g_session.checksum_type),
+           g_session.checksum_type == CHECKSUM_CRC32C ? (crc32c_hw_available() ? " (hardware)" : " (software)") : "");
+    printf("  File hash: %s (%s)\n", file_hash_name(g_session.file_hash.type),
+           g_session.file_hash.type == FILE_HASH_HASH64 ? hash64_impl_name() : "byte-wise");
+    if (g_session.merkle_enabled)
+    {
+        printf("  Merkle root: 0x%016llX (%u window digests)\n", (unsigned long long)merkle_root(&g_session.merkle),
+               g_session.total_windows);
+    }
 
     return true;
 }
@@ -64,384 +467,1695 @@ void send_session_announce()
     memset(&msg, 0, sizeof(msg));
 
     msg.header.msg_type = MSG_SESSION_ANNOUNCE;
-    msg.header.payload_len = sizeof(SessionAnnounce) - sizeof(MessageHeader);
     msg.file_id = g_session.file_id;
     msg.total_chunks = g_session.total_chunks;
     msg.window_size = g_session.window_size;
     msg.chunk_size = g_session.chunk_size;
     strncpy(msg.filename, g_session.filename, sizeof(msg.filename) - 1);
+    if (g_session.streaming)
+    {
+        msg.header.ver_flags |= WIRE_FLAG_STREAM; // total_chunks为0，由END确定
+    }
+    if (g_session.checksum_type == CHECKSUM_CRC32C)
+    {
+        msg.header.ver_flags |= WIRE_FLAG_CRC32C;
+    }
+    if (g_session.file_hash.type == FILE_HASH_HASH64)
+    {
+        msg.header.ver_flags |= WIRE_FLAG_HASH64;
+    }
+    if (g_session.merkle_enabled)
+    {
+        msg.header.ver_flags |= WIRE_FLAG_MERKLE;
+        msg.merkle_root = merkle_root(&g_session.merkle);
+    }
 
-    printf("[Master] Sending SESSION_ANNOUNCE...\n");
+    // 接收方根据会话启动消息的格式版本协商后续报文格式
+    size_t msg_len = wire_encode(&msg, g_session.wire_version);
+
+    printf("[Master] Sending SESSION_ANNOUNCE (wire format v%u)...\n", g_session.wire_version);
     for (int i = 0; i < ANNOUNCE_REPEAT_COUNT; i++)
     {
-        transport_send(&msg, sizeof(msg));
-        usleep(10000);
+        transport_send(&msg, msg_len);
+        master_wait_ms(10);
     }
 }
 
-// ========== 阶段2: 广播单个窗口的数据块 ==========
-void broadcast_window_chunks(uint32_t window_id)
+// ========== 构造数据块报文 ==========
+// 分两步：读取数据（流水线的读取阶段）与计算校验并编码（校验阶段）
+
+// 分配报文并读入数据块（不计算校验）
+static PacketBuf *read_chunk_packet(uint32_t chunk_id)
 {
-    DataChunk chunk_msg;
-    memset(&chunk_msg, 0, sizeof(chunk_msg));
-    chunk_msg.header.msg_type = MSG_DATA_CHUNK;
-    chunk_msg.file_id = g_session.file_id;
-    chunk_msg.header.payload_len = sizeof(DataChunk) - sizeof(MessageHeader);
+    PacketBuf *pkt = packet_alloc();
+    DataChunk *chunk_msg = (DataChunk *)pkt->data;
+
+    memset(chunk_msg, 0, offsetof(DataChunk, data));
+    chunk_msg->header.msg_type = MSG_DATA_CHUNK;
+    chunk_msg->file_id = g_session.file_id;
+
+    // 定位并读取数据（直接读入报文缓冲区；映射模式下取自映射）
+    size_t bytes_read;
+    const uint8_t *data = read_chunk_data(chunk_id, chunk_msg->data, &bytes_read);
+
+    // v2映射模式：数据段直接引用映射，由sendmmsg分散/聚集发送，不拷贝；
+    // v1定长格式要补零到整块（映射在文件末尾之后不可读），仍拷入报文
+    // （流式缓冲区会被后续窗口覆盖，缓存中的报文不能引用它，同样拷入报文）
+    bool scatter = g_session.input_map && data != chunk_msg->data && g_session.wire_version != WIRE_VERSION_V1;
+    if (!scatter)
+    {
+        if (data != chunk_msg->data)
+        {
+            memcpy(chunk_msg->data, data, bytes_read);
+        }
+        if (bytes_read < g_session.chunk_size)
+        {
+            memset(chunk_msg->data + bytes_read, 0, g_session.chunk_size - bytes_read);
+        }
+    }
 
-    uint32_t start_chunk = window_id * WINDOW_SIZE;
-    uint32_t end_chunk = start_chunk + WINDOW_SIZE;
-    if (end_chunk > g_session.total_chunks)
+    chunk_msg->chunk_id = chunk_id;
+    chunk_msg->data_len = bytes_read;
+    if (scatter)
+    {
+        pkt->ext_data = data;
+        pkt->ext_offset = offsetof(DataChunk, data);
+        pkt->ext_len = bytes_read;
+    }
+    return pkt;
+}
+
+// 计算校验并原地编码；first_send时按顺序计入文件hash（首次发送总是按块顺序进行）
+static void finish_chunk_packet(PacketBuf *pkt, bool first_send)
+{
+    DataChunk *chunk_msg = (DataChunk *)pkt->data;
+    const uint8_t *data = pkt->ext_len ? pkt->ext_data : chunk_msg->data;
+
+    // 首次按顺序读到的块计入文件hash，END时无需重新读取整个文件
+    if (first_send && chunk_msg->chunk_id == g_session.hashed_chunks)
+    {
+        file_hasher_update(&g_session.file_hash, data, chunk_msg->data_len);
+        g_session.hashed_chunks++;
+    }
+
+    chunk_set_checksum_from(chunk_msg, data, g_session.checksum_type);
+
+    // 原地编码为线上格式（v2只发送实际数据长度）；CRC32C尾部仍写在报文缓冲区中数据之后
+    pkt->len = wire_encode(chunk_msg, g_session.wire_version);
+}
+
+PacketBuf *build_chunk_packet(uint32_t chunk_id, bool first_send)
+{
+    PacketBuf *pkt = read_chunk_packet(chunk_id);
+    finish_chunk_packet(pkt, first_send);
+    return pkt;
+}
+
+// ========== 重传缓存操作 ==========
+// 按内存预算折算可缓存的组数，返回需要在缓冲池中额外预留的报文数
+static size_t retrans_cache_init(size_t budget_kb)
+{
+    g_retrans_cache.windows = budget_kb * 1024 / (WINDOW_SIZE * transport_packet_footprint());
+    if (g_retrans_cache.windows == 0)
+    {
+        return 0;
+    }
+    g_retrans_cache.slots = calloc(g_retrans_cache.windows, sizeof(RetransCacheWindow));
+    if (!g_retrans_cache.slots)
+    {
+        g_retrans_cache.windows = 0;
+        return 0;
+    }
+    return (size_t)g_retrans_cache.windows * WINDOW_SIZE;
+}
+
+static void retrans_cache_release_slot(RetransCacheWindow *slot)
+{
+    for (int i = 0; i < WINDOW_SIZE; i++)
+    {
+        if (slot->pkts[i])
+        {
+            packet_release(slot->pkts[i]);
+            slot->pkts[i] = NULL;
+        }
+    }
+    slot->valid = false;
+}
+
+// 缓存已编码的报文（增加一个引用，调用方仍持有自己的引用）
+static void retrans_cache_store(uint32_t chunk_id, PacketBuf *pkt)
+{
+    if (g_retrans_cache.windows == 0)
+    {
+        return;
+    }
+
+    uint32_t window_id = chunk_id / WINDOW_SIZE;
+    RetransCacheWindow *slot = &g_retrans_cache.slots[window_id % g_retrans_cache.windows];
+    if (slot->valid && slot->window_id != window_id)
+    {
+        retrans_cache_release_slot(slot);
+        g_retrans_cache.evictions++;
+    }
+    slot->valid = true;
+    slot->window_id = window_id;
+
+    PacketBuf **entry = &slot->pkts[chunk_id % WINDOW_SIZE];
+    if (*entry)
+    {
+        packet_release(*entry);
+    }
+    packet_ref(pkt);
+    *entry = pkt;
+}
+
+// 命中时返回缓存报文的一个新引用
+static PacketBuf *retrans_cache_lookup(uint32_t chunk_id)
+{
+    if (g_retrans_cache.windows > 0)
+    {
+        uint32_t window_id = chunk_id / WINDOW_SIZE;
+        RetransCacheWindow *slot = &g_retrans_cache.slots[window_id % g_retrans_cache.windows];
+        PacketBuf *pkt = slot->pkts[chunk_id % WINDOW_SIZE];
+        if (slot->valid && slot->window_id == window_id && pkt)
+        {
+            g_retrans_cache.hits++;
+            packet_ref(pkt);
+            return pkt;
+        }
+    }
+    g_retrans_cache.misses++;
+    return NULL;
+}
+
+// 释放所有缓存报文（须在transport_close销毁缓冲池之前）
+static void retrans_cache_free()
+{
+    if (g_retrans_cache.windows == 0)
+    {
+        return;
+    }
+
+    uint64_t lookups = g_retrans_cache.hits + g_retrans_cache.misses;
+    printf("[Master] Retransmit cache: %u groups of %d chunks (%zu KB), hits %llu, misses %llu (hit rate %.1f%%), "
+           "evicted groups %llu\n",
+           g_retrans_cache.windows, WINDOW_SIZE, (size_t)g_retrans_cache.windows * WINDOW_SIZE * transport_packet_footprint() / 1024,
+           (unsigned long long)g_retrans_cache.hits, (unsigned long long)g_retrans_cache.misses,
+           lookups ? 100.0 * g_retrans_cache.hits / lookups : 0.0, (unsigned long long)g_retrans_cache.evictions);
+
+    for (uint32_t w = 0; w < g_retrans_cache.windows; w++)
+    {
+        retrans_cache_release_slot(&g_retrans_cache.slots[w]);
+    }
+    free(g_retrans_cache.slots);
+    g_retrans_cache.slots = NULL;
+    g_retrans_cache.windows = 0;
+}
+
+// ========== 数据块准备流水线 ==========
+// 读取线程预读后续PIPELINE_DEPTH组数据块（映射模式下提前缺页），校验线程随后计算CRC/文件hash并编码，
+// 发送阶段只取已就绪的报文，磁盘时延与校验计算不再位于发送路径上。
+// 按块号每WINDOW_SIZE块一组（默认窗口大小时即窗口N+1、N+2；大窗口不会按窗口占满缓冲池），
+// 每组占一个槽位，槽位按group_id % PIPELINE_SLOTS轮转，发送方取走整组后槽位释放
+#define PIPELINE_SLOTS (PIPELINE_DEPTH + 1)
+
+typedef struct
+{
+    PacketBuf *pkts[WINDOW_SIZE];
+    uint32_t group_id;
+    uint32_t count;       // 本组的块数
+    uint32_t read_count;  // 读取阶段已完成的块数
+    uint32_t ready_count; // 校验阶段已完成的块数（可以发送）
+    bool in_use;
+} PipelineSlot;
+
+// 各阶段等待上游（或等待槽位释放）的次数与总时长
+typedef struct
+{
+    uint64_t stalls;
+    uint64_t stall_ns;
+} PipelineStageStats;
+
+static struct
+{
+    bool running;
+    bool stop;
+    pthread_t reader_thread;
+    pthread_t checksum_thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    PipelineSlot slots[PIPELINE_SLOTS];
+    PipelineStageStats reader;   // 读取阶段等待空闲槽位（已领先PIPELINE_DEPTH组）
+    PipelineStageStats checksum; // 校验阶段等待读取
+    PipelineStageStats send;     // 发送阶段等待校验
+    uint64_t depth_samples;      // 发送方每取一组采样一次预备队列深度
+    uint64_t depth_chunks_sum;
+    uint32_t depth_chunks_max;
+} g_pipeline_state = {.mutex = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER};
+
+// 在互斥锁内等待一次条件变量，首次等待时记录开始时间
+static void pipeline_wait(uint64_t *wait_start_ns)
+{
+    if (*wait_start_ns == 0)
+    {
+        *wait_start_ns = get_monotonic_ns();
+    }
+    pthread_cond_wait(&g_pipeline_state.cond, &g_pipeline_state.mutex);
+}
+
+// 等待结束：记入该阶段的停顿统计；流水线已停止时返回false
+static bool pipeline_wait_done(PipelineStageStats *stats, uint64_t wait_start_ns)
+{
+    if (wait_start_ns != 0)
+    {
+        stats->stalls++;
+        stats->stall_ns += get_monotonic_ns() - wait_start_ns;
+    }
+    return !g_pipeline_state.stop;
+}
+
+static uint32_t group_chunk_count(uint32_t group_id)
+{
+    uint32_t start_chunk = group_id * WINDOW_SIZE;
+    return g_session.total_chunks - start_chunk < WINDOW_SIZE ? g_session.total_chunks - start_chunk : WINDOW_SIZE;
+}
+
+static void *pipeline_reader_thread(void *arg)
+{
+    uint32_t total_groups = (g_session.total_chunks + WINDOW_SIZE - 1) / WINDOW_SIZE;
+    for (uint32_t group_id = 0; group_id < total_groups; group_id++)
+    {
+        PipelineSlot *slot = &g_pipeline_state.slots[group_id % PIPELINE_SLOTS];
+
+        pthread_mutex_lock(&g_pipeline_state.mutex);
+        uint64_t wait_ns = 0;
+        while (slot->in_use && !g_pipeline_state.stop)
+        {
+            pipeline_wait(&wait_ns);
+        }
+        bool ok = pipeline_wait_done(&g_pipeline_state.reader, wait_ns);
+        if (ok)
+        {
+            slot->in_use = true;
+            slot->group_id = group_id;
+            slot->count = group_chunk_count(group_id);
+            slot->read_count = 0;
+            slot->ready_count = 0;
+        }
+        pthread_mutex_unlock(&g_pipeline_state.mutex);
+        if (!ok)
+        {
+            break;
+        }
+
+        if (g_session.input_map)
+        {
+            // 映射模式：提前把整组读入页缓存，校验阶段不再缺页等待磁盘
+            size_t group_bytes = (size_t)WINDOW_SIZE * g_session.chunk_size;
+            size_t offset = (size_t)group_id * group_bytes;
+            size_t len = g_session.input_size - offset < group_bytes ? g_session.input_size - offset : group_bytes;
+            size_t page = sysconf(_SC_PAGESIZE);
+            size_t aligned = offset & ~(page - 1);
+            madvise((void *)(g_session.input_map + aligned), len + offset - aligned, MADV_WILLNEED);
+        }
+
+        for (uint32_t i = 0; i < slot->count; i++)
+        {
+            // 缓冲池为流水线预留了PIPELINE_DEPTH组报文，这里不会长期阻塞
+            PacketBuf *pkt = read_chunk_packet(group_id * WINDOW_SIZE + i);
+
+            pthread_mutex_lock(&g_pipeline_state.mutex);
+            slot->pkts[i] = pkt;
+            slot->read_count = i + 1;
+            pthread_cond_broadcast(&g_pipeline_state.cond);
+            pthread_mutex_unlock(&g_pipeline_state.mutex);
+        }
+    }
+    return NULL;
+}
+
+static void *pipeline_checksum_thread(void *arg)
+{
+    uint32_t total_groups = (g_session.total_chunks + WINDOW_SIZE - 1) / WINDOW_SIZE;
+    for (uint32_t group_id = 0; group_id < total_groups; group_id++)
+    {
+        PipelineSlot *slot = &g_pipeline_state.slots[group_id % PIPELINE_SLOTS];
+        uint32_t count = group_chunk_count(group_id);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            pthread_mutex_lock(&g_pipeline_state.mutex);
+            uint64_t wait_ns = 0;
+            while (!(slot->in_use && slot->group_id == group_id && slot->read_count > i) && !g_pipeline_state.stop)
+            {
+                pipeline_wait(&wait_ns);
+            }
+            bool ok = pipeline_wait_done(&g_pipeline_state.checksum, wait_ns);
+            PacketBuf *pkt = slot->pkts[i];
+            pthread_mutex_unlock(&g_pipeline_state.mutex);
+            if (!ok)
+            {
+                return NULL;
+            }
+
+            // 文件hash只由本线程（首次发送）更新
+            finish_chunk_packet(pkt, true);
+
+            pthread_mutex_lock(&g_pipeline_state.mutex);
+            slot->ready_count = i + 1;
+            pthread_cond_broadcast(&g_pipeline_state.cond);
+            pthread_mutex_unlock(&g_pipeline_state.mutex);
+        }
+    }
+    return NULL;
+}
+
+static bool chunk_pipeline_start()
+{
+    g_pipeline_state.stop = false;
+    if (pthread_create(&g_pipeline_state.reader_thread, NULL, pipeline_reader_thread, NULL) != 0)
+    {
+        perror("Failed to create pipeline reader thread");
+        return false;
+    }
+    if (pthread_create(&g_pipeline_state.checksum_thread, NULL, pipeline_checksum_thread, NULL) != 0)
+    {
+        perror("Failed to create pipeline checksum thread");
+        pthread_mutex_lock(&g_pipeline_state.mutex);
+        g_pipeline_state.stop = true;
+        pthread_cond_broadcast(&g_pipeline_state.cond);
+        pthread_mutex_unlock(&g_pipeline_state.mutex);
+        pthread_join(g_pipeline_state.reader_thread, NULL);
+        return false;
+    }
+    g_pipeline_state.running = true;
+    return true;
+}
+
+// 发送阶段：取出块chunk_id的已就绪报文（等待校验完成）
+static PacketBuf *chunk_pipeline_take(uint32_t chunk_id)
+{
+    uint32_t group_id = chunk_id / WINDOW_SIZE;
+    uint32_t i = chunk_id % WINDOW_SIZE;
+    PipelineSlot *slot = &g_pipeline_state.slots[group_id % PIPELINE_SLOTS];
+
+    pthread_mutex_lock(&g_pipeline_state.mutex);
+    if (i == 0)
+    {
+        // 采样预备队列深度：第N组开始发送时，已读取/就绪的后续块数
+        uint32_t depth = 0;
+        for (int s = 0; s < PIPELINE_SLOTS; s++)
+        {
+            if (g_pipeline_state.slots[s].in_use)
+            {
+                depth += g_pipeline_state.slots[s].read_count;
+            }
+        }
+        g_pipeline_state.depth_samples++;
+        g_pipeline_state.depth_chunks_sum += depth;
+        if (depth > g_pipeline_state.depth_chunks_max)
+        {
+            g_pipeline_state.depth_chunks_max = depth;
+        }
+    }
+    uint64_t wait_ns = 0;
+    while (!(slot->in_use && slot->group_id == group_id && slot->ready_count > i) && !g_pipeline_state.stop)
+    {
+        pipeline_wait(&wait_ns);
+    }
+    bool ok = pipeline_wait_done(&g_pipeline_state.send, wait_ns);
+    PacketBuf *pkt = NULL;
+    if (ok)
+    {
+        pkt = slot->pkts[i];
+        slot->pkts[i] = NULL;
+        if (i + 1 == slot->count)
+        {
+            // 整组已取走，槽位交给读取线程预读后续的组
+            slot->in_use = false;
+            pthread_cond_broadcast(&g_pipeline_state.cond);
+        }
+    }
+    pthread_mutex_unlock(&g_pipeline_state.mutex);
+    return pkt;
+}
+
+static void chunk_pipeline_stop()
+{
+    if (!g_pipeline_state.running)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&g_pipeline_state.mutex);
+    g_pipeline_state.stop = true;
+    pthread_cond_broadcast(&g_pipeline_state.cond);
+    pthread_mutex_unlock(&g_pipeline_state.mutex);
+    pthread_join(g_pipeline_state.reader_thread, NULL);
+    pthread_join(g_pipeline_state.checksum_thread, NULL);
+    g_pipeline_state.running = false;
+
+    // 释放未发送的预备报文（异常退出时）
+    for (int s = 0; s < PIPELINE_SLOTS; s++)
+    {
+        for (uint32_t i = 0; i < WINDOW_SIZE; i++)
+        {
+            if (g_pipeline_state.slots[s].pkts[i])
+            {
+                packet_release(g_pipeline_state.slots[s].pkts[i]);
+                g_pipeline_state.slots[s].pkts[i] = NULL;
+            }
+        }
+    }
+
+    printf("[Master] Pipeline stats: prepared chunks when a %d-chunk group starts sending: avg %.1f / max %u\n",
+           WINDOW_SIZE,
+           g_pipeline_state.depth_samples ? (double)g_pipeline_state.depth_chunks_sum / g_pipeline_state.depth_samples
+                                          : 0.0,
+           g_pipeline_state.depth_chunks_max);
+    printf("[Master]   stalls: reader %llu (%.1f ms waiting for a free slot), checksum %llu (%.1f ms waiting for reads), "
+           "send %llu (%.1f ms waiting for ready chunks)\n",
+           (unsigned long long)g_pipeline_state.reader.stalls, g_pipeline_state.reader.stall_ns / 1e6,
+           (unsigned long long)g_pipeline_state.checksum.stalls, g_pipeline_state.checksum.stall_ns / 1e6,
+           (unsigned long long)g_pipeline_state.send.stalls, g_pipeline_state.send.stall_ns / 1e6);
+}
+
+// ========== 前向纠错：构造并发送修复符号 ==========
+// 编码块block_id（窗口号 * window_words + 窗口内的组号）的修复符号first_index ~ first_index+count-1 一次算出：
+// 每个源块只读一次，乘加到全部count个符号上（映射模式下直接取自映射，否则pread，刚发送过的窗口仍在页缓存中）
+static void send_repair_symbols(uint32_t block_id, uint32_t first_index, uint32_t count)
+{
+    uint32_t window_id = block_id / g_session.window_words;
+    uint32_t offset = (block_id % g_session.window_words) * WINDOW_SIZE;
+    uint32_t start_chunk = window_id * g_session.window_size + offset;
+    uint32_t source_count = window_chunk_count(window_id) - offset;
+    if (source_count > FEC_MAX_SOURCE)
+    {
+        source_count = FEC_MAX_SOURCE;
+    }
+    size_t last_offset = (size_t)(start_chunk + source_count - 1) * g_session.chunk_size;
+    uint16_t last_len = g_session.input_size - last_offset < g_session.chunk_size ? g_session.input_size - last_offset
+                                                                                  : g_session.chunk_size;
+    uint16_t symbol_len = source_count > 1 ? g_session.chunk_size : last_len;
+
+    PacketBuf *pkts[WINDOW_SIZE];
+    for (uint32_t j = 0; j < count; j++)
+    {
+        pkts[j] = packet_alloc();
+        RepairSymbol *msg = (RepairSymbol *)pkts[j]->data;
+        memset(msg, 0, offsetof(RepairSymbol, data) + symbol_len);
+        msg->header.msg_type = MSG_REPAIR;
+        msg->file_id = g_session.file_id;
+        msg->block_id = block_id;
+        msg->repair_index = first_index + j;
+        msg->source_count = source_count;
+        msg->last_len = last_len;
+        msg->symbol_len = symbol_len;
+    }
+
+    uint8_t buffer[MAX_CHUNK_SIZE];
+    for (uint32_t i = 0; i < source_count; i++)
+    {
+        size_t len;
+        const uint8_t *data = read_chunk_data(start_chunk + i, buffer, &len);
+        for (uint32_t j = 0; j < count; j++)
+        {
+            RepairSymbol *msg = (RepairSymbol *)pkts[j]->data;
+            gf256_mul_add(msg->data, data, fec_coefficient(first_index + j, i), len);
+        }
+    }
+
+    for (uint32_t j = 0; j < count; j++)
+    {
+        RepairSymbol *msg = (RepairSymbol *)pkts[j]->data;
+        msg->crc = crc32c(msg->data, symbol_len);
+        pkts[j]->len = wire_encode(msg, g_session.wire_version);
+        transport_send_packet(pkts[j]);
+    }
+}
+
+// ========== 阶段2: 广播单个窗口的数据块 ==========
+void broadcast_window_chunks(uint32_t window_id)
+{
+    uint32_t start_chunk = window_id * g_session.window_size;
+    uint32_t end_chunk = start_chunk + g_session.window_size;
+    if (end_chunk > g_session.total_chunks)
+    {
+        end_chunk = g_session.total_chunks;
+    }
+
+    printf("[Master] Broadcasting window %u (chunks %u-%u)...\n",
+           window_id, start_chunk, end_chunk - 1);
+
+    for (uint32_t chunk_id = start_chunk; chunk_id < end_chunk; chunk_id++)
+    {
+        // 直接在缓冲池报文中构造数据块，发送时不再拷贝（流水线模式下取已预备好的报文）
+        PacketBuf *pkt = g_pipeline_state.running ? chunk_pipeline_take(chunk_id) : build_chunk_packet(chunk_id, true);
+        if (!pkt)
+        {
+            break;
+        }
+        retrans_cache_store(chunk_id, pkt);
+
+        // 发送数据块（发送速率由传输层令牌桶控制）
+        transport_send_packet(pkt);
+    }
+    // 紧随数据块发送各编码块的修复符号，丢块不超过修复符号数的UAV可在本地恢复，无需等待查询与重传
+    if (g_fec && g_fec_repairs > 0)
+    {
+        uint32_t blocks = (end_chunk - start_chunk + WINDOW_SIZE - 1) / WINDOW_SIZE;
+        for (uint32_t b = 0; b < blocks; b++)
+        {
+            uint32_t block_id = window_id * g_session.window_words + b;
+            send_repair_symbols(block_id, 0, g_fec_repairs);
+            pthread_mutex_lock(&g_session_mutex);
+            g_fec_blocks[block_id].next_repair = g_fec_repairs;
+            pthread_mutex_unlock(&g_session_mutex);
+            g_fec_stats.proactive += g_fec_repairs;
+        }
+    }
+    // 提交最后不足一批的数据块
+    transport_flush();
+
+    printf("[Master] Window %u broadcast completed.\n", window_id);
+}
+
+// ========== 发送窗口摘要（附到Merkle根的认证路径） ==========
+void send_window_digest(uint32_t window_id)
+{
+    if (!g_session.merkle_enabled)
+    {
+        return;
+    }
+
+    WindowDigestMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.header.msg_type = MSG_WINDOW_DIGEST;
+    msg.file_id = g_session.file_id;
+    msg.window_id = window_id;
+    msg.digest = g_session.merkle.nodes[window_id];
+    uint64_t proof[MERKLE_MAX_DEPTH];
+    msg.proof_len = merkle_proof(&g_session.merkle, window_id, proof);
+    memcpy(msg.proof, proof, msg.proof_len * sizeof(uint64_t)); // packed结构体，不直接传成员地址
+
+    size_t msg_len = wire_encode(&msg, g_session.wire_version);
+    transport_send(&msg, msg_len);
+}
+
+// ========== 阶段3: 发送状态查询 ==========
+void send_status_request(uint32_t window_id, uint16_t round_id)
+{
+    StatusRequest msg;
+    memset(&msg, 0, sizeof(msg));
+
+    msg.header.msg_type = MSG_STATUS_REQ;
+    msg.file_id = g_session.file_id;
+    msg.window_id = window_id;
+    msg.round_id = round_id;
+    if (g_session.streaming)
+    {
+        // 只有窗口已写满或流已结束时才会查询该窗口，接收方据此确定窗口（及最后一个窗口）的块数
+        msg.header.ver_flags = WIRE_FLAG_STREAM;
+        msg.total_chunks = g_session.total_chunks;
+    }
+
+    // 记录发送时间；同一轮重发后的应答无法对应到某次发送（Karn算法），不再采样
+    pthread_mutex_lock(&g_session_mutex);
+    MasterWindowState *window = &g_session.windows[window_id];
+    window->query_resent = window->query_sent_ns != 0 && window->query_round == round_id;
+    window->query_round = round_id;
+    window->query_sent_ns = get_monotonic_ns();
+    pthread_mutex_unlock(&g_session_mutex);
+
+    printf("[Master] Sending STATUS_REQ for window %u (round %u)\n", window_id, round_id);
+    size_t msg_len = wire_encode(&msg, g_session.wire_version);
+    transport_send(&msg, msg_len);
+}
+
+// ========== 处理收到的NACK ==========
+static void handle_nack_packet(PacketBuf *pkt, void *arg)
+{
+    // 直接在接收缓冲区上校验并解码，不拷贝（兼容v1/v2格式的NACK）
+    if (pkt->data[0] != MSG_NACK || !wire_decode(pkt->data, pkt->len))
+    {
+        packet_release(pkt);
+        return;
+    }
+
+    const NackMessage *nack = (const NackMessage *)pkt->data;
+    if (nack->file_id != g_session.file_id)
+    {
+        packet_release(pkt);
+        return;
+    }
+
+    pthread_mutex_lock(&g_session_mutex);
+
+    uint32_t window_id = nack->window_id;
+    if (window_id < g_session.total_windows)
+    {
+        // 合并NACK的缺失块到窗口状态
+        // nack->missing_bitmap 已经是缺失块的bitmap（NACK省略的字解码时已补0），只取本会话窗口的字
+        uint64_t missing_bitmap[MAX_WINDOW_WORDS];
+        memcpy(missing_bitmap, nack->missing_bitmap, g_session.window_words * sizeof(uint64_t)); // packed结构体，复制到对齐的数组
+        bitmap_or(window_retransmit_bitmap(window_id), missing_bitmap, g_session.window_words);
+        if (g_fec_blocks)
+        {
+            FecBlockState *blocks = &g_fec_blocks[(size_t)window_id * g_session.window_words];
+            for (uint32_t b = 0; b < g_session.window_words; b++)
+            {
+                uint32_t missing = bitmap_popcount(&missing_bitmap[b], 1);
+                if (missing > blocks[b].repair_needed)
+                {
+                    blocks[b].repair_needed = missing;
+                }
+            }
+        }
+        if (WIRE_GET_FLAGS(nack->header.ver_flags) & WIRE_FLAG_DIGEST_REQ)
+        {
+            g_session.windows[window_id].digest_requested = true;
+        }
+        // 记录已知UAV与本窗口的响应：只计入对最近一次查询的应答，迟到的上一轮NACK不能提前结束本轮
+        MasterWindowState *window = &g_session.windows[window_id];
+        if (nack->round_id == window->query_round && !bitmap_test(window->responded_uav_bitmap, nack->uav_id))
+        {
+            bitmap_set(g_session.known_uavs_bitmap, nack->uav_id);
+            bitmap_set(window->responded_uav_bitmap, nack->uav_id);
+
+            // 每个UAV对本次查询的第一个应答作为往返时间样本
+            if (!window->query_resent && window->query_sent_ns)
+            {
+                nack_rtt_sample(get_monotonic_ns() - window->query_sent_ns);
+            }
+
+            // 全部已知UAV均已应答：结束发送循环的等待
+            if (window_responses_complete(window_id))
+            {
+                g_response_seq++;
+                pthread_cond_broadcast(&g_response_cond);
+                if (g_event_loop && g_waiting_responses)
+                {
+                    evloop_stop();
+                }
+            }
+        }
+
+        printf("[Master] Received NACK from UAV %u for window %u (round %u), missing bits: %u\n", nack->uav_id,
+               window_id, nack->round_id, bitmap_popcount(missing_bitmap, g_session.window_words));
+    }
+
+    pthread_mutex_unlock(&g_session_mutex);
+    packet_release(pkt);
+}
+
+// ========== NACK接收处理线程 ==========
+void *nack_receiver_thread(void *arg)
+{
+    printf("[Master] NACK receiver thread started.\n");
+
+    while (1)
+    {
+        PacketBuf *pkt = transport_recv_packet();
+        if (!pkt)
+        {
+            break;
+        }
+        handle_nack_packet(pkt, NULL);
+    }
+
+    return NULL;
+}
+
+// ========== 阶段4: 重传指定窗口的缺失块 ==========
+void retransmit_window_chunks(uint32_t window_id)
+{
+    uint32_t words = g_session.window_words;
+    uint32_t chunks_in_window = window_chunk_count(window_id);
+    uint64_t need_retransmit[MAX_WINDOW_WORDS];
+    uint8_t repair_needed[MAX_WINDOW_WORDS] = {0};
+
+    pthread_mutex_lock(&g_session_mutex);
+    memcpy(need_retransmit, window_retransmit_bitmap(window_id), words * sizeof(uint64_t));
+    for (uint32_t b = 0; g_fec_blocks && b < words; b++)
+    {
+        repair_needed[b] = g_fec_blocks[(size_t)window_id * words + b].repair_needed;
+    }
+    pthread_mutex_unlock(&g_session_mutex);
+
+    // 只保留窗口内的块（最后一个窗口不满时，NACK中超出窗口块数的位无效）
+    uint32_t valid_words = (chunks_in_window + 63) / 64;
+    memset(need_retransmit + valid_words, 0, (words - valid_words) * sizeof(uint64_t));
+    if (chunks_in_window % 64)
+    {
+        need_retransmit[valid_words - 1] &= (1ULL << (chunks_in_window % 64)) - 1;
+    }
+    if (bitmap_popcount(need_retransmit, valid_words) == 0)
+    {
+        return; // 没有需要重传的块
+    }
+
+    // 按编码块（每WINDOW_SIZE块）分别决定：各UAV缺的块不同时，一个修复符号可以同时补上不同UAV的不同缺块，
+    // 发送缺块最多的UAV所缺的数量即可（与缺块并集一样多时直接重传原始块，接收方无需解码；
+    // 修复符号编号用尽后同样退回原始块）
+    uint32_t retrans_count = 0;
+    uint32_t repair_count = 0;
+    for (uint32_t b = 0; b < valid_words; b++)
+    {
+        uint32_t missing = bitmap_popcount(&need_retransmit[b], 1);
+        if (missing == 0)
+        {
+            continue;
+        }
+
+        uint32_t block_id = window_id * words + b;
+        pthread_mutex_lock(&g_session_mutex);
+        uint32_t next_repair = g_fec_blocks ? g_fec_blocks[block_id].next_repair : 0;
+        bool use_repairs = g_fec && repair_needed[b] < missing && next_repair + repair_needed[b] <= FEC_MAX_REPAIR;
+        if (use_repairs)
+        {
+            g_fec_blocks[block_id].next_repair += repair_needed[b];
+        }
+        pthread_mutex_unlock(&g_session_mutex);
+
+        if (use_repairs)
+        {
+            send_repair_symbols(block_id, next_repair, repair_needed[b]);
+            repair_count += repair_needed[b];
+            g_fec_stats.on_nack += repair_needed[b];
+            g_fec_stats.chunks_saved += missing - repair_needed[b];
+            continue;
+        }
+
+        uint32_t block_end = (b + 1) * WINDOW_SIZE;
+        for (uint32_t i = bitmap_next_set(need_retransmit, b * WINDOW_SIZE, block_end); i < block_end;
+             i = bitmap_next_set(need_retransmit, i + 1, block_end))
+        {
+            uint32_t chunk_id = window_id * g_session.window_size + i;
+
+            // 发送重传块：优先复用缓存中已编码的报文
+            PacketBuf *pkt = retrans_cache_lookup(chunk_id);
+            if (!pkt)
+            {
+                pkt = build_chunk_packet(chunk_id, false);
+                retrans_cache_store(chunk_id, pkt);
+            }
+            transport_send_packet(pkt);
+            retrans_count++;
+        }
+    }
+    transport_flush();
+
+    if (repair_count > 0)
+    {
+        printf("[Master] Sent %u repair symbols for window %u\n", repair_count, window_id);
+    }
+    if (retrans_count > 0)
+    {
+        printf("[Master] Retransmitting %u chunks for window %u\n", retrans_count, window_id);
+    }
+
+    // 注意：不在这里清零重传位图
+    // 应该在下一轮查询前清零，以便接收新的NACK
+}
+
+// ========== 阶段3-4: 查询并重传，直到窗口完成 ==========
+static void complete_window(uint32_t window_id)
+{
+    // 每个窗口至少查询3轮，确保有足够机会收到NACK
+    bool window_completed = false;
+    uint16_t no_nack_rounds = 0; // 连续没有NACK的轮数
+
+    for (uint16_t round = 0; round < MAX_RETRANS_ROUNDS; round++)
+    {
+        // 清零上一轮的重传标记与响应位图，准备接收新的应答
+        pthread_mutex_lock(&g_session_mutex);
+        window_begin_round(window_id);
+        pthread_mutex_unlock(&g_session_mutex);
+
+        // 在未收到全部已知UAV的响应时，重发STATUS_REQ，最多MAX_RESEND_BITMAP_ASK次
+        for (int attempt = 0; attempt < MAX_RESEND_BITMAP_ASK; attempt++)
+        {
+            // 有UAV收齐了窗口却没收到摘要时，先重发摘要
+            pthread_mutex_lock(&g_session_mutex);
+            bool digest_requested = g_session.windows[window_id].digest_requested;
+            g_session.windows[window_id].digest_requested = false;
+            pthread_mutex_unlock(&g_session_mutex);
+            if (digest_requested)
+            {
+                printf("[Master] Re-sending window %u digest on request\n", window_id);
+                send_window_digest(window_id);
+            }
+
+            // 发送状态查询
+            printf("[Master] Sending STATUS_REQ for window %u (round %u, attempt %d)\n", window_id, round, attempt + 1);
+            send_status_request(window_id, round);
+            // 等待响应（全部已知UAV应答后立即结束）
+            wait_window_responses(window_id);
+
+            // 检查是否所有已知UAV都已响应
+            pthread_mutex_lock(&g_session_mutex);
+            bool all_responded = window_all_responded(window_id);
+            pthread_mutex_unlock(&g_session_mutex);
+            if (all_responded)
+            {
+                break; // 所有已知UAV均已响应，结束重发
+            }
+        }
+
+        // 检查是否收到NACK（是否需要重传）
+        pthread_mutex_lock(&g_session_mutex);
+        bool need_retransmit = window_needs_retransmit(window_id);
+        bool all_responded = window_all_responded(window_id);
+        pthread_mutex_unlock(&g_session_mutex);
+
+        // 如果收到NACK，执行重传
+        if (need_retransmit)
+        {
+            retransmit_window_chunks(window_id);
+            no_nack_rounds = 0; // 重置计数
+        }
+        else
+        {
+            // 仅当所有已知UAV均已响应且没有需要重传的块时，才记为一轮“无NACK”
+            if (all_responded)
+            {
+                no_nack_rounds++;
+                // 连续3轮没有收到NACK，才认为窗口完成
+                if (no_nack_rounds >= 3)
+                {
+                    pthread_mutex_lock(&g_session_mutex);
+                    g_session.windows[window_id].completed = true;
+                    pthread_mutex_unlock(&g_session_mutex);
+                    printf("[Master] Window %u completed after %u rounds (no NACK for 3 consecutive rounds).\n",
+                           window_id, round);
+                    window_completed = true;
+                    break;
+                }
+            }
+            else
+            {
+                // 未收到所有已知UAV响应，不计入“无NACK”轮
+                no_nack_rounds = 0;
+            }
+        }
+    }
+
+    if (!window_completed)
+    {
+        printf("[Master] WARNING: Window %u reached max retransmission rounds.\n", window_id);
+    }
+}
+
+// ========== 阶段2-4: 逐窗口广播和重传 ==========
+void window_by_window_transmission()
+{
+    printf("[Master] Starting window-by-window transmission...\n");
+
+    for (uint32_t window_id = 0; window_id < g_session.total_windows; window_id++)
+    {
+        // 步骤1: 广播该窗口的所有数据块，随后下发窗口摘要
+        broadcast_window_chunks(window_id);
+        send_window_digest(window_id);
+
+        // 步骤2-3: 查询并重传，直到窗口完成
+        complete_window(window_id);
+    }
+
+    printf("[Master] All windows transmitted and verified.\n");
+}
+
+// ========== 阶段2-4: 多窗口滑动发送 ==========
+// 最多g_inflight个窗口同时处于查询/重传阶段：窗口广播完即发出STATUS_REQ，等待应答期间继续广播后续窗口。
+// 各窗口独立按complete_window的规则推进：应答收齐（或重发达上限）后结算，有NACK则排队重传，
+// 连续3轮无NACK则完成。重传与新窗口交替发送，有重传排队时每发送一个新窗口前最多处理g_repair_ratio个窗口的重传
+typedef struct
+{
+    uint32_t window_id;
+    uint16_t round;
+    int attempt;             // 本轮已发送的STATUS_REQ数
+    uint16_t no_nack_rounds; // 连续没有NACK的轮数
+    uint64_t due_ns;         // 本次查询的应答等待截止时间
+    bool repair_pending;     // 本轮收到NACK，等待重传
+} InflightWindow;
+
+// 发送（或重发）本轮的STATUS_REQ；有UAV请求时先重发窗口摘要
+static void inflight_query(InflightWindow *w)
+{
+    pthread_mutex_lock(&g_session_mutex);
+    bool digest_requested = g_session.windows[w->window_id].digest_requested;
+    g_session.windows[w->window_id].digest_requested = false;
+    pthread_mutex_unlock(&g_session_mutex);
+    if (digest_requested)
     {
-        end_chunk = g_session.total_chunks;
+        printf("[Master] Re-sending window %u digest on request\n", w->window_id);
+        send_window_digest(w->window_id);
     }
 
-    printf("[Master] Broadcasting window %u (chunks %u-%u)...\n",
-           window_id, start_chunk, end_chunk - 1);
+    send_status_request(w->window_id, w->round);
+    w->attempt++;
+    w->due_ns = get_monotonic_ns() + nack_rto_ns();
+}
 
-    for (uint32_t chunk_id = start_chunk; chunk_id < end_chunk; chunk_id++)
+// 开始新一轮查询（清零上一轮的重传标记与响应位图）；达到最大轮数时返回true，窗口离开在途集合
+static bool inflight_next_round(InflightWindow *w, bool first)
+{
+    if (!first && ++w->round >= MAX_RETRANS_ROUNDS)
     {
-        // 定位并读取数据
-        fseek(g_session.input_file, chunk_id * MAX_CHUNK_SIZE, SEEK_SET);
-        size_t bytes_read = fread(chunk_msg.data, 1, MAX_CHUNK_SIZE, g_session.input_file);
-
-        chunk_msg.chunk_id = chunk_id;
-        chunk_msg.data_len = bytes_read;
-        chunk_msg.crc = crc16(chunk_msg.data, bytes_read);
-
-        // 发送数据块
-        transport_send(&chunk_msg, sizeof(chunk_msg));
-
-        // 控制发送速率（避免过快导致丢包）
-        usleep(1000); // 1ms延迟，约1MB/s传输速率
+        printf("[Master] WARNING: Window %u reached max retransmission rounds.\n", w->window_id);
+        return true;
     }
 
-    printf("[Master] Window %u broadcast completed.\n", window_id);
+    pthread_mutex_lock(&g_session_mutex);
+    window_begin_round(w->window_id);
+    pthread_mutex_unlock(&g_session_mutex);
+
+    w->attempt = 0;
+    inflight_query(w);
+    return false;
 }
 
-// ========== 阶段3: 发送状态查询 ==========
-void send_status_request(uint32_t window_id, uint16_t round_id)
+// 查询到期：未收齐已知UAV的应答时重发查询，否则结算本轮。窗口完成或放弃时返回true
+static bool inflight_settle(InflightWindow *w)
 {
-    StatusRequest msg;
-    memset(&msg, 0, sizeof(msg));
+    pthread_mutex_lock(&g_session_mutex);
+    bool need_retransmit = window_needs_retransmit(w->window_id);
+    bool all_responded = window_all_responded(w->window_id);
+    pthread_mutex_unlock(&g_session_mutex);
+    if (!all_responded && w->attempt < MAX_RESEND_BITMAP_ASK)
+    {
+        inflight_query(w);
+        return false;
+    }
 
-    msg.header.msg_type = MSG_STATUS_REQ;
-    msg.header.payload_len = sizeof(StatusRequest) - sizeof(MessageHeader);
-    msg.file_id = g_session.file_id;
-    msg.window_id = window_id;
-    msg.round_id = round_id;
+    if (need_retransmit)
+    {
+        w->repair_pending = true;
+        w->no_nack_rounds = 0;
+        return false;
+    }
 
-    printf("[Master] Sending STATUS_REQ for window %u (round %u)\n", window_id, round_id);
-    transport_send(&msg, sizeof(msg));
+    if (!all_responded)
+    {
+        w->no_nack_rounds = 0; // 未收到所有已知UAV响应，不计入“无NACK”轮
+    }
+    else if (++w->no_nack_rounds >= 3)
+    {
+        pthread_mutex_lock(&g_session_mutex);
+        g_session.windows[w->window_id].completed = true;
+        pthread_mutex_unlock(&g_session_mutex);
+        printf("[Master] Window %u completed after %u rounds (no NACK for 3 consecutive rounds).\n", w->window_id,
+               w->round);
+        return true;
+    }
+    return inflight_next_round(w, false);
 }
 
-// ========== NACK接收处理线程 ==========
-void *nack_receiver_thread(void *arg)
+void sliding_window_transmission()
 {
-    uint8_t buffer[MAX_PACKET_SIZE];
+    printf("[Master] Starting sliding-window transmission (%u windows in flight, repair ratio %u)...\n", g_inflight,
+           g_repair_ratio);
 
-    printf("[Master] NACK receiver thread started.\n");
+    InflightWindow inflight[MAX_INFLIGHT_WINDOWS];
+    uint32_t inflight_count = 0;
+    uint32_t next_window = 0;
+    uint32_t repairs_since_fresh = 0;
 
-    while (1)
+    while (next_window < g_session.total_windows || inflight_count > 0)
     {
-        size_t recv_len = transport_recv(buffer, sizeof(buffer));
-        if (recv_len < sizeof(MessageHeader))
+        // 结算已收齐应答或应答等待已到期的窗口（按窗口顺序，完成的窗口移出在途集合）
+        pthread_mutex_lock(&g_session_mutex);
+        uint64_t seq = g_response_seq;
+        pthread_mutex_unlock(&g_session_mutex);
+        uint64_t now_ns = get_monotonic_ns();
+        for (uint32_t i = 0; i < inflight_count;)
         {
-            continue;
+            pthread_mutex_lock(&g_session_mutex);
+            bool ready = now_ns >= inflight[i].due_ns || window_responses_complete(inflight[i].window_id);
+            pthread_mutex_unlock(&g_session_mutex);
+            if (!inflight[i].repair_pending && ready && inflight_settle(&inflight[i]))
+            {
+                memmove(&inflight[i], &inflight[i + 1], (inflight_count - i - 1) * sizeof(InflightWindow));
+                inflight_count--;
+                continue;
+            }
+            i++;
         }
 
-        MessageHeader *header = (MessageHeader *)buffer;
-
-        if (header->msg_type == MSG_NACK)
+        // 最早排队的重传
+        uint32_t repair = inflight_count;
+        for (uint32_t i = 0; i < inflight_count; i++)
         {
-            NackMessage *nack = (NackMessage *)buffer;
+            if (inflight[i].repair_pending)
+            {
+                repair = i;
+                break;
+            }
+        }
+        bool can_send_fresh = next_window < g_session.total_windows && inflight_count < g_inflight;
 
-            if (nack->file_id != g_session.file_id)
+        if (repair < inflight_count && (!can_send_fresh || repairs_since_fresh < g_repair_ratio))
+        {
+            InflightWindow *w = &inflight[repair];
+            retransmit_window_chunks(w->window_id);
+            w->repair_pending = false;
+            repairs_since_fresh++;
+            if (inflight_next_round(w, false))
             {
-                continue;
+                memmove(&inflight[repair], &inflight[repair + 1],
+                        (inflight_count - repair - 1) * sizeof(InflightWindow));
+                inflight_count--;
             }
+            continue;
+        }
 
-            pthread_mutex_lock(&g_session_mutex);
+        if (can_send_fresh)
+        {
+            // 广播新窗口并下发窗口摘要，随即开始第一轮查询
+            broadcast_window_chunks(next_window);
+            send_window_digest(next_window);
+
+            InflightWindow *w = &inflight[inflight_count++];
+            memset(w, 0, sizeof(*w));
+            w->window_id = next_window++;
+            inflight_next_round(w, true);
+            repairs_since_fresh = 0;
+            continue;
+        }
 
-            uint32_t window_id = nack->window_id;
-            if (window_id < g_session.total_windows)
-            {
-                // 合并NACK的缺失块到窗口状态
-                // nack->missing_bitmap 已经是缺失块的bitmap，直接使用
-                g_session.windows[window_id].need_retransmit |= nack->missing_bitmap;
-                // 记录已知UAV与本窗口的响应
-                if (nack->uav_id < MAX_UAVS)
-                {
-                    g_session.known_uavs_bitmap |= (1u << nack->uav_id);
-                    g_session.windows[window_id].responded_uav_bitmap |= (1u << nack->uav_id);
-                }
+        if (inflight_count == 0)
+        {
+            continue; // 最后的窗口刚刚完成
+        }
 
-                printf("[Master] Received NACK from UAV %u for window %u (round %u), missing bits: %d\n",
-                       nack->uav_id, window_id, nack->round_id, count_set_bits(nack->missing_bitmap));
+        // 等待最早到期的查询，或有窗口收齐应答（事件循环模式下等待期间处理NACK）
+        uint64_t due_ns = UINT64_MAX;
+        for (uint32_t i = 0; i < inflight_count; i++)
+        {
+            if (inflight[i].due_ns < due_ns)
+            {
+                due_ns = inflight[i].due_ns;
             }
-
-            pthread_mutex_unlock(&g_session_mutex);
         }
+        master_wait_responses(due_ns, seq);
     }
 
-    return NULL;
+    printf("[Master] All windows transmitted and verified.\n");
 }
 
-// ========== 阶段4: 重传指定窗口的缺失块 ==========
-void retransmit_window_chunks(uint32_t window_id)
+// ========== 流式会话 ==========
+// 读满一个数据块（或读到流末尾），返回数据长度。数据尚未到达时先提交已排队的报文再阻塞等待；
+// 普通文件读到末尾时再等待g_stream_idle_ms，期间文件继续增长则接着读
+static size_t stream_read_chunk(uint8_t *buffer)
 {
-    pthread_mutex_lock(&g_session_mutex);
-
-    uint64_t need_retransmit = g_session.windows[window_id].need_retransmit;
-
-    pthread_mutex_unlock(&g_session_mutex);
+    int fd = fileno(g_session.input_file);
+    struct stat st;
+    bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    uint32_t idle_ms = 0;
 
-    if (need_retransmit == 0)
+    size_t len = 0;
+    while (len < g_session.chunk_size)
     {
-        return; // 没有需要重传的块
-    }
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (poll(&pfd, 1, 0) == 0)
+        {
+            transport_flush();
+        }
 
-    int retrans_count = 0;
-    for (int i = 0; i < WINDOW_SIZE; i++)
-    {
-        if (need_retransmit & (1ULL << i))
+        ssize_t n = read(fd, buffer + len, g_session.chunk_size - len);
+        if (n < 0 && errno == EINTR)
         {
-            retrans_count++;
+            continue;
+        }
+        if (n > 0)
+        {
+            len += n;
+            idle_ms = 0;
+            continue;
+        }
+        if (n == 0 && regular && idle_ms < g_stream_idle_ms)
+        {
+            transport_flush();
+            master_wait_ms(10);
+            idle_ms += 10;
+            continue;
+        }
+        if (n < 0)
+        {
+            perror("Failed to read input stream");
         }
+        g_session.stream_eof = true;
+        break;
     }
+    return len;
+}
 
-    printf("[Master] Retransmitting %d chunks for window %u\n", retrans_count, window_id);
-
-    DataChunk chunk_msg;
-    memset(&chunk_msg, 0, sizeof(chunk_msg));
-    chunk_msg.header.msg_type = MSG_DATA_CHUNK;
-    chunk_msg.file_id = g_session.file_id;
-    chunk_msg.header.payload_len = sizeof(DataChunk) - sizeof(MessageHeader);
-
-    for (int i = 0; i < WINDOW_SIZE; i++)
+// 计入一个新到达的块（窗口状态数组按需扩容；NACK线程通过g_session_mutex访问）
+static bool stream_add_chunk()
+{
+    pthread_mutex_lock(&g_session_mutex);
+    uint32_t window_id = g_session.total_chunks / g_session.window_size;
+    if (window_id >= g_session.window_capacity)
     {
-        if (need_retransmit & (1ULL << i))
+        uint32_t capacity = g_session.window_capacity * 2;
+        size_t words = g_session.window_words;
+        MasterWindowState *windows = realloc(g_session.windows, capacity * sizeof(MasterWindowState));
+        if (windows)
         {
-            uint32_t chunk_id = window_id * WINDOW_SIZE + i;
-
-            if (chunk_id >= g_session.total_chunks)
-            {
-                break; // 超出文件范围
-            }
-
-            // 定位并读取数据
-            fseek(g_session.input_file, chunk_id * MAX_CHUNK_SIZE, SEEK_SET);
-            size_t bytes_read = fread(chunk_msg.data, 1, MAX_CHUNK_SIZE, g_session.input_file);
-
-            chunk_msg.chunk_id = chunk_id;
-            chunk_msg.data_len = bytes_read;
-            chunk_msg.crc = crc16(chunk_msg.data, bytes_read);
-
-            // 发送重传块
-            transport_send(&chunk_msg, sizeof(chunk_msg));
-            usleep(1000);
+            g_session.windows = windows;
         }
+        uint64_t *bitmaps = windows ? realloc(g_session.retransmit_bitmaps, capacity * words * sizeof(uint64_t)) : NULL;
+        if (!bitmaps)
+        {
+            pthread_mutex_unlock(&g_session_mutex);
+            perror("Failed to grow window states");
+            return false;
+        }
+        g_session.retransmit_bitmaps = bitmaps;
+        memset(bitmaps + g_session.window_capacity * words, 0,
+               (capacity - g_session.window_capacity) * words * sizeof(uint64_t));
+        memset(windows + g_session.window_capacity, 0,
+               (capacity - g_session.window_capacity) * sizeof(MasterWindowState));
+        for (uint32_t i = g_session.window_capacity; i < capacity; i++)
+        {
+            windows[i].window_id = i;
+        }
+        g_session.windows = windows;
+        g_session.window_capacity = capacity;
     }
-
-    // 注意：不在这里清零 need_retransmit
-    // 应该在下一轮查询前清零，以便接收新的NACK
+    g_session.total_chunks++;
+    g_session.total_windows = window_id + 1;
+    pthread_mutex_unlock(&g_session_mutex);
+    return true;
 }
 
-// ========== 阶段2-4: 逐窗口广播和重传 ==========
-void window_by_window_transmission()
+// 数据到达即发送，窗口写满或流结束时返回本窗口的块数
+static uint32_t stream_broadcast_window(uint32_t window_id)
 {
-    printf("[Master] Starting window-by-window transmission...\n");
-
-    for (uint32_t window_id = 0; window_id < g_session.total_windows; window_id++)
+    uint32_t buffered = STREAM_BUFFER_WINDOWS * g_session.window_size;
+    uint32_t count = 0;
+    while (count < g_session.window_size && !g_session.stream_eof)
     {
-        // 步骤1: 广播该窗口的所有数据块
-        broadcast_window_chunks(window_id);
-
-        // 步骤2-3: 查询并重传，直到窗口完成
-        // 每个窗口至少查询3轮，确保有足够机会收到NACK
-        bool window_completed = false;
-        uint16_t no_nack_rounds = 0; // 连续没有NACK的轮数
-
-        for (uint16_t round = 0; round < MAX_RETRANS_ROUNDS; round++)
+        uint32_t chunk_id = window_id * g_session.window_size + count;
+        uint32_t slot = chunk_id % buffered;
+        size_t len = stream_read_chunk(g_session.stream_buf + (size_t)slot * g_session.chunk_size);
+        if (len == 0 || !stream_add_chunk())
         {
-            // 清零上一轮的重传标记与响应位图，准备接收新的应答
-            pthread_mutex_lock(&g_session_mutex);
-            g_session.windows[window_id].need_retransmit = 0;
-            g_session.windows[window_id].responded_uav_bitmap = 0;
-            pthread_mutex_unlock(&g_session_mutex);
+            g_session.stream_eof = true;
+            break;
+        }
+        g_session.stream_lens[slot] = len;
 
-            // 在未收到全部已知UAV的响应时，重发STATUS_REQ，最多MAX_RESEND_BITMAP_ASK次
-            for (int attempt = 0; attempt < MAX_RESEND_BITMAP_ASK; attempt++)
-            {
-                // 发送状态查询
-                printf("[Master] Sending STATUS_REQ for window %u (round %u, attempt %d)\n", window_id, round, attempt + 1);
-                send_status_request(window_id, round);
-                // 等待响应
-                usleep(STATUS_REQ_INTERVAL * 1000);
-
-                // 检查是否所有已知UAV都已响应
-                pthread_mutex_lock(&g_session_mutex);
-                uint32_t known_mask = g_session.known_uavs_bitmap;
-                uint32_t responded_mask = g_session.windows[window_id].responded_uav_bitmap;
-                pthread_mutex_unlock(&g_session_mutex);
-                if (known_mask == 0 || (responded_mask & known_mask) == known_mask)
-                {
-                    break; // 所有已知UAV均已响应，结束重发
-                }
-            }
+        PacketBuf *pkt = build_chunk_packet(chunk_id, true);
+        retrans_cache_store(chunk_id, pkt);
+        transport_send_packet(pkt);
+        count++;
+    }
+    transport_flush();
 
-            // 检查是否收到NACK（是否需要重传）
-            pthread_mutex_lock(&g_session_mutex);
-            uint64_t need_retransmit = g_session.windows[window_id].need_retransmit;
-            uint32_t known_mask = g_session.known_uavs_bitmap;
-            uint32_t responded_mask = g_session.windows[window_id].responded_uav_bitmap;
-            pthread_mutex_unlock(&g_session_mutex);
+    if (count > 0)
+    {
+        printf("[Master] Streamed window %u (chunks %u-%u)%s\n", window_id, window_id * g_session.window_size,
+               window_id * g_session.window_size + count - 1, g_session.stream_eof ? ", end of stream" : "");
+    }
+    return count;
+}
 
-            // 如果收到NACK，执行重传
-            if (need_retransmit != 0)
-            {
-                retransmit_window_chunks(window_id);
-                no_nack_rounds = 0; // 重置计数
-            }
-            else
-            {
-                // 仅当所有已知UAV均已响应且没有需要重传的块时，才记为一轮“无NACK”
-                if (known_mask == 0 || (responded_mask & known_mask) == known_mask)
-                {
-                    no_nack_rounds++;
-                    // 连续3轮没有收到NACK，才认为窗口完成
-                    if (no_nack_rounds >= 3)
-                    {
-                        pthread_mutex_lock(&g_session_mutex);
-                        g_session.windows[window_id].completed = true;
-                        pthread_mutex_unlock(&g_session_mutex);
-                        printf("[Master] Window %u completed after %u rounds (no NACK for 3 consecutive rounds).\n",
-                               window_id, round);
-                        window_completed = true;
-                        break;
-                    }
-                }
-                else
-                {
-                    // 未收到所有已知UAV响应，不计入“无NACK”轮
-                    no_nack_rounds = 0;
-                }
-            }
-        }
+void stream_transmission()
+{
+    printf("[Master] Starting streaming transmission...\n");
 
-        if (!window_completed)
+    for (uint32_t window_id = 0; !g_session.stream_eof; window_id++)
+    {
+        if (stream_broadcast_window(window_id) == 0)
         {
-            printf("[Master] WARNING: Window %u reached max retransmission rounds.\n", window_id);
+            break; // 流恰好在窗口边界结束
         }
+        complete_window(window_id);
     }
 
-    printf("[Master] All windows transmitted and verified.\n");
+    printf("[Master] Stream ended after %u chunks (%u windows).\n", g_session.total_chunks, g_session.total_windows);
 }
 
 // ========== 阶段5: 发送结束消息 ==========
 void send_end_message()
 {
-    // 计算文件hash
-    fseek(g_session.input_file, 0, SEEK_SET);
-    uint8_t *file_buffer = malloc(g_session.total_chunks * MAX_CHUNK_SIZE);
-    if (!file_buffer)
+    // 文件hash在广播时已流式计算；只有未按顺序读到的尾部块才需要补读
+    uint8_t buffer[MAX_CHUNK_SIZE];
+    while (g_session.hashed_chunks < g_session.total_chunks)
     {
-        perror("Failed to allocate buffer for hash");
-        return;
+        size_t bytes_read;
+        const uint8_t *data = read_chunk_data(g_session.hashed_chunks, buffer, &bytes_read);
+        file_hasher_update(&g_session.file_hash, data, bytes_read);
+        g_session.hashed_chunks++;
     }
-
-    size_t total_read = fread(file_buffer, 1, g_session.total_chunks * MAX_CHUNK_SIZE,
-                              g_session.input_file);
-    uint32_t file_hash = simple_hash(file_buffer, total_read);
-    free(file_buffer);
+    uint64_t file_hash = file_hasher_final(&g_session.file_hash);
 
     EndMessage msg;
     memset(&msg, 0, sizeof(msg));
     msg.header.msg_type = MSG_END;
-    msg.header.payload_len = sizeof(EndMessage) - sizeof(MessageHeader);
     msg.file_id = g_session.file_id;
     msg.total_chunks = g_session.total_chunks;
-    msg.file_hash = file_hash;
+    msg.file_hash = (uint32_t)file_hash;
+    if (g_session.file_hash.type == FILE_HASH_HASH64)
+    {
+        msg.header.ver_flags = WIRE_FLAG_HASH64;
+        msg.file_hash64 = file_hash;
+    }
 
-    printf("[Master] Sending END message (file_hash=0x%08X)...\n", file_hash);
+    printf("[Master] Sending END message (%s file_hash=0x%llX)...\n", file_hash_name(g_session.file_hash.type),
+           (unsigned long long)file_hash);
+    size_t msg_len = wire_encode(&msg, g_session.wire_version);
 
     // 多次发送END消息
     for (int i = 0; i < 5; i++)
     {
-        transport_send(&msg, sizeof(msg));
-        usleep(50000);
+        transport_send(&msg, msg_len);
+        master_wait_ms(50);
     }
 }
 
 // ========== 清理资源 ==========
 void cleanup_master_session()
 {
+    chunk_pipeline_stop();
+    retrans_cache_free();
     if (g_session.input_file)
     {
         fclose(g_session.input_file);
     }
+    free(g_session.stream_buf);
+    free(g_session.stream_lens);
     if (g_session.windows)
     {
         free(g_session.windows);
     }
+    free(g_session.retransmit_bitmaps);
+    free(g_fec_blocks);
+    merkle_free(&g_session.merkle);
+    transport_print_stats("[Master]");
     transport_close();
+    // 传输层关闭后不再有引用映射的报文
+    if (g_session.input_map)
+    {
+        munmap((void *)g_session.input_map, g_session.input_size);
+    }
 }
 
 // ========== 主函数 ==========
+static void print_usage(const char *prog)
+{
+    printf("Usage: %s [options] <filename> [file_id]\n", prog);
+    printf("Options:\n");
+    printf("  --rate <kbps>    Target send rate in kbit/s, 0 = unlimited (default %d)\n", PACING_DEFAULT_RATE_KBPS);
+    printf("  --burst <bytes>  Token bucket burst size in bytes (default %d)\n", PACING_DEFAULT_BURST_BYTES);
+    printf("  --wire <1|2>     Wire format version (default %d)\n", WIRE_VERSION_DEFAULT);
+    printf("  --checksum <auto|crc16|crc32c>  Chunk checksum; auto = CRC32C when this CPU has it in hardware (v2 only)\n");
+    printf("  --file-hash <auto|fnv|hash64>  File hash; auto = hash64 for wire v2, FNV-1a 32 for v1 receivers\n");
+    printf("  --no-merkle      Do not distribute per-window Merkle digests (skips the pre-read of the file)\n");
+    printf("  --retrans-cache <KB>  Memory budget for prebuilt retransmit packets, whole %d-chunk groups (default %d, 0 = off)\n",
+           WINDOW_SIZE, RETRANS_CACHE_DEFAULT_KB);
+    printf("  --stream         Broadcast a pipe (\"-\" = stdin) or growing file as data arrives; size fixed by END\n");
+    printf("  --stream-idle <ms>  With --stream on a regular file, wait this long at EOF for more data (default %d)\n",
+           STREAM_IDLE_DEFAULT_MS);
+    printf("  --inflight <K>   Keep K windows in the query/repair phase while broadcasting later windows (default 1 = stop-and-wait, max %d)\n",
+           MAX_INFLIGHT_WINDOWS);
+    printf("  --repair-ratio <n>  With --inflight, repair up to n windows before each fresh window when both are pending (default 1, 0 = fresh first)\n");
+    printf("  --mtu <auto|n>   Path MTU used to size chunks; auto = MTU of the route to the multicast group (default auto, %d-%d, v2 only)\n",
+           MIN_MTU, MAX_MTU);
+    printf("  --window <n>     Chunks per window, announced in SESSION_ANNOUNCE (default %d, max %d; over %d needs wire v2)\n",
+           WINDOW_SIZE, MAX_WINDOW_SIZE, WINDOW_SIZE);
+    printf("  --fec <R>        Send R Reed-Solomon repair symbols after each %d-chunk block and answer NACKs with repair symbols (v2 only, R <= %d)\n",
+           WINDOW_SIZE, WINDOW_SIZE);
+    printf("  --no-pipeline    Read and checksum chunks on the send path instead of in read-ahead threads\n");
+    printf("  --mmap           Map the input file and send chunk payloads straight from the mapping (no fread/copy)\n");
+    printf("  --event-loop     Single-threaded epoll/timerfd runtime (no NACK/Tx/Rx threads)\n");
+    printf("  --transport <socket|uring|sim>  Transport backend (default socket)\n");
+    printf("  --sim <spec>     Simulated network for --transport sim, e.g. loss=5,delay_ms=20,seed=7\n");
+    printf("  --offload        UDP GSO for data windows and GRO on receive (socket backend)\n");
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc < 2)
+    uint64_t rate_kbps = PACING_DEFAULT_RATE_KBPS;
+    uint32_t burst_bytes = PACING_DEFAULT_BURST_BYTES;
+    uint8_t wire_version = WIRE_VERSION_DEFAULT;
+    const char *checksum_arg = "auto";
+    const char *file_hash_arg = "auto";
+    size_t retrans_cache_kb = RETRANS_CACHE_DEFAULT_KB;
+    TransportBackend backend = TRANSPORT_BACKEND_THREADS;
+    SimNetConfig sim;
+    sim_parse_config(NULL, &sim);
+
+    static const struct option long_options[] = {
+        {"rate", required_argument, NULL, 'r'},
+        {"burst", required_argument, NULL, 'b'},
+        {"wire", required_argument, NULL, 'w'},
+        {"checksum", required_argument, NULL, 'c'},
+        {"no-merkle", no_argument, NULL, 'M'},
+        {"file-hash", required_argument, NULL, 'H'},
+        {"mmap", no_argument, NULL, 'm'},
+        {"no-pipeline", no_argument, NULL, 'P'},
+        {"retrans-cache", required_argument, NULL, 'R'},
+        {"stream", no_argument, NULL, 'S'},
+        {"stream-idle", required_argument, NULL, 'I'},
+        {"inflight", required_argument, NULL, 'K'},
+        {"repair-ratio", required_argument, NULL, 'Q'},
+        {"window", required_argument, NULL, 'W'},
+        {"mtu", required_argument, NULL, 'U'},
+        {"fec", required_argument, NULL, 'F'},
+        {"event-loop", no_argument, NULL, 'e'},
+        {"transport", required_argument, NULL, 't'},
+        {"offload", no_argument, NULL, 'o'},
+        {"sim", required_argument, NULL, 's'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "r:b:w:c:MH:mPR:SI:K:Q:W:U:F:et:os:h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            rate_kbps = strtoull(optarg, NULL, 10);
+            break;
+        case 'b':
+            burst_bytes = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            wire_version = atoi(optarg);
+            if (wire_version != WIRE_VERSION_V1 && wire_version != WIRE_VERSION_V2)
+            {
+                fprintf(stderr, "Unsupported wire format version: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'c':
+            checksum_arg = optarg;
+            break;
+        case 'M':
+            g_merkle = false;
+            break;
+        case 'H':
+            file_hash_arg = optarg;
+            break;
+        case 'm':
+            g_mmap = true;
+            break;
+        case 'P':
+            g_pipeline = false;
+            break;
+        case 'R':
+            retrans_cache_kb = strtoul(optarg, NULL, 10);
+            break;
+        case 'S':
+            g_stream = true;
+            break;
+        case 'I':
+            g_stream_idle_ms = strtoul(optarg, NULL, 10);
+            break;
+        case 'K':
+            g_inflight = strtoul(optarg, NULL, 10);
+            if (g_inflight < 1 || g_inflight > MAX_INFLIGHT_WINDOWS)
+            {
+                fprintf(stderr, "--inflight must be between 1 and %d\n", MAX_INFLIGHT_WINDOWS);
+                return 1;
+            }
+            break;
+        case 'Q':
+            g_repair_ratio = strtoul(optarg, NULL, 10);
+            break;
+        case 'W':
+            g_window_size = strtoul(optarg, NULL, 10);
+            if (g_window_size < 1 || g_window_size > MAX_WINDOW_SIZE)
+            {
+                fprintf(stderr, "--window must be between 1 and %d\n", MAX_WINDOW_SIZE);
+                return 1;
+            }
+            break;
+        case 'U':
+            if (strcmp(optarg, "auto") != 0)
+            {
+                g_mtu = strtoul(optarg, NULL, 10);
+                if (g_mtu < MIN_MTU || g_mtu > MAX_MTU)
+                {
+                    fprintf(stderr, "--mtu must be auto or between %d and %d\n", MIN_MTU, MAX_MTU);
+                    return 1;
+                }
+            }
+            break;
+        case 'F':
+            g_fec = true;
+            g_fec_repairs = strtoul(optarg, NULL, 10);
+            if (g_fec_repairs > WINDOW_SIZE)
+            {
+                fprintf(stderr, "--fec must be between 0 and %d\n", WINDOW_SIZE);
+                return 1;
+            }
+            break;
+        case 'e':
+            g_event_loop = true;
+            break;
+        case 't':
+            if (!transport_parse_backend(optarg, &backend))
+            {
+                fprintf(stderr, "Unknown transport backend: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'o':
+            transport_set_offload(true);
+            break;
+        case 's':
+            if (!sim_parse_config(optarg, &sim))
+            {
+                return 1;
+            }
+            break;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // 校验算法：v1只支持CRC16；auto在本机有CRC32C硬件指令时使用CRC32C
+    // （接收方没有硬件指令时使用slice-by-8软件实现，速度与CRC16相当）
+    ChecksumType checksum_type;
+    if (strcmp(checksum_arg, "crc16") == 0)
+    {
+        checksum_type = CHECKSUM_CRC16;
+    }
+    else if (strcmp(checksum_arg, "crc32c") == 0)
+    {
+        checksum_type = CHECKSUM_CRC32C;
+    }
+    else if (strcmp(checksum_arg, "auto") == 0)
+    {
+        checksum_type = crc32c_hw_available() ? CHECKSUM_CRC32C : CHECKSUM_CRC16;
+    }
+    else
+    {
+        fprintf(stderr, "Unknown checksum: %s\n", checksum_arg);
+        return 1;
+    }
+    if (wire_version == WIRE_VERSION_V1)
+    {
+        if (checksum_type == CHECKSUM_CRC32C && strcmp(checksum_arg, "crc32c") == 0)
+        {
+            fprintf(stderr, "CRC32C requires wire format v2\n");
+            return 1;
+        }
+        checksum_type = CHECKSUM_CRC16;
+    }
+
+    if (g_stream && wire_version == WIRE_VERSION_V1)
+    {
+        fprintf(stderr, "--stream requires wire format v2\n");
+        return 1;
+    }
+    if (g_stream && g_inflight > 1)
+    {
+        fprintf(stderr, "--inflight cannot be combined with --stream\n");
+        return 1;
+    }
+    if (g_window_size > WINDOW_SIZE && wire_version == WIRE_VERSION_V1)
+    {
+        fprintf(stderr, "--window over %d requires wire format v2 (v1 NACKs carry a single 64-bit bitmap)\n",
+                WINDOW_SIZE);
+        return 1;
+    }
+    if (g_fec && (g_stream || wire_version == WIRE_VERSION_V1))
+    {
+        fprintf(stderr, "--fec requires wire format v2 and cannot be combined with --stream\n");
+        return 1;
+    }
+
+    // 块大小：v2按路径MTU选择（探测失败时用默认值），v1定长格式固定为DEFAULT_CHUNK_SIZE
+    if (wire_version == WIRE_VERSION_V1)
+    {
+        if (g_mtu)
+        {
+            fprintf(stderr, "--mtu requires wire format v2 (v1 chunks are fixed at %d bytes)\n", DEFAULT_CHUNK_SIZE);
+            return 1;
+        }
+    }
+    else
+    {
+        if (!g_mtu)
+        {
+            g_mtu = path_mtu_probe();
+            g_mtu_probed = true;
+            if (g_mtu && g_mtu < MIN_MTU)
+            {
+                g_mtu = MIN_MTU;
+            }
+        }
+        if (g_mtu)
+        {
+            g_chunk_size = chunk_size_for_mtu(g_mtu);
+        }
+    }
+
+    // 文件hash：v1接收端只认识FNV-1a 32位
+    FileHashType file_hash_type = wire_version == WIRE_VERSION_V1 ? FILE_HASH_FNV1A32 : FILE_HASH_HASH64;
+    if (strcmp(file_hash_arg, "fnv") == 0)
+    {
+        file_hash_type = FILE_HASH_FNV1A32;
+    }
+    else if (strcmp(file_hash_arg, "hash64") == 0)
     {
-        printf("Usage: %s <filename> [file_id]\n", argv[0]);
+        if (wire_version == WIRE_VERSION_V1)
+        {
+            fprintf(stderr, "hash64 file hash requires wire format v2\n");
+            return 1;
+        }
+        file_hash_type = FILE_HASH_HASH64;
+    }
+    else if (strcmp(file_hash_arg, "auto") != 0)
+    {
+        fprintf(stderr, "Unknown file hash: %s\n", file_hash_arg);
         return 1;
     }
 
-    const char *filename = argv[1];
-    uint16_t file_id = (argc >= 3) ? atoi(argv[2]) : 1;
+    const char *filename = argv[optind];
+    uint16_t file_id = (optind + 1 < argc) ? atoi(argv[optind + 1]) : 1;
 
     // 禁用输出缓冲，确保日志立即写入
     setbuf(stdout, NULL);
     setbuf(stderr, NULL);
 
-    // 初始化随机数种子（用于丢包模拟）
-    srand(time(NULL));
-
     printf("========================================\n");
     printf("  UAV File Broadcast Master\n");
     printf("========================================\n");
-#if SIMULATE_PACKET_LOSS > 0
-    printf("  ⚠️  Packet Loss Simulation: %d%%\n", SIMULATE_PACKET_LOSS);
+    if (rate_kbps > 0)
+    {
+        printf("  Send rate: %llu kbit/s (burst %u bytes)\n", (unsigned long long)rate_kbps, burst_bytes);
+    }
+    else
+    {
+        printf("  Send rate: unlimited\n");
+    }
     printf("========================================\n");
-#endif
     fflush(stdout);
 
+    sim.node_id = 0; // Master固定为0号节点
+    transport_set_sim(&sim);
+    // 缓冲区按选定的块大小分配（巨帧时才按巨帧分配）
+    transport_set_packet_size(packet_size_for_chunk(g_chunk_size));
+    // 重传缓存长期持有报文，缓冲池相应扩容
+    transport_reserve_packets(retrans_cache_init(retrans_cache_kb));
+
     // 初始化传输层 (Master 既发送数据也接收NACK，需要加入组播组)
-    if (!transport_init(false))
+    bool transport_ok = g_event_loop ? transport_init_event_loop(false, handle_nack_packet, NULL)
+                                     : transport_init_backend(backend, false);
+    if (!transport_ok)
     {
         fprintf(stderr, "Failed to initialize transport layer\n");
         return 1;
     }
+    printf("[Master] Transport: %s\n", transport_backend_name());
+    transport_set_pacing(rate_kbps * 1000, burst_bytes);
+
+    // 应答通知使用单调时钟计算超时
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&g_response_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
 
     // 初始化会话
-    if (!init_master_session(filename, file_id))
+    if (!init_master_session(filename, file_id, wire_version, checksum_type, file_hash_type))
+    {
+        cleanup_master_session();
+        return 1;
+    }
+
+    // 启动数据块准备流水线：会话启动期间即开始预读前几个窗口
+    if (g_pipeline && !g_event_loop && !g_session.streaming && !chunk_pipeline_start())
     {
         cleanup_master_session();
         return 1;
     }
 
-    // 启动NACK接收线程
-    pthread_t nack_thread;
-    pthread_create(&nack_thread, NULL, nack_receiver_thread, NULL);
-    pthread_detach(nack_thread);
+    // 启动NACK接收线程（事件循环模式下NACK在等待期间由事件循环处理）
+    if (!g_event_loop)
+    {
+        pthread_t nack_thread;
+        pthread_create(&nack_thread, NULL, nack_receiver_thread, NULL);
+        pthread_detach(nack_thread);
+    }
 
-    sleep(1);
+    master_wait_ms(1000);
 
     // 阶段1: 会话启动
     send_session_announce();
-    sleep(1);
+    master_wait_ms(1000);
 
-    // 阶段2-4: 逐窗口广播和重传
-    window_by_window_transmission();
-    sleep(1);
+    // 阶段2-4: 逐窗口（或多窗口滑动）广播和重传（流式会话边读边发）
+    uint64_t transmission_start_ns = get_monotonic_ns();
+    if (g_session.streaming)
+    {
+        stream_transmission();
+    }
+    else if (g_inflight > 1)
+    {
+        sliding_window_transmission();
+    }
+    else
+    {
+        window_by_window_transmission();
+    }
+    if (g_inflight > 1)
+    {
+        printf("[Master] Transmission time: %.3f s (%u windows, sliding window, %u in flight)\n",
+               (get_monotonic_ns() - transmission_start_ns) / 1e9, g_session.total_windows, g_inflight);
+    }
+    else
+    {
+        printf("[Master] Transmission time: %.3f s (%u windows, stop-and-wait)\n",
+               (get_monotonic_ns() - transmission_start_ns) / 1e9, g_session.total_windows);
+    }
+    if (g_nack_rtt.samples > 0)
+    {
+        printf("[Master] NACK RTT: srtt %.1f ms, rttvar %.1f ms, min/max %.1f/%.1f ms over %llu samples, "
+               "response timeout %.1f ms\n",
+               g_nack_rtt.srtt_ns / 1e6, g_nack_rtt.rttvar_ns / 1e6, g_nack_rtt.min_ns / 1e6, g_nack_rtt.max_ns / 1e6,
+               (unsigned long long)g_nack_rtt.samples, nack_rto_ns() / 1e6);
+    }
+    if (g_fec)
+    {
+        printf("[Master] FEC (%s): %llu proactive repair symbols, %llu repair symbols for NACKs "
+               "(%llu fewer packets than retransmitting the missing chunks)\n",
+               gf256_impl_name(), (unsigned long long)g_fec_stats.proactive, (unsigned long long)g_fec_stats.on_nack,
+               (unsigned long long)g_fec_stats.chunks_saved);
+    }
+    master_wait_ms(1000);
 
     // 阶段5: 结束
     send_end_message();
@@ -449,7 +2163,7 @@ int main(int argc, char *argv[])
     printf("[Master] All phases completed. Press Ctrl+C to exit.\n");
 
     // 保持运行以继续处理延迟的NACK
-    sleep(5);
+    master_wait_ms(5000);
 
     cleanup_master_session();
     return 0;
@@ -1,8 +1,14 @@
 #include "broadcast_protocol.h"
 
-static ReceiverSession g_session;
-static uint8_t g_uav_id = 0;
-static pthread_mutex_t g_session_mutex = PTHREAD_MUTEX_INITIALIZER;
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+static bool g_event_loop = false; // 单线程事件循环模式（NACK退避使用timerfd定时器，不创建线程，块在接收路径上直接写盘）
+static uint32_t g_max_chunk_size = DEFAULT_CHUNK_SIZE; // 报文缓冲区能容纳的最大块（按本机路径MTU或--mtu）
 
 // NACK抑制相关
 typedef struct
@@ -10,169 +16,1351 @@ typedef struct
     bool active;
     uint32_t window_id;
     uint16_t round_id;
-    uint64_t my_missing_bitmap;
+    uint64_t my_missing_bitmap[MAX_WINDOW_WORDS];
     uint64_t pending_timeout_ms;
-    pthread_t timer_thread;
+    uint32_t generation; // 每次调度NACK递增，退避线程醒来时据此判断自己是否已被新的调度取代
+    int timer_id; // 事件循环模式下的退避定时器
     bool suppressed;
+    bool need_digest; // 窗口已收齐但没有窗口摘要，NACK中请求重发
 } NackContext;
 
-static NackContext g_nack_ctx;
-static pthread_mutex_t g_nack_mutex = PTHREAD_MUTEX_INITIALIZER;
+// 一个虚拟UAV：会话状态与NACK退避状态
+// 同一进程内的多个UAV共享传输层（一个socket、一条Rx路径），收到的报文解码一次后分发给每个UAV
+typedef struct
+{
+    uint8_t uav_id;
+    ReceiverSession session;
+    pthread_mutex_t session_mutex;
+    NackContext nack;
+    pthread_mutex_t nack_mutex;
+    unsigned int rand_seed; // NACK退避随机数（rand_r，各UAV独立）
+    struct WriteStage *stage; // 正在暂存的写盘批次（session_mutex保护）
+    int writes_pending;       // 已提交给写盘线程、尚未写完的批次数（g_writer.mutex保护）
+    uint64_t write_batches;   // 写盘统计：批次数、pwritev次数、字节数
+    uint64_t write_calls;
+    uint64_t write_bytes;
+    uint64_t fec_symbols;   // 收到的修复符号数
+    uint64_t fec_recovered; // 由修复符号恢复的块数
+} ReceiverNode;
+
+static ReceiverNode *g_nodes;
+static int g_node_count = 1;
+
+// ========== 前向纠错 ==========
+// 编码块已收到的修复符号，缺失块数不超过符号数时立即解码恢复（WindowState.repairs[组号]，按需分配）
+typedef struct FecRepairSet
+{
+    uint32_t count;
+    uint16_t symbol_len;
+    uint16_t last_len;
+    uint8_t index[WINDOW_SIZE];
+    uint8_t data[]; // 各符号数据，间隔symbol_len字节（按编码块的源块数分配）
+} FecRepairSet;
+
+// ========== 断点续传 ==========
+// 旁路文件 received_uav<ID>_<文件名>.resume：记录会话标识与各窗口已写入输出文件的块位图，mmap映射。
+// 位图与ReceiverSession.bitmaps布局相同（每窗口window_words个字），写盘批次按字号更新。
+// 写盘线程写完一批块后更新映射中的位图（只写内存，由内核回写，不按块fsync）；
+// 接收端重启后收到同一文件的SESSION_ANNOUNCE时据此恢复窗口状态，只NACK真正缺失的块。传输成功后删除
+#define RESUME_MAGIC 0x55415652u // "UAVR"
+#define RESUME_VERSION 2 // v2: 每窗口window_words个位图字（v1每窗口固定1个字）
+
+typedef struct ResumeHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t file_id;
+    uint32_t total_chunks;
+    uint32_t chunk_size;
+    uint16_t window_size;
+    uint8_t reserved[6];
+    uint64_t merkle_root; // 文件内容摘要（Merkle根，未启用Merkle时为0）
+    uint64_t bitmaps[];   // 各窗口已写入输出文件的块（每窗口window_words个字）
+} ResumeHeader;
+
+// ========== 批量写盘 ==========
+// 收到的块先按位图字（窗口内每64块一组）暂存，窗口收齐（或暂存字节数达到阈值、或开始暂存另一组）时
+// 整批交给写盘线程，连续的块用一次pwritev写出；接收路径不再直接等待磁盘
+typedef enum
+{
+    FSYNC_NONE,   // 不主动同步
+    FSYNC_END,    // 收齐并通过hash校验后、报告成功前同步一次
+    FSYNC_WINDOW, // 每个窗口写完后同步
+} FsyncPolicy;
+
+#define WRITE_STAGE_SLOTS 64 // 每批最多暂存一组（对应窗口位图的一个字）
+
+typedef struct WriteStage
+{
+    struct WriteStage *next;
+    ReceiverNode *node;
+    int fd;
+    uint32_t block_id;      // 位图字号（窗口号 * window_words + 窗口内的组号）
+    uint32_t first_chunk;   // 本组第一块的块号
+    uint64_t staged_bitmap; // 已暂存的块
+    size_t staged_bytes;
+    bool window_complete;   // 窗口已收齐（FSYNC_WINDOW时写完后同步）
+    uint32_t chunk_size;    // 会话的块大小（暂存槽位间隔）
+    uint32_t capacity;      // 分配时每个槽位的容量（复用时不小于chunk_size）
+    uint16_t lens[WRITE_STAGE_SLOTS];
+    uint8_t data[]; // WRITE_STAGE_SLOTS个槽位
+} WriteStage;
+
+static struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t work; // 队列中有待写批次（或要求退出）
+    pthread_cond_t done; // 有批次写完
+    WriteStage *head;
+    WriteStage *tail;
+    WriteStage *writing;   // 正在写入的批次，写完前其数据仍可供hash读回
+    WriteStage *free_list; // 写完的批次缓冲区，循环使用
+    int queued;
+    bool running;
+    bool stop;
+    pthread_t thread;
+} g_writer = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static size_t g_write_batch_bytes = 0; // 暂存字节数阈值（--write-batch），0表示按整窗口
+static FsyncPolicy g_fsync_policy = FSYNC_END;
+
+static WriteStage *stage_alloc(uint32_t chunk_size)
+{
+    pthread_mutex_lock(&g_writer.mutex);
+    WriteStage *stage = g_writer.free_list;
+    if (stage)
+    {
+        g_writer.free_list = stage->next;
+    }
+    pthread_mutex_unlock(&g_writer.mutex);
+
+    // 换成更大块的会话后，旧会话留下的缓冲区容纳不下
+    if (stage && stage->capacity < chunk_size)
+    {
+        free(stage);
+        stage = NULL;
+    }
+    if (!stage)
+    {
+        stage = malloc(sizeof(WriteStage) + (size_t)WRITE_STAGE_SLOTS * chunk_size);
+        if (!stage)
+        {
+            perror("Failed to allocate write stage");
+            return NULL;
+        }
+        stage->capacity = chunk_size;
+    }
+    stage->chunk_size = chunk_size;
+    stage->next = NULL;
+    stage->staged_bitmap = 0;
+    stage->staged_bytes = 0;
+    stage->window_complete = false;
+    return stage;
+}
+
+// 写出iov中的全部数据（处理部分写入）
+static bool pwritev_all(int fd, struct iovec *iov, int iovcnt, off_t offset)
+{
+    while (iovcnt > 0)
+    {
+        ssize_t n = pwritev(fd, iov, iovcnt, offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        offset += n;
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+// 把一批暂存块写入输出文件：文件中连续的一段块（前面的块都是满块）合成一次pwritev
+static void stage_write(WriteStage *stage)
+{
+    ReceiverNode *node = stage->node;
+    struct iovec iov[WRITE_STAGE_SLOTS];
+    uint64_t calls = 0;
+
+    int slot = 0;
+    while (slot < WRITE_STAGE_SLOTS)
+    {
+        if (!((stage->staged_bitmap >> slot) & 1))
+        {
+            slot++;
+            continue;
+        }
+
+        int start = slot;
+        int iovcnt = 0;
+        while (slot < WRITE_STAGE_SLOTS && ((stage->staged_bitmap >> slot) & 1))
+        {
+            iov[iovcnt].iov_base = stage->data + (size_t)slot * stage->chunk_size;
+            iov[iovcnt].iov_len = stage->lens[slot];
+            iovcnt++;
+            slot++;
+            if (stage->lens[slot - 1] < stage->chunk_size)
+            {
+                break; // 短块之后的数据在文件中不连续
+            }
+        }
+
+        if (!pwritev_all(stage->fd, iov, iovcnt, (off_t)(stage->first_chunk + start) * stage->chunk_size))
+        {
+            perror("Failed to write chunks");
+        }
+        calls++;
+    }
+
+    if (stage->window_complete && g_fsync_policy == FSYNC_WINDOW)
+    {
+        fdatasync(stage->fd);
+    }
+
+    // 块写入输出文件后才记入旁路位图，重启时位图中的块一定已在文件中
+    ResumeHeader *resume = node->session.resume;
+    if (resume)
+    {
+        resume->bitmaps[stage->block_id] |= stage->staged_bitmap;
+        if (stage->window_complete && g_fsync_policy == FSYNC_WINDOW)
+        {
+            // 数据已同步，再同步位图所在的页
+            uintptr_t page = (uintptr_t)&resume->bitmaps[stage->block_id] & ~((uintptr_t)sysconf(_SC_PAGESIZE) - 1);
+            msync((void *)page, sizeof(uint64_t), MS_SYNC);
+        }
+    }
+
+    node->write_batches++;
+    node->write_calls += calls;
+    node->write_bytes += stage->staged_bytes;
+}
+
+// ========== 写盘线程 ==========
+static void *writer_thread(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&g_writer.mutex);
+    while (1)
+    {
+        while (!g_writer.head && !g_writer.stop)
+        {
+            pthread_cond_wait(&g_writer.work, &g_writer.mutex);
+        }
+        if (!g_writer.head)
+        {
+            break;
+        }
+
+        WriteStage *stage = g_writer.head;
+        g_writer.head = stage->next;
+        if (!g_writer.head)
+        {
+            g_writer.tail = NULL;
+        }
+        g_writer.queued--;
+        g_writer.writing = stage;
+        pthread_mutex_unlock(&g_writer.mutex);
+
+        stage_write(stage);
+
+        pthread_mutex_lock(&g_writer.mutex);
+        g_writer.writing = NULL;
+        stage->node->writes_pending--;
+        stage->next = g_writer.free_list;
+        g_writer.free_list = stage;
+        pthread_cond_broadcast(&g_writer.done);
+    }
+    pthread_mutex_unlock(&g_writer.mutex);
+    return NULL;
+}
+
+static void writer_start(void)
+{
+    g_writer.stop = false;
+    if (pthread_create(&g_writer.thread, NULL, writer_thread, NULL) != 0)
+    {
+        perror("Failed to start writer thread");
+        return; // 退回在接收路径上直接写盘
+    }
+    g_writer.running = true;
+}
+
+static void writer_stop(void)
+{
+    if (!g_writer.running)
+    {
+        return;
+    }
+    pthread_mutex_lock(&g_writer.mutex);
+    g_writer.stop = true;
+    pthread_cond_signal(&g_writer.work);
+    pthread_mutex_unlock(&g_writer.mutex);
+    pthread_join(g_writer.thread, NULL);
+    g_writer.running = false;
+
+    while (g_writer.free_list)
+    {
+        WriteStage *stage = g_writer.free_list;
+        g_writer.free_list = stage->next;
+        free(stage);
+    }
+}
+
+// 把节点当前的暂存批次交给写盘线程（队列满时等待）；调用者持有session_mutex
+static void stage_submit(ReceiverNode *node)
+{
+    WriteStage *stage = node->stage;
+    if (!stage)
+    {
+        return;
+    }
+    node->stage = NULL;
+
+    if (!g_writer.running)
+    {
+        // 事件循环模式：单线程运行，直接写盘
+        stage_write(stage);
+        pthread_mutex_lock(&g_writer.mutex);
+        stage->next = g_writer.free_list;
+        g_writer.free_list = stage;
+        pthread_mutex_unlock(&g_writer.mutex);
+        return;
+    }
+
+    pthread_mutex_lock(&g_writer.mutex);
+    while (g_writer.queued >= WRITE_QUEUE_MAX)
+    {
+        pthread_cond_wait(&g_writer.done, &g_writer.mutex);
+    }
+    if (g_writer.tail)
+    {
+        g_writer.tail->next = stage;
+    }
+    else
+    {
+        g_writer.head = stage;
+    }
+    g_writer.tail = stage;
+    g_writer.queued++;
+    node->writes_pending++;
+    pthread_cond_signal(&g_writer.work);
+    pthread_mutex_unlock(&g_writer.mutex);
+}
+
+// 块所在的位图字号与字内位置
+static uint32_t chunk_block(const ReceiverSession *session, uint32_t chunk_id, uint32_t *slot)
+{
+    uint32_t offset = chunk_id % session->window_size;
+    *slot = offset % 64;
+    return chunk_id / session->window_size * session->window_words + offset / 64;
+}
+
+// 把块暂存到所属组的批次中；暂存的是另一组时先提交旧批次。调用者持有session_mutex
+static bool stage_chunk(ReceiverNode *node, const DataChunk *chunk)
+{
+    ReceiverSession *session = &node->session;
+    uint32_t slot;
+    uint32_t block_id = chunk_block(session, chunk->chunk_id, &slot);
+
+    if (node->stage && node->stage->block_id != block_id)
+    {
+        stage_submit(node);
+    }
+    if (!node->stage)
+    {
+        node->stage = stage_alloc(session->chunk_size);
+        if (!node->stage)
+        {
+            return false;
+        }
+        node->stage->node = node;
+        node->stage->fd = session->output_fd;
+        node->stage->block_id = block_id;
+        node->stage->first_chunk = chunk->chunk_id - slot;
+    }
+
+    WriteStage *stage = node->stage;
+    memcpy(stage->data + (size_t)slot * stage->chunk_size, chunk->data, chunk->data_len);
+    stage->lens[slot] = chunk->data_len;
+    stage->staged_bitmap |= 1ULL << slot;
+    stage->staged_bytes += chunk->data_len;
+    return true;
+}
+
+// 窗口收齐后提交该窗口的批次，或暂存字节数达到--write-batch阈值时提前提交；调用者持有session_mutex
+static void stage_flush(ReceiverNode *node, uint32_t window_id, bool window_complete)
+{
+    WriteStage *stage = node->stage;
+    if (!stage || stage->block_id / node->session.window_words != window_id)
+    {
+        return;
+    }
+
+    // 默认按整窗口（大窗口时按整组）提交
+    uint32_t slots = node->session.window_size < WRITE_STAGE_SLOTS ? node->session.window_size : WRITE_STAGE_SLOTS;
+    size_t threshold = g_write_batch_bytes ? g_write_batch_bytes : (size_t)slots * node->session.chunk_size;
+    if (window_complete || stage->staged_bytes >= threshold)
+    {
+        stage->window_complete = window_complete;
+        stage_submit(node);
+    }
+}
+
+// 窗口因摘要不一致被重置时丢弃其暂存块（已提交的旧数据会被修复后的数据覆盖）；调用者持有session_mutex
+static void stage_drop_window(ReceiverNode *node, uint32_t window_id)
+{
+    WriteStage *stage = node->stage;
+    if (stage && stage->block_id / node->session.window_words == window_id)
+    {
+        node->stage = NULL;
+        pthread_mutex_lock(&g_writer.mutex);
+        stage->next = g_writer.free_list;
+        g_writer.free_list = stage;
+        pthread_mutex_unlock(&g_writer.mutex);
+    }
+}
+
+static bool stage_has_chunk(const WriteStage *stage, const ReceiverNode *node, uint32_t block_id, uint32_t slot)
+{
+    return stage && stage->node == node && stage->block_id == block_id && ((stage->staged_bitmap >> slot) & 1);
+}
+
+// 从尚未落盘的批次中取块数据（后提交的批次较新）；调用者持有session_mutex
+static bool stage_read_chunk(ReceiverNode *node, uint32_t chunk_id, uint8_t *buffer, size_t len)
+{
+    uint32_t slot;
+    uint32_t block_id = chunk_block(&node->session, chunk_id, &slot);
+
+    if (stage_has_chunk(node->stage, node, block_id, slot))
+    {
+        memcpy(buffer, node->stage->data + (size_t)slot * node->stage->chunk_size, len);
+        return true;
+    }
+
+    pthread_mutex_lock(&g_writer.mutex);
+    const WriteStage *found = stage_has_chunk(g_writer.writing, node, block_id, slot) ? g_writer.writing : NULL;
+    for (const WriteStage *stage = g_writer.head; stage; stage = stage->next)
+    {
+        if (stage_has_chunk(stage, node, block_id, slot))
+        {
+            found = stage;
+        }
+    }
+    if (found)
+    {
+        memcpy(buffer, found->data + (size_t)slot * found->chunk_size, len);
+    }
+    pthread_mutex_unlock(&g_writer.mutex);
+    return found != NULL;
+}
+
+// 提交暂存批次并等待该节点的全部写入完成；调用者持有session_mutex
+static void stage_drain(ReceiverNode *node)
+{
+    stage_submit(node);
+
+    pthread_mutex_lock(&g_writer.mutex);
+    while (node->writes_pending > 0)
+    {
+        pthread_cond_wait(&g_writer.done, &g_writer.mutex);
+    }
+    pthread_mutex_unlock(&g_writer.mutex);
+}
+
+// 关闭输出文件与旁路文件映射（先写完暂存数据）；调用者持有session_mutex或接收已停止
+static void close_output(ReceiverNode *node)
+{
+    if (node->session.output_fd >= 0)
+    {
+        stage_drain(node);
+        close(node->session.output_fd);
+        node->session.output_fd = -1;
+    }
+    if (node->session.resume)
+    {
+        munmap(node->session.resume, node->session.resume_len);
+        node->session.resume = NULL;
+    }
+}
+
+static void resume_path(const ReceiverNode *node, char *path, size_t len)
+{
+    snprintf(path, len, "received_uav%u_%s.resume", node->uav_id, node->session.filename);
+}
+
+// 映射旁路文件：已有旁路文件与本会话一致（文件ID、块数、块大小、窗口大小、Merkle根）时返回true（续传），
+// 否则重新初始化为空位图。失败时session.resume为NULL，会话照常进行但不支持续传
+static bool resume_open(ReceiverNode *node)
+{
+    ReceiverSession *session = &node->session;
+    char path[160];
+    resume_path(node, path, sizeof(path));
+
+    size_t len = sizeof(ResumeHeader) + (size_t)session->total_windows * session->window_words * sizeof(uint64_t);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        perror("Failed to open resume file");
+        return false;
+    }
+
+    struct stat st;
+    bool existing = fstat(fd, &st) == 0 && (size_t)st.st_size == len;
+    if (!existing && (ftruncate(fd, 0) != 0 || ftruncate(fd, len) != 0))
+    {
+        perror("Failed to size resume file");
+        close(fd);
+        return false;
+    }
+    ResumeHeader *resume = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (resume == MAP_FAILED)
+    {
+        perror("Failed to map resume file");
+        return false;
+    }
+
+    bool match = existing && resume->magic == RESUME_MAGIC && resume->version == RESUME_VERSION &&
+                 resume->file_id == session->file_id && resume->total_chunks == session->total_chunks &&
+                 resume->chunk_size == session->chunk_size && resume->window_size == session->window_size &&
+                 resume->merkle_root == (session->merkle_enabled ? session->merkle_root : 0);
+    if (!match)
+    {
+        memset(resume, 0, len);
+        resume->magic = RESUME_MAGIC;
+        resume->version = RESUME_VERSION;
+        resume->file_id = session->file_id;
+        resume->total_chunks = session->total_chunks;
+        resume->chunk_size = session->chunk_size;
+        resume->window_size = session->window_size;
+        resume->merkle_root = session->merkle_enabled ? session->merkle_root : 0;
+    }
+
+    session->resume = resume;
+    session->resume_len = len;
+    return match;
+}
+
+// 传输成功后删除旁路文件；调用者持有session_mutex
+static void resume_remove(ReceiverNode *node)
+{
+    if (!node->session.resume)
+    {
+        return;
+    }
+    munmap(node->session.resume, node->session.resume_len);
+    node->session.resume = NULL;
+
+    char path[160];
+    resume_path(node, path, sizeof(path));
+    unlink(path);
+}
+
+static void resume_restore(ReceiverNode *node);
+
+// ========== 初始化接收方会话 ==========
+bool init_receiver_session(ReceiverNode *node, const SessionAnnounce *announce)
+{
+    pthread_mutex_lock(&node->session_mutex);
+
+    // 检查是否已有会话
+    if (node->session.session_active && node->session.file_id == announce->file_id)
+    {
+        pthread_mutex_unlock(&node->session_mutex);
+        return true; // 会话已存在
+    }
+    if (announce->window_size == 0 || announce->window_size > MAX_WINDOW_SIZE)
+    {
+        printf("[UAV %u] Unsupported window size %u in SESSION_ANNOUNCE, ignored.\n", node->uav_id,
+               announce->window_size);
+        pthread_mutex_unlock(&node->session_mutex);
+        return false;
+    }
+    if (announce->chunk_size == 0 || announce->chunk_size > g_max_chunk_size)
+    {
+        printf("[UAV %u] Chunk size %u in SESSION_ANNOUNCE exceeds this receiver's %u-byte buffers "
+               "(raise --mtu), ignored.\n",
+               node->uav_id, announce->chunk_size, g_max_chunk_size);
+        pthread_mutex_unlock(&node->session_mutex);
+        return false;
+    }
+
+    // 新会话替换旧会话前写完旧文件的暂存数据
+    close_output(node);
+
+    memset(&node->session, 0, sizeof(node->session));
+    node->session.output_fd = -1;
+    node->write_batches = 0;
+    node->write_calls = 0;
+    node->write_bytes = 0;
+    node->fec_symbols = 0;
+    node->fec_recovered = 0;
+
+    node->session.file_id = announce->file_id;
+    node->session.total_chunks = announce->total_chunks;
+    node->session.window_size = announce->window_size;
+    node->session.window_words = (announce->window_size + 63) / 64;
+    node->session.chunk_size = announce->chunk_size;
+    strncpy(node->session.filename, announce->filename, sizeof(node->session.filename) - 1);
+    node->session.wire_version = WIRE_GET_VERSION(announce->header.ver_flags); // 后续NACK使用与Master相同的格式
+    node->session.checksum_type =
+        (WIRE_GET_FLAGS(announce->header.ver_flags) & WIRE_FLAG_CRC32C) ? CHECKSUM_CRC32C : CHECKSUM_CRC16;
+    node->session.merkle_enabled = (WIRE_GET_FLAGS(announce->header.ver_flags) & WIRE_FLAG_MERKLE) != 0;
+    node->session.merkle_root = announce->merkle_root;
+    FileHashType hash_type =
+        (WIRE_GET_FLAGS(announce->header.ver_flags) & WIRE_FLAG_HASH64) ? FILE_HASH_HASH64 : FILE_HASH_FNV1A32;
+    // 流式会话：总块数未知，窗口状态随数据到达扩容，END（或带总块数的STATUS_REQ）确定总块数
+    node->session.streaming = (WIRE_GET_FLAGS(announce->header.ver_flags) & WIRE_FLAG_STREAM) != 0;
+    node->session.total_final = !node->session.streaming;
+    if (node->session.streaming)
+    {
+        node->session.total_chunks = 0;
+        node->session.merkle_enabled = false;
+        node->session.last_chunk_len = node->session.chunk_size; // 只有最后一块可能不满，收到短块时更新
+    }
+    node->session.total_windows = (node->session.total_chunks + node->session.window_size - 1) / node->session.window_size;
+
+    // 分配窗口状态数组
+    size_t window_count = node->session.total_windows ? node->session.total_windows : 1;
+    node->session.windows = calloc(window_count, sizeof(WindowState));
+    node->session.bitmaps = calloc(window_count * node->session.window_words, sizeof(uint64_t));
+    if (!node->session.windows || !node->session.bitmaps)
+    {
+        perror("Failed to allocate window states");
+        pthread_mutex_unlock(&node->session_mutex);
+        return false;
+    }
+
+    // 初始化窗口状态（不再需要缓冲区，改为立即写入文件）
+    for (uint32_t i = 0; i < node->session.total_windows; i++)
+    {
+        node->session.windows[i].window_id = i;
+        node->session.windows[i].completed = false;
+        // node->session.windows[i].data_buffer = NULL; // 不再需要缓冲区
+    }
+
+    // 只有Merkle校验失败时才需要回退流式hash
+    if (node->session.merkle_enabled)
+    {
+        node->session.hash_checkpoints = calloc(node->session.total_windows, sizeof(FileHasher));
+        if (!node->session.hash_checkpoints)
+        {
+            perror("Failed to allocate hash checkpoints");
+            pthread_mutex_unlock(&node->session_mutex);
+            return false;
+        }
+    }
+
+    // 打开输出文件（每个UAV使用独立的文件名）
+    char output_filename[128];
+    snprintf(output_filename, sizeof(output_filename), "received_uav%u_%s", node->uav_id, node->session.filename);
+    // 启用Merkle的非流式会话先映射断点续传旁路文件，与本会话一致时保留输出文件中已写入的块
+    // （恢复的窗口会按窗口摘要重新校验；没有Merkle根时旁路文件无法可靠识别文件内容，不续传）
+    bool resumed = !node->session.streaming && node->session.merkle_enabled && resume_open(node);
+    node->session.output_fd = open(output_filename, O_RDWR | O_CREAT | (resumed ? 0 : O_TRUNC), 0644); // 可读：乱序块计入hash时需读回
+    if (node->session.output_fd < 0)
+    {
+        perror("Failed to open output file");
+        pthread_mutex_unlock(&node->session_mutex);
+        return false;
+    }
+    // 按总块数预分配磁盘空间（不改变文件长度），减少乱序写入造成的碎片；文件系统不支持时忽略
+    if (node->session.total_chunks > 0 &&
+        fallocate(node->session.output_fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)node->session.total_chunks * node->session.chunk_size) != 0 &&
+        errno != EOPNOTSUPP)
+    {
+        perror("Failed to preallocate output file");
+    }
+
+    node->session.session_active = true;
+    node->session.received_chunks = 0;
+    file_hasher_init(&node->session.file_hash, hash_type);
+    node->session.hashed_chunks = 0;
+    if (resumed)
+    {
+        resume_restore(node);
+    }
+
+    printf("[UAV %u] Session initialized:\n", node->uav_id);
+    printf("  File: %s\n", node->session.filename);
+    if (node->session.streaming)
+    {
+        printf("  Total chunks: unknown (streaming)\n");
+    }
+    else
+    {
+        printf("  Total chunks: %u\n", node->session.total_chunks);
+        printf("  Total windows: %u\n", node->session.total_windows);
+    }
+    printf("  Window size: %u chunks\n", node->session.window_size);
+    printf("  Chunk size: %u bytes\n", node->session.chunk_size);
+    printf("  Wire format: v%u\n", node->session.wire_version);
+    printf("  File hash: %s\n", file_hash_name(hash_type));
+    if (node->session.merkle_enabled)
+    {
+        printf("  Merkle root: 0x%016llX\n", (unsigned long long)node->session.merkle_root);
+    }
+    printf("  Checksum: %s\n", node->session.checksum_type == CHECKSUM_CRC32C
+                                   ? (crc32c_hw_available() ? "CRC32C (hardware)" : "CRC32C (software)")
+                                   : "CRC16");
+    printf("  Output: %s\n", output_filename);
+    if (resumed)
+    {
+        printf("  Resumed: %u/%u chunks already on disk\n", node->session.received_chunks, node->session.total_chunks);
+    }
+
+    pthread_mutex_unlock(&node->session_mutex);
+    return true;
+}
+
+// 取回已收到的块：尚未落盘的取自暂存批次，否则从输出文件读回；调用者持有session_mutex
+static bool load_chunk(ReceiverNode *node, uint32_t chunk_id, uint8_t *buffer, size_t len)
+{
+    if (stage_read_chunk(node, chunk_id, buffer, len))
+    {
+        return true;
+    }
+    return pread(node->session.output_fd, buffer, len, (off_t)chunk_id * node->session.chunk_size) == (ssize_t)len;
+}
+
+// 窗口已收到的块（window_words个字）
+static uint64_t *window_bitmap(const ReceiverSession *session, uint32_t window_id)
+{
+    return session->bitmaps + (size_t)window_id * session->window_words;
+}
+
+// ========== 流式文件hash ==========
+// 块chunk_id是否已收到
+static bool chunk_received(const ReceiverSession *session, uint32_t chunk_id)
+{
+    return bitmap_test(window_bitmap(session, chunk_id / session->window_size), chunk_id % session->window_size);
+}
+
+// 把第hashed_chunks块计入流式hash；经过窗口起点时记下当时的hash，窗口修复时据此回退
+static void hash_next_chunk(ReceiverSession *session, const uint8_t *data, size_t len)
+{
+    if (session->hash_checkpoints && session->hashed_chunks % session->window_size == 0)
+    {
+        session->hash_checkpoints[session->hashed_chunks / session->window_size] = session->file_hash;
+    }
+    file_hasher_update(&session->file_hash, data, len);
+    session->hashed_chunks++;
+}
+
+// 把连续前缀之后已乱序到达的块依次计入hash（取自尚未落盘的暂存批次，或从输出文件读回，通常命中页缓存）。
+// 流式会话总块数未确定前，已分配窗口内的块都是满块；调用者持有session_mutex
+static void catch_up_file_hash(ReceiverNode *node)
+{
+    ReceiverSession *session = &node->session;
+    uint32_t limit = session->total_final ? session->total_chunks : session->total_windows * session->window_size;
+
+    uint8_t buffer[MAX_CHUNK_SIZE];
+    while (session->hashed_chunks < limit && chunk_received(session, session->hashed_chunks))
+    {
+        uint32_t chunk_id = session->hashed_chunks;
+        size_t len = (session->total_final && chunk_id == session->total_chunks - 1) ? session->last_chunk_len
+                                                                                       : session->chunk_size;
+        if (!load_chunk(node, chunk_id, buffer, len))
+        {
+            perror("Failed to read back chunk for hashing");
+            return;
+        }
+        hash_next_chunk(session, buffer, len);
+    }
+}
+
+// 刚收到的块正好补上连续前缀时，把它以及其后已乱序到达的块依次计入hash；调用者持有session_mutex
+static void advance_file_hash(ReceiverNode *node, const DataChunk *chunk)
+{
+    if (chunk->chunk_id != node->session.hashed_chunks)
+    {
+        return;
+    }
+
+    hash_next_chunk(&node->session, chunk->data, chunk->data_len);
+    catch_up_file_hash(node);
+}
+
+// ========== 窗口摘要校验 ==========
+static uint32_t window_chunk_count(const ReceiverSession *session, uint32_t window_id)
+{
+    uint32_t start_chunk = window_id * session->window_size;
+    if (start_chunk + session->window_size <= session->total_chunks || !session->total_final)
+    {
+        return session->window_size; // 流式会话在总块数确定前，窗口按满窗口计
+    }
+    return session->total_chunks > start_chunk ? session->total_chunks - start_chunk : 0;
+}
+
+// 窗口收齐且摘要已知时，比对各块hash算出的窗口摘要；不一致时丢弃整个窗口，
+// 下一次STATUS_REQ会NACK该窗口的全部数据块（只修复这一个窗口）。调用者持有session_mutex
+static void verify_window(ReceiverNode *node, uint32_t window_id)
+{
+    ReceiverSession *session = &node->session;
+    WindowState *window = &session->windows[window_id];
+    if (!window->completed || !window->digest_known || window->verified)
+    {
+        return;
+    }
+
+    uint64_t digest = merkle_window_digest(window->chunk_hashes, window_chunk_count(session, window_id));
+    if (digest == window->digest)
+    {
+        window->verified = true;
+        session->verified_windows++;
+        free(window->chunk_hashes);
+        window->chunk_hashes = NULL;
+        printf("[UAV %u] Window %u verified against Merkle root.\n", node->uav_id, window_id);
+        return;
+    }
+
+    printf("[UAV %u] ✗ Window %u digest mismatch (expected 0x%016llX, got 0x%016llX), requesting repair\n",
+           node->uav_id, window_id, (unsigned long long)window->digest, (unsigned long long)digest);
+    uint64_t *bitmap = window_bitmap(session, window_id);
+    session->received_chunks -= bitmap_popcount(bitmap, session->window_words);
+    memset(bitmap, 0, session->window_words * sizeof(uint64_t));
+    window->completed = false;
+    memset(window->chunk_hashes, 0, session->window_size * sizeof(uint64_t));
+    stage_drop_window(node, window_id);
+    if (session->resume)
+    {
+        // 等已提交的旧数据写完（写盘线程会把它们记入位图）后再清空该窗口的旁路位图
+        stage_drain(node);
+        memset(&session->resume->bitmaps[(size_t)window_id * session->window_words], 0,
+               session->window_words * sizeof(uint64_t));
+    }
+
+    // 流式文件hash已越过本窗口时回退到窗口起点，修复后重新计入
+    uint32_t start_chunk = window_id * session->window_size;
+    if (session->hashed_chunks > start_chunk)
+    {
+        session->hashed_chunks = start_chunk;
+        session->file_hash = session->hash_checkpoints[window_id];
+    }
+}
+
+// 释放窗口各编码块的修复符号
+static void fec_free_repairs(const ReceiverSession *session, WindowState *window)
+{
+    if (!window->repairs)
+    {
+        return;
+    }
+    for (uint32_t b = 0; b < session->window_words; b++)
+    {
+        free(window->repairs[b]);
+    }
+    free(window->repairs);
+    window->repairs = NULL;
+}
+
+// 整文件hash不一致：丢弃全部已收块与旁路文件，之后的STATUS_REQ会NACK全部数据块（重新获取）；
+// 调用者持有session_mutex
+static void reset_all_windows(ReceiverNode *node)
+{
+    ReceiverSession *session = &node->session;
+    stage_drain(node); // 已提交的批次写完（并记入旁路位图）后再删除旁路文件
+    resume_remove(node);
+    for (uint32_t i = 0; i < session->total_windows; i++)
+    {
+        WindowState *window = &session->windows[i];
+        fec_free_repairs(session, window);
+        free(window->chunk_hashes);
+        window->chunk_hashes = NULL;
+        window->completed = false;
+        window->verified = false; // 已知的窗口摘要仍然有效，重新收齐后再次校验
+    }
+    memset(session->bitmaps, 0, (size_t)session->total_windows * session->window_words * sizeof(uint64_t));
+    session->received_chunks = 0;
+    session->verified_windows = 0;
+    session->hashed_chunks = 0;
+    file_hasher_init(&session->file_hash, session->file_hash.type);
+}
+
+// 窗口的全部数据块都已收到时标记完成；调用者持有session_mutex
+static void check_window_complete(ReceiverNode *node, uint32_t window_id)
+{
+    WindowState *window = &node->session.windows[window_id];
+    uint32_t chunks_in_window = window_chunk_count(&node->session, window_id);
+
+    // 只会置位窗口内的块，置位数等于块数即收齐
+    if (!window->completed && chunks_in_window > 0 &&
+        bitmap_popcount(window_bitmap(&node->session, window_id), node->session.window_words) == chunks_in_window)
+    {
+        window->completed = true;
+
+        // 释放窗口缓冲区（数据已写入文件）
+        // if (window->data_buffer)
+        // {
+        //     free(window->data_buffer);
+        //     window->data_buffer = NULL;
+        // }
+
+        printf("[UAV %u] Window %u completed and saved.\n", node->uav_id, window_id);
+        fec_free_repairs(&node->session, window); // 多余的修复符号不再需要
+        verify_window(node, window_id);
+        if (window->completed)
+        {
+            stage_flush(node, window_id, true); // 摘要不一致时窗口已重置，等修复后再写
+        }
+    }
+}
+
+// ========== 流式会话 ==========
+// 窗口状态数组扩容到至少window_count个窗口；调用者持有session_mutex
+static bool ensure_windows(ReceiverSession *session, uint32_t window_count)
+{
+    if (window_count <= session->total_windows)
+    {
+        return true;
+    }
+
+    uint32_t capacity = session->total_windows ? session->total_windows : 16;
+    while (capacity < window_count)
+    {
+        capacity = capacity > UINT32_MAX / 2 ? window_count : capacity * 2; // 倍增溢出时按需分配
+    }
+    WindowState *windows = realloc(session->windows, capacity * sizeof(WindowState));
+    if (windows)
+    {
+        session->windows = windows;
+    }
+    size_t words = session->window_words;
+    uint64_t *bitmaps = windows ? realloc(session->bitmaps, capacity * words * sizeof(uint64_t)) : NULL;
+    if (!bitmaps)
+    {
+        perror("Failed to grow window states");
+        return false;
+    }
+    session->bitmaps = bitmaps;
+    memset(bitmaps + session->total_windows * words, 0, (capacity - session->total_windows) * words * sizeof(uint64_t));
+    memset(windows + session->total_windows, 0, (capacity - session->total_windows) * sizeof(WindowState));
+    for (uint32_t i = session->total_windows; i < capacity; i++)
+    {
+        windows[i].window_id = i;
+    }
+    session->windows = windows;
+    session->total_windows = capacity;
+    return true;
+}
+
+// 已知块数增加（或确定总块数）后：扩容窗口状态，最后一个窗口可能因此收齐，流式hash可能可以继续推进；
+// 调用者持有session_mutex
+static void stream_update_total(ReceiverNode *node, uint32_t total_chunks, bool final)
+{
+    ReceiverSession *session = &node->session;
+    if (!session->streaming || session->total_final || total_chunks < session->total_chunks)
+    {
+        return;
+    }
+    if (!ensure_windows(session, ((uint64_t)total_chunks + session->window_size - 1) / session->window_size))
+    {
+        return;
+    }
+
+    session->total_chunks = total_chunks;
+    session->total_final = final;
+    if (final)
+    {
+        printf("[UAV %u] Stream length fixed at %u chunks\n", node->uav_id, total_chunks);
+        if (total_chunks > 0)
+        {
+            check_window_complete(node, (total_chunks - 1) / session->window_size);
+        }
+        catch_up_file_hash(node);
+    }
+}
+
+// ========== 断点续传：恢复窗口状态 ==========
+// 按旁路位图恢复各窗口已收到的块（超出输出文件长度的块视为未写入），重新计算块hash与流式文件hash，
+// 收齐的窗口在摘要到达（NACK中请求）后照常校验；调用者持有session_mutex
+static void resume_restore(ReceiverNode *node)
+{
+    ReceiverSession *session = &node->session;
+    struct stat st;
+    off_t file_size = fstat(session->output_fd, &st) == 0 ? st.st_size : 0;
+
+    uint8_t buffer[MAX_CHUNK_SIZE];
+    for (uint32_t window_id = 0; window_id < session->total_windows; window_id++)
+    {
+        WindowState *window = &session->windows[window_id];
+        uint32_t start_chunk = window_id * session->window_size;
+        uint64_t *saved = &session->resume->bitmaps[(size_t)window_id * session->window_words];
+        uint64_t *bitmap = window_bitmap(session, window_id);
+        uint32_t count = window_chunk_count(session, window_id);
+
+        for (uint32_t i = bitmap_next_set(saved, 0, count); i < count; i = bitmap_next_set(saved, i + 1, count))
+        {
+            uint32_t chunk_id = start_chunk + i;
+            off_t offset = (off_t)chunk_id * session->chunk_size;
+            size_t len = session->chunk_size;
+            if (chunk_id == session->total_chunks - 1 && file_size > offset && file_size - offset <= (off_t)len)
+            {
+                len = file_size - offset; // 最后一块的长度由文件长度确定
+                session->last_chunk_len = len;
+            }
+            if (offset + (off_t)len > file_size)
+            {
+                continue;
+            }
+
+            if (session->merkle_enabled)
+            {
+                if (!window->chunk_hashes)
+                {
+                    window->chunk_hashes = calloc(session->window_size, sizeof(uint64_t));
+                }
+                if (!window->chunk_hashes || pread(session->output_fd, buffer, len, offset) != (ssize_t)len)
+                {
+                    continue;
+                }
+                window->chunk_hashes[i] = hash64(buffer, len);
+            }
+            bitmap_set(bitmap, i);
+            session->received_chunks++;
+        }
+
+        memcpy(saved, bitmap, session->window_words * sizeof(uint64_t));
+        check_window_complete(node, window_id);
+    }
+
+    catch_up_file_hash(node);
+}
+
+// ========== 处理窗口摘要（WINDOW_DIGEST） ==========
+void process_window_digest(ReceiverNode *node, const WindowDigestMessage *msg)
+{
+    if (msg->file_id != node->session.file_id || !node->session.session_active || !node->session.merkle_enabled)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&node->session_mutex);
+    ReceiverSession *session = &node->session;
+    if (msg->window_id >= session->total_windows || session->windows[msg->window_id].digest_known)
+    {
+        pthread_mutex_unlock(&node->session_mutex);
+        return;
+    }
+
+    uint64_t proof[MERKLE_MAX_DEPTH];
+    memcpy(proof, msg->proof, msg->proof_len * sizeof(uint64_t)); // packed结构体，复制到对齐的数组
+    if (!merkle_verify(session->merkle_root, session->total_windows, msg->window_id, msg->digest, proof,
+                       msg->proof_len))
+    {
+        printf("[UAV %u] Window %u digest does not match Merkle root, ignored.\n", node->uav_id, msg->window_id);
+        pthread_mutex_unlock(&node->session_mutex);
+        return;
+    }
+
+    WindowState *window = &session->windows[msg->window_id];
+    window->digest = msg->digest;
+    window->digest_known = true;
+    verify_window(node, msg->window_id);
+    pthread_mutex_unlock(&node->session_mutex);
+}
+
+// ========== 处理接收到的数据块 ==========
+static void fec_try_recover(ReceiverNode *node, uint32_t block_id);
+
+// 接收一个通过校验的数据块（网络收到或由修复符号恢复）；调用者持有session_mutex
+static void receive_chunk_locked(ReceiverNode *node, const DataChunk *chunk)
+{
+    // 流式会话在总块数确定前接受已知块数之后STREAM_BUFFER_WINDOWS个窗口内的块（窗口状态按需扩容），
+    // Master不会领先STATUS_REQ宣告的块数更多；按64位计算，块号接近UINT32_MAX时窗口数不会回绕
+    bool open_ended = node->session.streaming && !node->session.total_final;
+    uint32_t window_size = node->session.window_size;
+    uint64_t chunk_window = chunk->chunk_id / window_size;
+    uint64_t known_windows = ((uint64_t)node->session.total_chunks + window_size - 1) / window_size;
+    if (chunk->data_len > node->session.chunk_size ||
+        (!open_ended && chunk->chunk_id >= node->session.total_chunks) ||
+        (open_ended && (chunk_window >= known_windows + STREAM_BUFFER_WINDOWS || chunk_window + 1 > UINT32_MAX ||
+                        !ensure_windows(&node->session, (uint32_t)(chunk_window + 1)))))
+    {
+        return; // 超出范围（或长于会话块大小）
+    }
+
+    uint32_t window_id = chunk->chunk_id / node->session.window_size;
+    uint32_t chunk_offset = chunk->chunk_id % node->session.window_size;
+
+    WindowState *window = &node->session.windows[window_id];
+    uint64_t *bitmap = window_bitmap(&node->session, window_id);
+
+    // 检查是否已经收到过
+    if (bitmap_test(bitmap, chunk_offset))
+    {
+        return; // 已收到，跳过
+    }
+
+    // 记录块hash，窗口收齐后用于计算窗口摘要
+    if (node->session.merkle_enabled)
+    {
+        if (!window->chunk_hashes)
+        {
+            window->chunk_hashes = calloc(node->session.window_size, sizeof(uint64_t));
+            if (!window->chunk_hashes)
+            {
+                perror("Failed to allocate chunk hashes");
+                return;
+            }
+        }
+        window->chunk_hashes[chunk_offset] = hash64(chunk->data, chunk->data_len);
+    }
+
+    // 暂存到窗口批次，由写盘线程批量写入（不等待窗口完成）
+    if (!stage_chunk(node, chunk))
+    {
+        return; // 丢弃，等待重传
+    }
+
+    // 标记为已收到
+    bitmap_set(bitmap, chunk_offset);
+    node->session.received_chunks++;
+
+
+    if (open_ended && chunk->data_len < node->session.chunk_size)
+    {
+        // 流式会话中只有最后一块不满，总块数随之确定
+        node->session.last_chunk_len = chunk->data_len;
+        stream_update_total(node, chunk->chunk_id + 1, true);
+    }
+    else if (chunk->chunk_id == node->session.total_chunks - 1)
+    {
+        node->session.last_chunk_len = chunk->data_len;
+    }
+    advance_file_hash(node, chunk);
+
+    // 已有的修复符号可能因这一块而足以恢复所在编码块的其余缺失块
+    fec_try_recover(node, window_id * node->session.window_words + chunk_offset / 64);
+
+    // 检查窗口是否完成
+    check_window_complete(node, window_id);
+    stage_flush(node, window_id, false);
+
+    // 显示进度
+    if (node->session.received_chunks % 100 == 0)
+    {
+        if (node->session.total_final)
+        {
+            printf("[UAV %u] Progress: %u/%u chunks (%.1f%%)\n",
+                   node->uav_id, node->session.received_chunks, node->session.total_chunks,
+                   100.0 * node->session.received_chunks / node->session.total_chunks);
+        }
+        else
+        {
+            printf("[UAV %u] Progress: %u chunks (streaming)\n", node->uav_id, node->session.received_chunks);
+        }
+    }
+}
 
-// ========== 初始化接收方会话 ==========
-bool init_receiver_session(const SessionAnnounce *announce)
+void process_data_chunk(ReceiverNode *node, const DataChunk *chunk)
 {
-    pthread_mutex_lock(&g_session_mutex);
-
-    // 检查是否已有会话
-    if (g_session.session_active && g_session.file_id == announce->file_id)
+    if (chunk->file_id != node->session.file_id || !node->session.session_active)
     {
-        pthread_mutex_unlock(&g_session_mutex);
-        return true; // 会话已存在
+        return;
     }
 
-    memset(&g_session, 0, sizeof(g_session));
+    pthread_mutex_lock(&node->session_mutex);
+    receive_chunk_locked(node, chunk);
+    pthread_mutex_unlock(&node->session_mutex);
+}
 
-    g_session.file_id = announce->file_id;
-    g_session.total_chunks = announce->total_chunks;
-    g_session.window_size = announce->window_size;
-    g_session.chunk_size = announce->chunk_size;
-    strncpy(g_session.filename, announce->filename, sizeof(g_session.filename) - 1);
-    g_session.total_windows = (g_session.total_chunks + g_session.window_size - 1) / g_session.window_size;
+// ========== 前向纠错：由修复符号恢复缺失块 ==========
+// 编码块block_id（窗口号 * window_words + 窗口内的组号）的源块数，编码块不在窗口内时为0
+static uint32_t fec_block_source_count(const ReceiverSession *session, uint32_t block_id)
+{
+    uint32_t offset = block_id % session->window_words * WINDOW_SIZE;
+    uint32_t chunks_in_window = window_chunk_count(session, block_id / session->window_words);
+    if (offset >= chunks_in_window)
+    {
+        return 0;
+    }
+    return chunks_in_window - offset < FEC_MAX_SOURCE ? chunks_in_window - offset : FEC_MAX_SOURCE;
+}
 
-    // 分配窗口状态数组
-    g_session.windows = calloc(g_session.total_windows, sizeof(WindowState));
-    if (!g_session.windows)
+// 编码块缺失m块且已有至少m个修复符号时：从前m个符号中减去全部已收到块的贡献，解出缺失块，
+// 再按普通数据块接收（计入窗口、写盘、文件hash与窗口摘要）。调用者持有session_mutex
+static void fec_try_recover(ReceiverNode *node, uint32_t block_id)
+{
+    ReceiverSession *session = &node->session;
+    uint32_t window_id = block_id / session->window_words;
+    uint32_t group = block_id % session->window_words;
+    WindowState *window = &session->windows[window_id];
+    FecRepairSet *set = window->repairs ? window->repairs[group] : NULL;
+    if (!set || window->completed)
     {
-        perror("Failed to allocate window states");
-        pthread_mutex_unlock(&g_session_mutex);
-        return false;
+        return;
     }
 
-    // 初始化窗口状态（不再需要缓冲区，改为立即写入文件）
-    for (uint32_t i = 0; i < g_session.total_windows; i++)
+    // 编码块对应窗口位图的一个字
+    uint64_t received = window_bitmap(session, window_id)[group];
+    uint32_t source_count = fec_block_source_count(session, block_id);
+    uint8_t missing[WINDOW_SIZE];
+    int m = 0;
+    for (uint32_t i = 0; i < source_count; i++)
+    {
+        if (!((received >> i) & 1))
+        {
+            missing[m++] = i;
+        }
+    }
+    if (m == 0 || set->count < (uint32_t)m)
     {
-        g_session.windows[i].window_id = i;
-        g_session.windows[i].received_bitmap = 0;
-        g_session.windows[i].completed = false;
-        // g_session.windows[i].data_buffer = NULL; // 不再需要缓冲区
+        return;
     }
 
-    // 打开输出文件（每个UAV使用独立的文件名）
-    char output_filename[128];
-    snprintf(output_filename, sizeof(output_filename), "received_uav%u_%s", g_uav_id, g_session.filename);
-    g_session.output_file = fopen(output_filename, "wb");
-    if (!g_session.output_file)
+    // 符号数据原地变为校正子；任一步失败时丢弃这些符号，等待Master再次发送
+    window->repairs[group] = NULL;
+    uint32_t start_chunk = window_id * session->window_size + group * WINDOW_SIZE;
+    uint8_t *syndromes[WINDOW_SIZE];
+    for (int a = 0; a < m; a++)
     {
-        perror("Failed to open output file");
-        pthread_mutex_unlock(&g_session_mutex);
-        return false;
+        syndromes[a] = set->data + (size_t)a * set->symbol_len;
     }
 
-    g_session.session_active = true;
-    g_session.received_chunks = 0;
+    uint8_t buffer[MAX_CHUNK_SIZE];
+    for (uint32_t i = 0; i < source_count; i++)
+    {
+        if (!((received >> i) & 1))
+        {
+            continue;
+        }
+        size_t len = i == source_count - 1 ? set->last_len : set->symbol_len;
+        if (!load_chunk(node, start_chunk + i, buffer, len))
+        {
+            perror("Failed to read back chunk for FEC decoding");
+            free(set);
+            return;
+        }
+        memset(buffer + len, 0, set->symbol_len - len);
+        for (int a = 0; a < m; a++)
+        {
+            gf256_mul_add(syndromes[a], buffer, fec_coefficient(set->index[a], i), set->symbol_len);
+        }
+    }
 
-    printf("[UAV %u] Session initialized:\n", g_uav_id);
-    printf("  File: %s\n", g_session.filename);
-    printf("  Total chunks: %u\n", g_session.total_chunks);
-    printf("  Total windows: %u\n", g_session.total_windows);
-    printf("  Output: %s\n", output_filename);
+    // 恢复出的块直接解到DataChunk中（留出CRC32C尾部的空间）
+    size_t chunk_stride = offsetof(DataChunk, data) + set->symbol_len + sizeof(uint32_t);
+    uint8_t *chunks = calloc(m, chunk_stride);
+    uint8_t *out[WINDOW_SIZE];
+    for (int b = 0; chunks && b < m; b++)
+    {
+        out[b] = ((DataChunk *)(chunks + b * chunk_stride))->data;
+    }
+    if (!chunks || !fec_solve(set->index, missing, m, syndromes, out, set->symbol_len))
+    {
+        printf("[UAV %u] FEC decoding failed for block %u of window %u\n", node->uav_id, group, window_id);
+        free(chunks);
+        free(set);
+        return;
+    }
 
-    pthread_mutex_unlock(&g_session_mutex);
-    return true;
+    printf("[UAV %u] Recovered %d chunks of window %u (block %u) from repair symbols\n", node->uav_id, m, window_id,
+           group);
+    node->fec_recovered += m;
+    for (int b = 0; b < m; b++)
+    {
+        DataChunk *chunk = (DataChunk *)(chunks + b * chunk_stride);
+        chunk->header.msg_type = MSG_DATA_CHUNK;
+        chunk->file_id = session->file_id;
+        chunk->chunk_id = start_chunk + missing[b];
+        chunk->data_len = missing[b] == source_count - 1 ? set->last_len : set->symbol_len;
+        receive_chunk_locked(node, chunk);
+    }
+    free(chunks);
+    free(set);
 }
 
-// ========== 处理接收到的数据块 ==========
-void process_data_chunk(const DataChunk *chunk)
+// ========== 处理修复符号（REPAIR） ==========
+void process_repair_symbol(ReceiverNode *node, const RepairSymbol *msg)
 {
-    if (chunk->file_id != g_session.file_id || !g_session.session_active)
+    if (msg->file_id != node->session.file_id || !node->session.session_active)
     {
         return;
     }
 
-    if (chunk->chunk_id >= g_session.total_chunks)
+    pthread_mutex_lock(&node->session_mutex);
+    ReceiverSession *session = &node->session;
+    uint32_t window_id = msg->block_id / session->window_words;
+    uint32_t group = msg->block_id % session->window_words;
+    if (window_id >= session->total_windows || window_id * session->window_size >= session->total_chunks)
     {
-        return; // 超出范围
+        pthread_mutex_unlock(&node->session_mutex);
+        return;
     }
 
-    // 验证CRC
-    uint16_t calc_crc = crc16(chunk->data, chunk->data_len);
-    if (calc_crc != chunk->crc)
+    WindowState *window = &session->windows[window_id];
+    uint32_t source_count = fec_block_source_count(session, msg->block_id);
+    if (window->completed || source_count == 0 || msg->source_count != source_count ||
+        msg->symbol_len > session->chunk_size || (source_count > 1 && msg->symbol_len != session->chunk_size))
     {
-        printf("[UAV %u] CRC error for chunk %u, discarding.\n", g_uav_id, chunk->chunk_id);
+        pthread_mutex_unlock(&node->session_mutex);
         return;
     }
 
-    pthread_mutex_lock(&g_session_mutex);
-
-    uint32_t window_id = chunk->chunk_id / g_session.window_size;
-    uint32_t chunk_offset = chunk->chunk_id % g_session.window_size;
-
-    WindowState *window = &g_session.windows[window_id];
-
-    // 检查是否已经收到过
-    if (window->received_bitmap & (1ULL << chunk_offset))
+    if (!window->repairs)
     {
-        pthread_mutex_unlock(&g_session_mutex);
-        return; // 已收到，跳过
+        window->repairs = calloc(session->window_words, sizeof(FecRepairSet *));
     }
-
-    // 标记为已收到
-    window->received_bitmap |= (1ULL << chunk_offset);
-    g_session.received_chunks++;
-
-    // 立即写入文件（不等待窗口完成）
-    fseek(g_session.output_file, chunk->chunk_id * MAX_CHUNK_SIZE, SEEK_SET);
-    fwrite(chunk->data, 1, chunk->data_len, g_session.output_file);
-    fflush(g_session.output_file);
-
-    // 检查窗口是否完成
-    uint32_t chunks_in_window = (window_id == g_session.total_windows - 1) ? (g_session.total_chunks - window_id * g_session.window_size) : g_session.window_size;
-
-    // 特殊处理：当chunks_in_window=64时，(1ULL << 64)是未定义行为
-    uint64_t expected_bitmap;
-    if (chunks_in_window == 64)
+    FecRepairSet *set = window->repairs ? window->repairs[group] : NULL;
+    if (window->repairs && !set)
     {
-        expected_bitmap = 0xFFFFFFFFFFFFFFFFULL; // 64个1
+        set = malloc(sizeof(FecRepairSet) + (size_t)source_count * msg->symbol_len);
+        if (set)
+        {
+            set->count = 0;
+            set->symbol_len = msg->symbol_len;
+            set->last_len = msg->last_len;
+            window->repairs[group] = set;
+        }
     }
-    else
+    if (!set)
     {
-        expected_bitmap = (1ULL << chunks_in_window) - 1;
+        perror("Failed to allocate repair symbols");
+        pthread_mutex_unlock(&node->session_mutex);
+        return;
     }
 
-    if (window->received_bitmap == expected_bitmap)
+    // 同一编号只保留一份；超过源块数的符号不会再有用
+    bool duplicate = set->symbol_len != msg->symbol_len || set->last_len != msg->last_len;
+    for (uint32_t a = 0; a < set->count && !duplicate; a++)
     {
-        window->completed = true;
-
-        // 释放窗口缓冲区（数据已写入文件）
-        // if (window->data_buffer)
-        // {
-        //     free(window->data_buffer);
-        //     window->data_buffer = NULL;
-        // }
-
-        printf("[UAV %u] Window %u completed and saved.\n", g_uav_id, window_id);
+        duplicate = set->index[a] == msg->repair_index;
     }
-
-    // 显示进度
-    if (g_session.received_chunks % 100 == 0)
+    if (!duplicate && set->count < source_count)
     {
-        printf("[UAV %u] Progress: %u/%u chunks (%.1f%%)\n",
-               g_uav_id, g_session.received_chunks, g_session.total_chunks,
-               100.0 * g_session.received_chunks / g_session.total_chunks);
+        set->index[set->count] = msg->repair_index;
+        memcpy(set->data + (size_t)set->count * set->symbol_len, msg->data, msg->symbol_len);
+        set->count++;
+        node->fec_symbols++;
+        fec_try_recover(node, msg->block_id);
     }
-
-    pthread_mutex_unlock(&g_session_mutex);
+    pthread_mutex_unlock(&node->session_mutex);
 }
 
-// ========== NACK定时器线程 ==========
-void *nack_timer_thread(void *arg)
+// ========== 退避到期：发送（或放弃被抑制的）NACK ==========
+// 调用者持有nack_mutex
+static void send_nack_locked(ReceiverNode *node)
 {
-    NackContext *ctx = (NackContext *)arg;
-
-    usleep(ctx->pending_timeout_ms * 1000);
-
-    pthread_mutex_lock(&g_nack_mutex);
+    NackContext *ctx = &node->nack;
 
     if (!ctx->suppressed && ctx->active)
     {
@@ -180,337 +1368,582 @@ void *nack_timer_thread(void *arg)
         NackMessage nack;
         memset(&nack, 0, sizeof(nack));
         nack.header.msg_type = MSG_NACK;
-        nack.header.payload_len = sizeof(NackMessage) - sizeof(MessageHeader);
-        nack.file_id = g_session.file_id;
+        nack.file_id = node->session.file_id;
         nack.window_id = ctx->window_id;
         nack.round_id = ctx->round_id;
-        nack.uav_id = g_uav_id;
-        nack.missing_bitmap = ctx->my_missing_bitmap;
+        nack.uav_id = node->uav_id;
+        memcpy(nack.missing_bitmap, ctx->my_missing_bitmap, sizeof(nack.missing_bitmap));
+        if (ctx->need_digest)
+        {
+            nack.header.ver_flags = WIRE_FLAG_DIGEST_REQ;
+        }
 
-        transport_send(&nack, sizeof(nack));
+        size_t nack_len = wire_encode(&nack, node->session.wire_version);
+        transport_send(&nack, nack_len);
 
-        int missing_count = count_set_bits(ctx->my_missing_bitmap);
-        printf("[UAV %u] Sent NACK for window %u (missing %d chunks)\n",
-               g_uav_id, ctx->window_id, missing_count);
+        uint32_t missing_count = bitmap_popcount(ctx->my_missing_bitmap, MAX_WINDOW_WORDS);
+        printf("[UAV %u] Sent NACK for window %u (missing %u chunks)\n",
+               node->uav_id, ctx->window_id, missing_count);
     }
     else if (ctx->suppressed)
     {
         printf("[UAV %u] NACK suppressed for window %u (covered by others)\n",
-               g_uav_id, ctx->window_id);
+               node->uav_id, ctx->window_id);
     }
 
     ctx->active = false;
-    pthread_mutex_unlock(&g_nack_mutex);
+}
+
+// 只发送generation对应的那一次调度：之后已重新调度过则由新的定时器负责
+static void send_pending_nack(ReceiverNode *node, uint32_t generation)
+{
+    pthread_mutex_lock(&node->nack_mutex);
+    if (node->nack.generation == generation)
+    {
+        send_nack_locked(node);
+    }
+    pthread_mutex_unlock(&node->nack_mutex);
+}
+
+// ========== NACK定时器线程 ==========
+typedef struct
+{
+    ReceiverNode *node;
+    uint32_t generation;
+    uint64_t timeout_ms;
+} NackTimerArg;
+
+void *nack_timer_thread(void *arg)
+{
+    NackTimerArg timer = *(NackTimerArg *)arg;
+    free(arg);
+
+    usleep(timer.timeout_ms * 1000);
+    send_pending_nack(timer.node, timer.generation);
 
     return NULL;
 }
 
+// ========== NACK定时器回调（事件循环模式） ==========
+static void nack_timer_fire(void *arg)
+{
+    ReceiverNode *node = (ReceiverNode *)arg;
+    send_pending_nack(node, node->nack.generation);
+}
+
 // ========== 处理状态查询（STATUS_REQ） ==========
-void process_status_request(const StatusRequest *req)
+void process_status_request(ReceiverNode *node, const StatusRequest *req)
 {
-    if (req->file_id != g_session.file_id || !g_session.session_active)
+    if (req->file_id != node->session.file_id || !node->session.session_active)
     {
         return;
     }
 
     uint32_t window_id = req->window_id;
-    if (window_id >= g_session.total_windows)
+
+    pthread_mutex_lock(&node->session_mutex);
+    if (WIRE_GET_FLAGS(req->header.ver_flags) & WIRE_FLAG_STREAM)
+    {
+        // 只有写满或流结束后窗口才会被查询：被查询的窗口不满说明流已结束
+        stream_update_total(node, req->total_chunks,
+                            req->total_chunks < (window_id + 1) * (uint32_t)node->session.window_size);
+    }
+    if (window_id >= node->session.total_windows ||
+        window_id * node->session.window_size >= node->session.total_chunks)
     {
+        pthread_mutex_unlock(&node->session_mutex);
         return;
     }
 
-    pthread_mutex_lock(&g_session_mutex);
-    WindowState *window = &g_session.windows[window_id];
+    WindowState *window = &node->session.windows[window_id];
+    uint32_t chunks_in_window = window_chunk_count(&node->session, window_id);
+    uint32_t words = node->session.window_words;
+
+    // 计算缺失的块（窗口块数之外的位与字为0，NACK编码时省略末尾全0的字）
+    uint64_t missing_bitmap[MAX_WINDOW_WORDS] = {0};
+    const uint64_t *received_bitmap = window_bitmap(&node->session, window_id);
+    bitmap_missing(missing_bitmap, received_bitmap, chunks_in_window);
+    uint32_t received_count = bitmap_popcount(received_bitmap, words);
+    bool need_digest = node->session.merkle_enabled && window->completed && !window->digest_known;
+    uint64_t first_word = received_bitmap[0];
+    pthread_mutex_unlock(&node->session_mutex);
 
-    uint64_t received_bitmap = window->received_bitmap;
-    pthread_mutex_unlock(&g_session_mutex);
+    uint32_t missing_count = bitmap_popcount(missing_bitmap, words);
 
-    // 计算缺失的块数量
-    uint32_t chunks_in_window = (window_id == g_session.total_windows - 1) ? (g_session.total_chunks - window_id * g_session.window_size) : g_session.window_size;
+    printf("[UAV %u] Received STATUS_REQ for window %u (round %u)\n", node->uav_id, window_id, req->round_id);
 
-    // 特殊处理：当chunks_in_window=64时，(1ULL << 64)是未定义行为
-    uint64_t expected_bitmap;
-    if (chunks_in_window == 64)
+    if (words == 1)
     {
-        expected_bitmap = 0xFFFFFFFFFFFFFFFFULL; // 64个1
+        printf("[UAV %u] Window %u status: received %u/%u chunks, received_bitmap=0x%llx, missing_bitmap=0x%llx\n",
+               node->uav_id, window_id, received_count, chunks_in_window, (unsigned long long)first_word,
+               (unsigned long long)missing_bitmap[0]);
     }
     else
     {
-        expected_bitmap = (1ULL << chunks_in_window) - 1;
-    }
-    uint64_t missing_bitmap = expected_bitmap & (~received_bitmap);
-
-    // 统计收到的块数
-    int received_count = 0;
-    for (int i = 0; i < chunks_in_window; i++)
-    {
-        if (received_bitmap & (1ULL << i))
-        {
-            received_count++;
-        }
+        uint32_t first_missing = bitmap_next_set(missing_bitmap, 0, chunks_in_window);
+        printf("[UAV %u] Window %u status: received %u/%u chunks (%u-word bitmap), first missing chunk offset %d\n",
+               node->uav_id, window_id, received_count, chunks_in_window, words,
+               first_missing < chunks_in_window ? (int)first_missing : -1);
     }
 
-    printf("[UAV %u] Received STATUS_REQ for window %u (round %u)\n", g_uav_id, window_id, req->round_id);
+    printf("[UAV %u] Window %u: Sending bitmap response (round %u, missing %u chunks)\n",
+           node->uav_id, window_id, req->round_id, missing_count);
 
-    printf("[UAV %u] Window %u status: received %d/%u chunks, received_bitmap=0x%llx, expected_bitmap=0x%llx, missing_bitmap=0x%llx\n",
-           g_uav_id, window_id, received_count, chunks_in_window,
-           (unsigned long long)received_bitmap,
-           (unsigned long long)expected_bitmap,
-           (unsigned long long)missing_bitmap);
+    // 启动NACK延迟线程
+    pthread_mutex_lock(&node->nack_mutex);
 
-    // 计算缺失块数量（用于日志）
-    int missing_count = 0;
-    for (int i = 0; i < 64; i++)
+    // 如果已有未完成的timer，先取消它
+    if (node->nack.active)
     {
-        if (missing_bitmap & (1ULL << i))
+        // 上一个还没发完？ 这里我们简单地覆盖它，因为Master发起了新的查询
+        // 线程模式下旧的退避线程不取消：generation变化后它醒来时直接放弃
+        if (g_event_loop)
         {
-            missing_count++;
+            evloop_timer_cancel(node->nack.timer_id);
         }
-    }
-    printf("[UAV %u] Window %u: Sending bitmap response (round %u, missing %d chunks)\n",
-           g_uav_id, window_id, req->round_id, missing_count);
-
-    // 启动NACK延迟线程
-    pthread_mutex_lock(&g_nack_mutex);
-
-    // 如果已有未完成的timer，先取消它（简单起见，这里假设同一时间只有一个活动窗口查询）
-    // 实际应用中可能需要更复杂的队列，但在此协议中Master是串行查询窗口的
-    if (g_nack_ctx.active)
-    {
-        // 上一个还没发完？ 强制停止或其他逻辑
-        // 这里我们简单地覆盖它，因为Master发起了新的查询
-        if (g_nack_ctx.timer_thread)
+        // Master多窗口滑动发送时不同窗口的查询交错到达：另一个窗口的NACK立即发出而不丢弃
+        if (node->nack.window_id != window_id)
         {
-            pthread_cancel(g_nack_ctx.timer_thread);
-            pthread_join(g_nack_ctx.timer_thread, NULL);
+            send_nack_locked(node);
         }
     }
 
-    g_nack_ctx.active = true;
-    g_nack_ctx.suppressed = false;
-    g_nack_ctx.window_id = window_id;
-    g_nack_ctx.round_id = req->round_id;
-    g_nack_ctx.my_missing_bitmap = missing_bitmap;
+    node->nack.generation++;
+    node->nack.active = true;
+    node->nack.suppressed = false;
+    node->nack.window_id = window_id;
+    node->nack.round_id = req->round_id;
+    memcpy(node->nack.my_missing_bitmap, missing_bitmap, sizeof(missing_bitmap));
+    node->nack.need_digest = need_digest;
 
     // 计算随机退避时间 (0 ~ NACK_TIMEOUT_MS)
-    g_nack_ctx.pending_timeout_ms = rand() % NACK_TIMEOUT_MS;
+    node->nack.pending_timeout_ms = rand_r(&node->rand_seed) % NACK_TIMEOUT_MS;
 
     printf("[UAV %u] Schedule NACK for window %u in %lu ms\n",
-           g_uav_id, window_id, g_nack_ctx.pending_timeout_ms);
+           node->uav_id, window_id, node->nack.pending_timeout_ms);
 
-    pthread_create(&g_nack_ctx.timer_thread, NULL, nack_timer_thread, &g_nack_ctx);
-    // 需要detach或者join，这里使用detach让它自生自灭
-    pthread_detach(g_nack_ctx.timer_thread);
+    if (g_event_loop)
+    {
+        // 事件循环模式：退避由timerfd定时器驱动，回调在事件循环线程中发送NACK
+        node->nack.timer_id = evloop_timer_start(node->nack.pending_timeout_ms, nack_timer_fire, node);
+    }
+    else
+    {
+        NackTimerArg *timer = malloc(sizeof(NackTimerArg));
+        pthread_t thread;
+        if (timer)
+        {
+            timer->node = node;
+            timer->generation = node->nack.generation;
+            timer->timeout_ms = node->nack.pending_timeout_ms;
+        }
+        if (!timer || pthread_create(&thread, NULL, nack_timer_thread, timer) != 0)
+        {
+            // 无法启动退避线程时立即发送，避免这一轮没有应答
+            free(timer);
+            send_nack_locked(node);
+        }
+        else
+        {
+            // 线程不被取消或join，detach后自生自灭
+            pthread_detach(thread);
+        }
+    }
 
-    pthread_mutex_unlock(&g_nack_mutex);
+    pthread_mutex_unlock(&node->nack_mutex);
 }
 
 // ========== 处理其他节点的NACK（用于抑制） ==========
-void process_other_nack(const NackMessage *nack)
+void process_other_nack(ReceiverNode *node, const NackMessage *nack)
 {
-    if (nack->file_id != g_session.file_id || !g_session.session_active)
+    if (nack->file_id != node->session.file_id || !node->session.session_active)
     {
         return;
     }
 
-    if (nack->uav_id == g_uav_id)
+    if (nack->uav_id == node->uav_id)
     {
         return; // 忽略自己的NACK
     }
 
-    pthread_mutex_lock(&g_nack_mutex);
+    pthread_mutex_lock(&node->nack_mutex);
 
     // 如果我有pending的NACK，且与收到的NACK相关
-    if (g_nack_ctx.active &&
-        g_nack_ctx.window_id == nack->window_id &&
-        g_nack_ctx.round_id == nack->round_id)
+    if (node->nack.active &&
+        node->nack.window_id == nack->window_id &&
+        node->nack.round_id == nack->round_id)
     {
 
         // 检查对方的NACK是否覆盖了我的需求
-        if (bitmap_covers(nack->missing_bitmap, g_nack_ctx.my_missing_bitmap))
+        uint64_t other_missing[MAX_WINDOW_WORDS];
+        memcpy(other_missing, nack->missing_bitmap, sizeof(other_missing)); // packed结构体，复制到对齐的数组
+        if (bitmap_is_subset(node->nack.my_missing_bitmap, other_missing, MAX_WINDOW_WORDS))
         {
             // 对方的NACK已经涵盖了我的缺失块，抑制我的NACK
-            // g_nack_ctx.suppressed = true;
-            printf("[UAV %u] NACK suppression DISABLED (was window %u)\n", g_uav_id, nack->window_id);
+            // node->nack.suppressed = true;
+            printf("[UAV %u] NACK suppression DISABLED (was window %u)\n", node->uav_id, nack->window_id);
         }
     }
 
-    pthread_mutex_unlock(&g_nack_mutex);
+    pthread_mutex_unlock(&node->nack_mutex);
 }
 
 // ========== 处理结束消息 ==========
-void process_end_message(const EndMessage *end_msg)
+void process_end_message(ReceiverNode *node, const EndMessage *end_msg)
 {
-    if (end_msg->file_id != g_session.file_id || !g_session.session_active)
+    if (end_msg->file_id != node->session.file_id || !node->session.session_active)
     {
         return;
     }
 
-    printf("[UAV %u] Received END message, verifying file...\n", g_uav_id);
+    printf("[UAV %u] Received END message, verifying file...\n", node->uav_id);
+
+    pthread_mutex_lock(&node->session_mutex);
 
-    pthread_mutex_lock(&g_session_mutex);
+    // 流式会话由END确定最终块数
+    stream_update_total(node, end_msg->total_chunks, true);
 
     // 检查是否收齐所有块
-    bool all_received = (g_session.received_chunks == g_session.total_chunks);
+    bool all_received = (node->session.received_chunks == node->session.total_chunks);
 
     if (!all_received)
     {
         printf("[UAV %u] WARNING: File incomplete! Received %u/%u chunks\n",
-               g_uav_id, g_session.received_chunks, g_session.total_chunks);
-        pthread_mutex_unlock(&g_session_mutex);
+               node->uav_id, node->session.received_chunks, node->session.total_chunks);
+        pthread_mutex_unlock(&node->session_mutex);
         return;
     }
 
-    // 验证文件hash（关闭并重新打开确保所有数据已写入）
-    fflush(g_session.output_file);
-    fclose(g_session.output_file);
-
-    char output_filename[128];
-    snprintf(output_filename, sizeof(output_filename), "received_%s", g_session.filename);
-    FILE *verify_file = fopen(output_filename, "rb");
-    if (!verify_file)
+    // 收齐时流式hash已覆盖整个文件，直接比较，无需重新读取
+    if (node->session.hashed_chunks != node->session.total_chunks)
     {
-        pthread_mutex_unlock(&g_session_mutex);
+        printf("[UAV %u] WARNING: File hash incomplete (%u/%u chunks hashed)\n",
+               node->uav_id, node->session.hashed_chunks, node->session.total_chunks);
+        pthread_mutex_unlock(&node->session_mutex);
         return;
     }
 
-    uint8_t *file_buffer = malloc(g_session.total_chunks * MAX_CHUNK_SIZE);
-    if (file_buffer)
+    // 使用hash64时比较END携带的64位hash（END缺少该字段视为不一致）
+    uint64_t calc_hash = file_hasher_final(&node->session.file_hash);
+    uint64_t expected_hash = end_msg->file_hash;
+    if (node->session.file_hash.type == FILE_HASH_HASH64)
+    {
+        expected_hash = (WIRE_GET_FLAGS(end_msg->header.ver_flags) & WIRE_FLAG_HASH64) ? end_msg->file_hash64 : ~calc_hash;
+    }
+
+    if (calc_hash == expected_hash)
     {
-        size_t total_read = fread(file_buffer, 1, g_session.total_chunks * MAX_CHUNK_SIZE,
-                                  verify_file);
-        uint32_t calc_hash = simple_hash(file_buffer, total_read);
-        free(file_buffer);
+        // 报告成功前确保数据已写入（--fsync end时同步到磁盘）
+        stage_drain(node);
+        if (g_fsync_policy == FSYNC_END)
+        {
+            fdatasync(node->session.output_fd);
+        }
+        resume_remove(node);
 
-        if (calc_hash == end_msg->file_hash)
+        printf("[UAV %u] ✓ File transfer completed successfully!\n", node->uav_id);
+        printf("[UAV %u] ✓ Hash verified (%s): 0x%0*llX\n", node->uav_id, file_hash_name(node->session.file_hash.type),
+               node->session.file_hash.type == FILE_HASH_HASH64 ? 16 : 8, (unsigned long long)calc_hash);
+        if (node->session.merkle_enabled)
         {
-            printf("[UAV %u] ✓ File transfer completed successfully!\n", g_uav_id);
-            printf("[UAV %u] ✓ Hash verified: 0x%08X\n", g_uav_id, calc_hash);
-            printf("[UAV %u] ✓ File saved as: received_%s\n", g_uav_id, g_session.filename);
-            g_session.session_active = false; // 标记会话完成
+            printf("[UAV %u] ✓ Windows verified against Merkle root: %u/%u\n", node->uav_id,
+                   node->session.verified_windows, node->session.total_windows);
         }
-        else
+        printf("[UAV %u] ✓ File saved as: received_uav%u_%s\n", node->uav_id, node->uav_id, node->session.filename);
+        printf("[UAV %u] Disk writes: %llu batches, %llu pwritev calls, %llu KB (fsync: %s)\n", node->uav_id,
+               (unsigned long long)node->write_batches, (unsigned long long)node->write_calls,
+               (unsigned long long)(node->write_bytes / 1024),
+               g_fsync_policy == FSYNC_NONE ? "none" : (g_fsync_policy == FSYNC_END ? "end" : "window"));
+        if (node->fec_symbols > 0)
+        {
+            printf("[UAV %u] FEC: %llu repair symbols received, %llu chunks recovered locally (%s)\n", node->uav_id,
+                   (unsigned long long)node->fec_symbols, (unsigned long long)node->fec_recovered, gf256_impl_name());
+        }
+        node->session.session_active = false; // 标记会话完成
+
+        char tag[16];
+        snprintf(tag, sizeof(tag), "[UAV %u]", node->uav_id);
+        transport_print_stats(tag);
+    }
+    else
+    {
+        printf("[UAV %u] ✗ Hash mismatch! Expected 0x%llX, got 0x%llX, discarding received chunks\n", node->uav_id,
+               (unsigned long long)expected_hash, (unsigned long long)calc_hash);
+        reset_all_windows(node);
+    }
+
+    pthread_mutex_unlock(&node->session_mutex);
+}
+
+// ========== 处理收到的报文 ==========
+static void dispatch_message(ReceiverNode *node, const uint8_t *buffer)
+{
+    const MessageHeader *header = (const MessageHeader *)buffer;
+
+    switch (header->msg_type)
+    {
+    case MSG_SESSION_ANNOUNCE:
+        init_receiver_session(node, (const SessionAnnounce *)buffer);
+        break;
+
+    case MSG_DATA_CHUNK:
+        process_data_chunk(node, (const DataChunk *)buffer);
+        break;
+
+    case MSG_STATUS_REQ:
+        process_status_request(node, (const StatusRequest *)buffer);
+        break;
+
+    case MSG_NACK:
+        process_other_nack(node, (const NackMessage *)buffer);
+        break;
+
+    case MSG_END:
+        process_end_message(node, (const EndMessage *)buffer);
+        break;
+
+    case MSG_WINDOW_DIGEST:
+        process_window_digest(node, (const WindowDigestMessage *)buffer);
+        break;
+
+    case MSG_REPAIR:
+        process_repair_symbol(node, (const RepairSymbol *)buffer);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void handle_message(PacketBuf *pkt, void *arg)
+{
+    uint8_t *buffer = pkt->data;
+    size_t recv_len = pkt->len;
+
+    // 校验payload_len与实际接收长度，并原地解码为主机字节序（只解码一次，各UAV共享只读视图）
+    if (!wire_decode(buffer, recv_len))
+    {
+        packet_release(pkt);
+        return;
+    }
+
+    // 数据块的CRC与接收方无关，分发前校验一次
+    if (buffer[0] == MSG_DATA_CHUNK)
+    {
+        const DataChunk *chunk = (const DataChunk *)buffer;
+        if (!chunk_verify_checksum(chunk))
+        {
+            printf("[UAV %u] CRC error for chunk %u, discarding.\n", g_nodes[0].uav_id, chunk->chunk_id);
+            packet_release(pkt);
+            return;
+        }
+    }
+    else if (buffer[0] == MSG_REPAIR)
+    {
+        const RepairSymbol *repair = (const RepairSymbol *)buffer;
+        if (crc32c(repair->data, repair->symbol_len) != repair->crc)
+        {
+            printf("[UAV %u] CRC error for repair symbol %u of block %u, discarding.\n", g_nodes[0].uav_id,
+                   repair->repair_index, repair->block_id);
+            packet_release(pkt);
+            return;
+        }
+    }
+
+    for (int i = 0; i < g_node_count; i++)
+    {
+        // 模拟网络下每个UAV有独立的丢包序列
+        if (transport_sim_node_drop(g_nodes[i].uav_id))
         {
-            printf("[UAV %u] ✗ Hash mismatch! Expected 0x%08X, got 0x%08X\n",
-                   g_uav_id, end_msg->file_hash, calc_hash);
+            continue;
         }
+        dispatch_message(&g_nodes[i], buffer);
     }
 
-    fclose(verify_file);
-    pthread_mutex_unlock(&g_session_mutex);
+    packet_release(pkt);
 }
 
 // ========== 消息接收主循环 ==========
 void *message_receiver_thread(void *arg)
 {
-    uint8_t buffer[MAX_PACKET_SIZE];
-
-    printf("[UAV %u] Message receiver thread started.\n", g_uav_id);
+    printf("[UAV %u] Message receiver thread started.\n", g_nodes[0].uav_id);
 
     while (1)
     {
-        size_t recv_len = transport_recv(buffer, sizeof(buffer));
-        if (recv_len < sizeof(MessageHeader))
+        // 直接解析recvmmsg写入的缓冲池报文，处理完后释放
+        PacketBuf *pkt = transport_recv_packet();
+        if (!pkt)
         {
-            continue;
+            break;
+        }
+        handle_message(pkt, NULL);
+    }
+
+    return NULL;
+}
+
+// ========== 清理资源 ==========
+void cleanup_receiver_session(ReceiverNode *node)
+{
+    pthread_mutex_lock(&node->session_mutex);
+    close_output(node);
+    pthread_mutex_unlock(&node->session_mutex);
+    if (node->session.windows)
+    {
+        for (uint32_t i = 0; i < node->session.total_windows; i++)
+        {
+            free(node->session.windows[i].chunk_hashes);
+            fec_free_repairs(&node->session, &node->session.windows[i]);
         }
+        free(node->session.windows);
+    }
+    free(node->session.bitmaps);
+    free(node->session.hash_checkpoints);
+}
 
-        MessageHeader *header = (MessageHeader *)buffer;
+static void print_usage(const char *prog)
+{
+    printf("Usage: %s [options] <uav_id>\n", prog);
+    printf("Options:\n");
+    printf("  --uavs <n>       Host n virtual UAVs (IDs uav_id .. uav_id+n-1) on one transport (default 1)\n");
+    printf("  --event-loop     Single-threaded epoll/timerfd runtime\n");
+    printf("  --transport <socket|uring|sim>  Transport backend (default socket)\n");
+    printf("  --sim <spec>     Simulated network for --transport sim, e.g. loss=5,delay_ms=20,seed=7\n");
+    printf("  --offload        Enable UDP GRO/GSO (socket backend)\n");
+    printf("  --write-batch <KB>  Write staged chunks once this many KB are buffered (default: one full window, at most %d chunks)\n",
+           WRITE_STAGE_SLOTS);
+    printf("  --fsync <none|end|window>  Sync output to disk at END (default), after every window, or never\n");
+    printf("  --mtu <auto|n>   Path MTU that sizes receive buffers; larger announced chunks are refused (default auto = MTU of the route to the multicast group, %d-%d)\n",
+           MIN_MTU, MAX_MTU);
+}
 
-        switch (header->msg_type)
+// ========== 主函数 ==========
+int main(int argc, char *argv[])
+{
+    TransportBackend backend = TRANSPORT_BACKEND_THREADS;
+    uint32_t mtu = 0;
+    SimNetConfig sim;
+    sim_parse_config(NULL, &sim);
+
+    static const struct option long_options[] = {
+        {"uavs", required_argument, NULL, 'n'},
+        {"event-loop", no_argument, NULL, 'e'},
+        {"transport", required_argument, NULL, 't'},
+        {"offload", no_argument, NULL, 'o'},
+        {"sim", required_argument, NULL, 's'},
+        {"write-batch", required_argument, NULL, 'b'},
+        {"fsync", required_argument, NULL, 'f'},
+        {"mtu", required_argument, NULL, 'U'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:et:os:b:f:U:h", long_options, NULL)) != -1)
+    {
+        switch (opt)
         {
-        case MSG_SESSION_ANNOUNCE:
-            if (recv_len >= sizeof(SessionAnnounce))
+        case 'n':
+            g_node_count = atoi(optarg);
+            if (g_node_count < 1 || g_node_count > RECEIVER_MAX_UAVS)
             {
-                SessionAnnounce *announce = (SessionAnnounce *)buffer;
-                init_receiver_session(announce);
+                fprintf(stderr, "--uavs must be between 1 and %d\n", RECEIVER_MAX_UAVS);
+                return 1;
             }
             break;
-
-        case MSG_DATA_CHUNK:
-            if (recv_len >= sizeof(DataChunk))
+        case 'e':
+            g_event_loop = true;
+            break;
+        case 't':
+            if (!transport_parse_backend(optarg, &backend))
             {
-                // ========== 应用层丢包模拟（每个接收方独立）==========
-#if SIMULATE_PACKET_LOSS > 0
-                // 每个接收方独立地随机丢弃数据包
-                int random_value = rand() % 100;
-                if (random_value < SIMULATE_PACKET_LOSS)
-                {
-                    // 模拟丢包：忽略此数据块
-                    break;
-                }
-#endif
-                DataChunk *chunk = (DataChunk *)buffer;
-                process_data_chunk(chunk);
+                fprintf(stderr, "Unknown transport backend: %s\n", optarg);
+                return 1;
             }
             break;
-
-        case MSG_STATUS_REQ:
-            if (recv_len >= sizeof(StatusRequest))
+        case 'o':
+            transport_set_offload(true);
+            break;
+        case 's':
+            if (!sim_parse_config(optarg, &sim))
             {
-                StatusRequest *req = (StatusRequest *)buffer;
-                process_status_request(req);
+                return 1;
             }
             break;
-
-        case MSG_NACK:
-            if (recv_len >= sizeof(NackMessage))
+        case 'b':
+            g_write_batch_bytes = (size_t)atoi(optarg) * 1024;
+            break;
+        case 'f':
+            if (strcmp(optarg, "none") == 0)
+            {
+                g_fsync_policy = FSYNC_NONE;
+            }
+            else if (strcmp(optarg, "end") == 0)
+            {
+                g_fsync_policy = FSYNC_END;
+            }
+            else if (strcmp(optarg, "window") == 0)
+            {
+                g_fsync_policy = FSYNC_WINDOW;
+            }
+            else
             {
-                NackMessage *nack = (NackMessage *)buffer;
-                process_other_nack(nack);
+                fprintf(stderr, "Unknown fsync policy: %s\n", optarg);
+                return 1;
             }
             break;
-
-        case MSG_END:
-            if (recv_len >= sizeof(EndMessage))
+        case 'U':
+            if (strcmp(optarg, "auto") != 0)
             {
-                EndMessage *end_msg = (EndMessage *)buffer;
-                process_end_message(end_msg);
+                mtu = strtoul(optarg, NULL, 10);
+                if (mtu < MIN_MTU || mtu > MAX_MTU)
+                {
+                    fprintf(stderr, "--mtu must be auto or between %d and %d\n", MIN_MTU, MAX_MTU);
+                    return 1;
+                }
             }
             break;
-
         default:
-            break;
+            print_usage(argv[0]);
+            return 1;
         }
     }
 
-    return NULL;
-}
-
-// ========== 清理资源 ==========
-void cleanup_receiver_session()
-{
-    if (g_session.output_file)
+    if (optind >= argc)
     {
-        fclose(g_session.output_file);
+        print_usage(argv[0]);
+        return 1;
     }
-    if (g_session.windows)
+
+    int first_uav_id = atoi(argv[optind]);
+    if (first_uav_id < 0 || first_uav_id + g_node_count - 1 > UINT8_MAX)
     {
-        for (uint32_t i = 0; i < g_session.total_windows; i++)
-        {
-            // if (g_session.windows[i].data_buffer)
-            // {
-            //     free(g_session.windows[i].data_buffer);
-            // }
-        }
-        free(g_session.windows);
+        fprintf(stderr, "UAV IDs must be within 0-%d\n", UINT8_MAX);
+        return 1;
     }
-    transport_close();
-}
 
-// ========== 主函数 ==========
-int main(int argc, char *argv[])
-{
-    if (argc < 2)
+    g_nodes = calloc(g_node_count, sizeof(ReceiverNode));
+    if (!g_nodes)
     {
-        printf("Usage: %s <uav_id>\n", argv[0]);
+        perror("Failed to allocate receivers");
         return 1;
     }
+    for (int i = 0; i < g_node_count; i++)
+    {
+        ReceiverNode *node = &g_nodes[i];
+        node->uav_id = first_uav_id + i;
+        pthread_mutex_init(&node->session_mutex, NULL);
+        pthread_mutex_init(&node->nack_mutex, NULL);
+        // 初始化随机数种子（用于NACK退避）
+        node->rand_seed = time(NULL) + node->uav_id;
+        node->session.output_fd = -1;
+    }
 
-    g_uav_id = atoi(argv[1]);
-
-    // 初始化随机数种子（用于NACK退避）
-    srand(time(NULL) + g_uav_id);
+    // 写盘线程（事件循环模式为单线程运行，在接收路径上直接写盘）
+    if (!g_event_loop)
+    {
+        writer_start();
+    }
 
     // 禁用输出缓冲，确保日志立即写入
     setbuf(stdout, NULL);
@@ -518,27 +1951,81 @@ int main(int argc, char *argv[])
 
     printf("========================================\n");
     printf("  UAV File Broadcast Receiver\n");
-    printf("  UAV ID: %u\n", g_uav_id);
+    if (g_node_count == 1)
+    {
+        printf("  UAV ID: %u\n", g_nodes[0].uav_id);
+    }
+    else
+    {
+        printf("  UAV IDs: %u-%u (%d receivers)\n", g_nodes[0].uav_id, g_nodes[g_node_count - 1].uav_id,
+               g_node_count);
+    }
     printf("========================================\n");
     fflush(stdout);
 
-    // 初始化传输层 (Receiver是接收方，但也发送NACK)
-    if (!transport_init(false))
+    // 接收缓冲区按本机到组播组的路径MTU分配（Master按同一路径选块大小）；探测失败时按巨帧分配。
+    // 至少容纳DEFAULT_CHUNK_SIZE，v1与旧版Master的定长块总能接收
+    bool mtu_probed = mtu == 0;
+    if (mtu_probed)
+    {
+        mtu = path_mtu_probe();
+    }
+    g_max_chunk_size = mtu ? chunk_size_for_mtu(mtu < MIN_MTU ? MIN_MTU : mtu) : MAX_CHUNK_SIZE;
+    if (g_max_chunk_size < DEFAULT_CHUNK_SIZE)
+    {
+        g_max_chunk_size = DEFAULT_CHUNK_SIZE;
+    }
+    transport_set_packet_size(packet_size_for_chunk(g_max_chunk_size));
+
+    // 每个接收方是模拟网络中的独立节点（独立的丢包序列）
+    sim.node_id = first_uav_id;
+    sim.node_count = g_node_count;
+    transport_set_sim(&sim);
+
+    // 初始化传输层 (Receiver是接收方，但也发送NACK；所有UAV共享)
+    bool transport_ok = g_event_loop ? transport_init_event_loop(false, handle_message, NULL)
+                                     : transport_init_backend(backend, false);
+    if (!transport_ok)
     {
         fprintf(stderr, "Failed to initialize transport layer\n");
         return 1;
     }
+    printf("[UAV %u] Transport: %s\n", g_nodes[0].uav_id, transport_backend_name());
+    if (mtu)
+    {
+        printf("[UAV %u] Receive buffers: chunks up to %u bytes (path MTU %u, %s)\n", g_nodes[0].uav_id,
+               g_max_chunk_size, mtu, mtu_probed ? "probed" : "--mtu");
+    }
+    else
+    {
+        printf("[UAV %u] Receive buffers: chunks up to %u bytes (path MTU unknown)\n", g_nodes[0].uav_id,
+               g_max_chunk_size);
+    }
 
     printf("[UAV %u] Listening for broadcasts on %s:%d\n",
-           g_uav_id, MULTICAST_GROUP, MULTICAST_PORT);
+           g_nodes[0].uav_id, MULTICAST_GROUP, MULTICAST_PORT);
 
-    // 启动消息接收线程
-    pthread_t receiver_thread;
-    pthread_create(&receiver_thread, NULL, message_receiver_thread, NULL);
+    if (g_event_loop)
+    {
+        // 单线程处理socket事件与NACK退避定时器
+        evloop_run();
+    }
+    else
+    {
+        // 启动消息接收线程
+        pthread_t receiver_thread;
+        pthread_create(&receiver_thread, NULL, message_receiver_thread, NULL);
 
-    // 主线程等待
-    pthread_join(receiver_thread, NULL);
+        // 主线程等待
+        pthread_join(receiver_thread, NULL);
+    }
 
-    cleanup_receiver_session();
+    for (int i = 0; i < g_node_count; i++)
+    {
+        cleanup_receiver_session(&g_nodes[i]);
+    }
+    writer_stop();
+    transport_close();
+    free(g_nodes);
     return 0;
 }
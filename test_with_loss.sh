@@ -32,23 +32,16 @@ echo "  丢包测试: ${LOSS_RATE}%"
 echo "=========================================="
 echo ""
 
-# 备份原配置
-if [ ! -f broadcast_protocol.h.backup ]; then
-    cp broadcast_protocol.h broadcast_protocol.h.backup
-    echo "✓ 已备份配置文件"
-fi
-
-# 修改配置
-echo "⚙️  设置丢包率为 ${LOSS_RATE}%..."
-sed -i "s/#define SIMULATE_PACKET_LOSS.*/#define SIMULATE_PACKET_LOSS  ${LOSS_RATE}/" broadcast_protocol.h
+# 丢包由模拟网络传输后端在运行时施加，无需修改配置或重新编译
+SEED=${SEED:-1}
+SIM_SPEC="loss=${LOSS_RATE},seed=${SEED}"
+echo "⚙️  模拟网络: ${SIM_SPEC}（每个接收方独立的丢包序列，相同SEED可复现）"
 
-# 重新编译
+# 编译
 echo "🔨 编译程序..."
 make -f makefile_broadcast clean > /dev/null 2>&1
 if ! make -f makefile_broadcast all > /dev/null 2>&1; then
     echo "❌ 编译失败！"
-    # 恢复配置
-    mv broadcast_protocol.h.backup broadcast_protocol.h
     exit 1
 fi
 echo "✓ 编译完成"
@@ -70,11 +63,11 @@ echo ""
 
 # 启动接收方
 echo "🚁 启动接收方..."
-./receiver 1 > receiver1.log 2>&1 &
+./receiver --transport sim --sim "$SIM_SPEC" 1 > receiver1.log 2>&1 &
 PID1=$!
-./receiver 2 > receiver2.log 2>&1 &
+./receiver --transport sim --sim "$SIM_SPEC" 2 > receiver2.log 2>&1 &
 PID2=$!
-./receiver 3 > receiver3.log 2>&1 &
+./receiver --transport sim --sim "$SIM_SPEC" 3 > receiver3.log 2>&1 &
 PID3=$!
 
 # 等待接收方就绪
@@ -87,7 +80,7 @@ START_TIME=$(date +%s)
 echo "📡 开始文件传输（丢包率=${LOSS_RATE}%）..."
 echo ""
 echo "----------------------------------------"
-./master test_file.bin 1
+./master --transport sim test_file.bin 1
 echo "----------------------------------------"
 echo ""
 
@@ -148,17 +141,6 @@ fi
 
 echo ""
 
-# 恢复配置
-echo "🔄 恢复配置..."
-if [ -f broadcast_protocol.h.backup ]; then
-    mv broadcast_protocol.h.backup broadcast_protocol.h
-fi
-
-# 重新编译为默认配置
-make -f makefile_broadcast clean > /dev/null 2>&1
-make -f makefile_broadcast all > /dev/null 2>&1
-
-echo ""
 echo "=========================================="
 if [ $SUCCESS_COUNT -eq $TOTAL_RECEIVERS ]; then
     echo "  ✅ 测试通过！"